@@ -94,7 +94,7 @@ void parseBlock(osmpbf::PrimitiveBlockInputAdaptor & pbi) {
 int main(int argc, char ** argv) {
 	if (argc < 3) {
 		std::cout << "Need parse type and in file" << std::endl;
-		std::cout << "Parse type may be any of s=single threaded,o=OpenMP,c=C++11 Threads" << std::endl;
+		std::cout << "Parse type may be any of s=single threaded,o=OpenMP,c=C++11 Threads,e=Executor,b=C++11 Threads with a 64 MiB memory budget" << std::endl;
 	}
 	
 	std::string parseType(argv[1]);
@@ -117,6 +117,15 @@ int main(int argc, char ** argv) {
 	else if (parseType == "c") {
 		osmpbf::parseFileCPPThreads(inFile, parseFunc);
 	}
+	else if (parseType == "e") {
+		//the workers of the default executor persist across scans
+		osmpbf::parseFileCPPThreads(osmpbf::Executor::defaultExecutor(), inFile, parseFunc);
+	}
+	else if (parseType == "b") {
+		//at most 64 MiB (plus one blob per thread) of decompressed blobs are fetched but not yet processed
+		osmpbf::MemoryBudget budget(64 << 20);
+		osmpbf::parseFileCPPThreads(inFile, parseFunc, 0, 4, false, 0xFFFFFFFF, &budget);
+	}
 
 	return 0;
 }
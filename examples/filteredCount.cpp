@@ -17,67 +17,96 @@
     License along with this library; if not, see
     <http://www.gnu.org/licenses/>.
  */
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
 #include <osmpbf/parsehelpers.h>
+#include <osmpbf/pbistream.h>
 #include <osmpbf/inode.h>
 #include <osmpbf/iway.h>
 #include <osmpbf/irelation.h>
 #include <osmpbf/filter.h>
+#include <osmpbf/compiledfilter.h>
 
 /**
   * This is a small example to demonstrate the use of filters together with threads.
   * Filters are NOT! thread-safe. We circumvent this by using only thread-local filters.
+  * Every thread counts into its own MyCounter (see parseFileReduce), the counters are summed up at the end.
+  * The filter dag is compiled into a flat, immutable program once. Every thread gets its own
+  * CompiledFilter which shares that program and only holds the binding to its current block.
+  * With -p every thread evaluates its own copy of the filter dag instead. If the library is built with
+  * OSMPBF_FILTER_PROFILING the copies count into the nodes of the original dag, which is printed at the end.
   */
 
-struct SharedState {
-	std::mutex lock;
-	uint64_t nodeCount;
-	uint64_t wayCount;
-	uint64_t relationCount;
-	SharedState() : nodeCount(0), wayCount(0), relationCount(0) {}
+///gives a CompiledFilter the pointer-like interface of CopyFilterPtr
+struct CompiledFilterRef {
+	osmpbf::CompiledFilter filter;
+	explicit CompiledFilterRef(const osmpbf::RCFilterPtr & filter) : filter(filter) {}
+	osmpbf::CompiledFilter * operator->() { return &filter; }
 };
 
+template<typename T_FILTER>
 struct MyCounter {
-	SharedState * state;
-	osmpbf::CopyFilterPtr filter; //automatically create a deep copy of filter dag
+	T_FILTER filter; //copies of a CompiledFilter share the program, not the binding
 	uint64_t nodeCount;
 	uint64_t wayCount;
 	uint64_t relationCount;
-	MyCounter(SharedState * state, const osmpbf::RCFilterPtr & filter) : state(state), filter(filter), nodeCount(0), wayCount(0), relationCount(0) {}
-	MyCounter(const MyCounter & other) : state(other.state), filter(other.filter), nodeCount(0), wayCount(0), relationCount(0) {}
+	explicit MyCounter(const osmpbf::RCFilterPtr & filter) : filter(filter), nodeCount(0), wayCount(0), relationCount(0) {}
 	void operator()(osmpbf::PrimitiveBlockInputAdaptor & pbi) {
 		filter->assignInputAdaptor(&pbi);
 		//we can rebuild the cache ourselfs for early termination
-// 		if (!filter->rebuildCache()) {
-// 			return;
-// 		}
-		nodeCount = wayCount = relationCount = 0;
-		for(osmpbf::INodeStream node(pbi.getNodeStream()); !node.isNull(); node.next()) {
-			if (filter->matches(node)) {
-				++nodeCount;
-			}
+		if (!filter->rebuildCache()) {
+			return;
 		}
-		for(osmpbf::IWayStream way(pbi.getWayStream()); !way.isNull(); way.next()) {
-			if (filter->matches(way)) {
-				++wayCount;
-			}
-		}
-		for(osmpbf::IRelationStream rel(pbi.getRelationStream()); !rel.isNull(); rel.next()) {
-			if (filter->matches(rel)) {
-				++relationCount;
-			}
-		}
-		//now flush everything to shared state
-		std::lock_guard<std::mutex> lck(state->lock);
-		state->nodeCount += nodeCount;
-		state->wayCount += wayCount;
-		state->relationCount += relationCount;
+		//evaluate whole blocks at once, we only need the number of selected primitives
+		osmpbf::BlockSelection nodes(filter->evaluateBlock(pbi, osmpbf::NodePrimitive));
+		osmpbf::BlockSelection ways(filter->evaluateBlock(pbi, osmpbf::WayPrimitive));
+		osmpbf::BlockSelection relations(filter->evaluateBlock(pbi, osmpbf::RelationPrimitive));
+		nodeCount += std::count(nodes.begin(), nodes.end(), true);
+		wayCount += std::count(ways.begin(), ways.end(), true);
+		relationCount += std::count(relations.begin(), relations.end(), true);
+	}
+	void operator+=(const MyCounter & other) {
+		nodeCount += other.nodeCount;
+		wayCount += other.wayCount;
+		relationCount += other.relationCount;
 	}
 };
 
+///prints the progress of the scan to std::cerr
+struct ProgressPrinter : public osmpbf::ParseObserver {
+	void progress(const osmpbf::ParseProgress & p) override {
+		std::cerr << std::fixed << std::setprecision(1)
+			<< (p.totalBytes ? 100.0 * p.bytesRead / p.totalBytes : 100.0) << "% "
+			<< p.blobsParsed << " blobs, " << p.primitivesPerSecond / 1000.0 << "k primitives/s";
+		if (p.etaSeconds >= 0.0)
+			std::cerr << ", " << p.etaSeconds << "s left";
+		std::cerr << std::endl;
+	}
+	void finished(const osmpbf::ParseProgress & p) override {
+		std::cerr << std::fixed << std::setprecision(3) << "scanned " << p.blobsParsed << " blobs in " << p.elapsedSeconds << "s" << std::endl;
+	}
+};
+
+template<typename T_FILTER>
+MyCounter<T_FILTER> count(osmpbf::PbiStream & inFile, const osmpbf::RCFilterPtr & filter, uint32_t threadCount, uint32_t readBlobCount, osmpbf::ParseObserver * observer) {
+	typedef MyCounter<T_FILTER> Counter;
+	Counter prototype(filter); //compile once, copies share the program
+	return osmpbf::parseFileReduce(inFile,
+		[&prototype]() { return Counter(prototype); },
+		[](Counter & counter, osmpbf::PrimitiveBlockInputAdaptor & pbi) { counter(pbi); },
+		[](Counter & target, Counter & source) { target += source; },
+		threadCount, readBlobCount, false, NULL, observer);
+}
+
 void help() {
 	std::cout << "Count the number of primitives in a osm.pbf file matching specified tags\n";
-	std::cout << "prg [-k <key> [-k]] [-kv <key> <value> [-kv]] [-t number_of_threads] [-b number_of_blocks_per_fetch] filename\n";
+	std::cout << "prg [-k <key> [-k]] [-kv <key> <value> [-kv]] [-bbox <minLat> <minLon> <maxLat> <maxLon>] [-t number_of_threads] [-b number_of_blocks_per_fetch] [-s shard shard_count] [-p] [-v] filename\n";
+	std::cout << "filename - reads the file from stdin\n";
+	std::cout << "-bbox restricts the result to nodes inside the bounding box (degrees), without tag filters all of them are counted\n";
+	std::cout << "-p evaluates the filter dag without compiling it and prints its profile (needs OSMPBF_FILTER_PROFILING)\n";
+	std::cout << "-s counts only the blobs of the given shard (0 based), the counts of all shards add up to the count of the file\n";
+	std::cout << "-v prints the progress of the scan to stderr\n";
 	std::cout << std::flush;
 }
 
@@ -85,11 +114,15 @@ void help() {
 int main(int argc, char ** argv) {
 	std::vector<std::string> keys;
 	std::vector< std::pair<std::string, std::string> > kvs;
+	std::vector<double> bbox;
 	osmpbf::RCFilterPtr filter;
 	std::string fileName;
-	SharedState state;
 	uint32_t threadCount = 2; //use 2 threads, usually 4 are more than enough
 	uint32_t readBlobCount = 2; //parse 2 blocks at once
+	bool profile = false;
+	bool verbose = false;
+	uint32_t shard = 0;
+	uint32_t shardCount = 1;
 
 	
 	for(int i(0); i < argc; ++i) {
@@ -102,6 +135,12 @@ int main(int argc, char ** argv) {
 			kvs.emplace_back(std::string(argv[i+1]), std::string(argv[i+2]));
 			i+=2;
 		}
+		else if (token == "-bbox" && i+4 < argc) {
+			for(int j(1); j <= 4; ++j) {
+				bbox.push_back(::atof(argv[i+j]));
+			}
+			i+=4;
+		}
 		else if (token == "-t" && i+1 < argc) {
 			threadCount = ::atoi(argv[i+1]);
 			++i;
@@ -110,6 +149,17 @@ int main(int argc, char ** argv) {
 			readBlobCount = ::atoi(argv[i+1]);
 			++i;
 		}
+		else if (token == "-s" && i+2 < argc) {
+			shard = ::atoi(argv[i+1]);
+			shardCount = ::atoi(argv[i+2]);
+			i+=2;
+		}
+		else if (token == "-p") {
+			profile = true;
+		}
+		else if (token == "-v") {
+			verbose = true;
+		}
 		else if(token == "--help" || token == "-h") {
 			help();
 			return 0;
@@ -120,28 +170,69 @@ int main(int argc, char ** argv) {
 	}
 	
 	
-	osmpbf::OSMFileIn inFile(fileName);
-	if (!inFile.open()) {
-		std::cerr << "Could not open file " << fileName << std::endl;
+	std::unique_ptr<osmpbf::PbiStream> inFilePtr;
+	try {
+		if (fileName == "-") {
+			inFilePtr.reset(new osmpbf::PbiStream(new osmpbf::BlobStreamIn(0)));
+		}
+		else if (shardCount > 1) {
+			osmpbf::OSMFileIn shardFile(fileName);
+			if (!shardFile.openShard(shard, shardCount)) {
+				throw std::runtime_error("could not open shard");
+			}
+			inFilePtr.reset(new osmpbf::PbiStream(std::move(shardFile)));
+		}
+		else {
+			inFilePtr.reset(new osmpbf::PbiStream(std::vector<std::string>(1, fileName)));
+		}
+	}
+	catch (const std::exception & e) {
+		std::cerr << "Could not open file " << fileName << ": " << e.what() << std::endl;
 		return -1;
 	}
+	osmpbf::PbiStream & inFile = *inFilePtr;
 	
 	{//setup filters
 		auto orFilter = new osmpbf::OrTagFilter({new osmpbf::MultiKeyTagFilter(keys.begin(), keys.end())});
 		for(auto x : kvs) {
 			orFilter->addChild(new osmpbf::KeyValueTagFilter(x.first, x.second));
 		}
-		filter.reset(orFilter); //takes ownership of orFilter
+		if (bbox.size() != 4) {
+			filter.reset(orFilter); //takes ownership of orFilter
+		}
+		else if (keys.empty() && kvs.empty()) {
+			delete orFilter;
+			filter.reset(new osmpbf::BBoxNodeFilter(bbox[0], bbox[1], bbox[2], bbox[3]));
+		}
+		else {
+			filter.reset(new osmpbf::AndTagFilter({new osmpbf::BBoxNodeFilter(bbox[0], bbox[1], bbox[2], bbox[3]), orFilter}));
+		}
 	}
 	
-	bool threadPrivateProcessor = true; //set to true so that MyCounter is copied
-	
-	osmpbf::parseFileCPPThreads(inFile, MyCounter(&state, filter), threadCount, readBlobCount, threadPrivateProcessor);
+	ProgressPrinter progressPrinter;
+	osmpbf::ParseObserver * observer = verbose ? &progressPrinter : NULL;
+
+	uint64_t nodeCount, wayCount, relationCount;
+	if (profile) {
+		MyCounter<osmpbf::CopyFilterPtr> result(count<osmpbf::CopyFilterPtr>(inFile, filter, threadCount, readBlobCount, observer));
+		nodeCount = result.nodeCount;
+		wayCount = result.wayCount;
+		relationCount = result.relationCount;
+	}
+	else {
+		MyCounter<CompiledFilterRef> result(count<CompiledFilterRef>(inFile, filter, threadCount, readBlobCount, observer));
+		nodeCount = result.nodeCount;
+		wayCount = result.wayCount;
+		relationCount = result.relationCount;
+	}
 	
 	std::cout << "File " << fileName << " has the following amounts of matching primitives:\n";
-	std::cout << "Nodes: " << state.nodeCount << "\n";
-	std::cout << "Ways: " << state.wayCount << "\n";
-	std::cout << "Relations: " << state.relationCount<< "\n";
+	std::cout << "Nodes: " << nodeCount << "\n";
+	std::cout << "Ways: " << wayCount << "\n";
+	std::cout << "Relations: " << relationCount<< "\n";
+	if (profile) {
+		filter->dumpProfile(std::cout);
+	}
 	std::cout << std::flush;
 	return 0;
 }
\ No newline at end of file
@@ -21,7 +21,6 @@
 #include <cstdint>
 
 #include <iostream>
-#include <set>
 
 #include <osmpbf/blobfile.h>
 #include <osmpbf/osmfile.h>
@@ -32,6 +31,7 @@
 #include <osmpbf/irelation.h>
 
 #include <osmpbf/filter.h>
+#include <osmpbf/extractor.h>
 
 #include <osmpbf/primitiveblockoutputadaptor.h>
 #include <osmpbf/onode.h>
@@ -98,7 +98,7 @@ int compare(char * inFileName, char * matchFileName, bool verbose) {
 	return match ? 0 : -1;
 }
 
-int copyBlobs(char * inFileName, char * outFileName, bool verbose) {
+int copyBlobs(char * inFileName, char * outFileName, char * compressionName, bool verbose) {
 	if (!outFileName) {
 		std::cerr << "output file parameter is missing" << std::endl;
 		return -1;
@@ -110,23 +110,55 @@ int copyBlobs(char * inFileName, char * outFileName, bool verbose) {
 	inFile.setVerboseOutput(verbose);
 	outFile.setVerboseOutput(verbose);
 
-	osmpbf::BlobDataBuffer buffer;
+	if (compressionName) {
+		std::string name = compressionName;
+		osmpbf::BlobCompression compression;
+
+		if (name == "none")
+			compression = osmpbf::COMPRESSION_None;
+		else if (name == "zlib")
+			compression = osmpbf::COMPRESSION_Zlib;
+		else if (name == "lz4")
+			compression = osmpbf::COMPRESSION_Lz4;
+		else if (name == "zstd")
+			compression = osmpbf::COMPRESSION_Zstd;
+		else {
+			std::cerr << "ERROR: unknown compression \"" << name << '\"' << std::endl;
+			return -1;
+		}
 
-	inFile.open();
-	outFile.open();
+		if (!outFile.setCompression(compression))
+			return -1;
+	}
+
+	if (!inFile.open() || !outFile.open())
+		return -1;
 
-	bool writeOk = false;
+	// a blob failing to decode is consumed all the same, so the loops run until the end of the input
+	bool ok = true;
+	if (compressionName) {
+		// recompress every blob
+		osmpbf::BlobDataBuffer buffer;
 
-	do {
-		inFile.readBlob(buffer);
-		writeOk = outFile.writeBlob(buffer);
+		while (ok && inFile.position() < inFile.size()) {
+			inFile.readBlob(buffer);
+			ok = buffer.type && outFile.writeBlob(buffer);
+		}
+	}
+	else {
+		// blobs are copied verbatim, no need to inflate and recompress them
+		osmpbf::RawBlobRef rawBlob;
+		while (ok && inFile.position() < inFile.size())
+			ok = inFile.readRawBlob(rawBlob) && outFile.writeRawBlob(rawBlob);
+	}
 
-	} while (buffer.type && writeOk);
+	if (!ok)
+		std::cerr << "ERROR: copy stopped at offset " << inFile.position() << " of " << inFile.size() << std::endl;
 
 	inFile.close();
 	outFile.close();
 
-	return 0;
+	return ok ? 0 : -1;
 }
 
 int printStats(char * inputFileName, bool verbose) {
@@ -424,6 +456,7 @@ int extract(const char * inputFileName, const char * outputFileName, const char
 	osmpbf::BlobFileOut outFile(outputFileName);
 
 	osmpbf::BlobDataBuffer buffer;
+	osmpbf::RawBlobRef rawBlob;
 
 	inFile.setVerboseOutput(verbose);
 	outFile.setVerboseOutput(verbose);
@@ -431,11 +464,16 @@ int extract(const char * inputFileName, const char * outputFileName, const char
 	inFile.open();
 	outFile.open();
 
+	uint32_t copiedBlocks = 0, encodedBlocks = 0, droppedBlocks = 0;
+
 	osmpbf::PrimitiveBlockOutputAdaptor pbo;
 	do {
-		inFile.readBlob(buffer);
+		inFile.readBlob(buffer, rawBlob);
 
-		if (buffer.type == osmpbf::BLOB_OSMData) {
+		if (buffer.type == osmpbf::BLOB_OSMHeader) {
+			outFile.writeRawBlob(rawBlob);
+		}
+		else if (buffer.type == osmpbf::BLOB_OSMData) {
 			osmpbf::PrimitiveBlockInputAdaptor pbi(buffer.data, buffer.availableBytes);
 
 			int keyStringIndex;
@@ -444,8 +482,32 @@ int extract(const char * inputFileName, const char * outputFileName, const char
 				if (pbi.queryStringTable(keyStringIndex) == matchString) break;
 			}
 
-			if (keyStringIndex == pbi.stringTableSize())
+			if (keyStringIndex == pbi.stringTableSize()) {
+				++droppedBlocks;
+				continue;
+			}
+
+			int matchingWays = 0, matchingNodes = 0;
+
+			for (osmpbf::IWayStream wayStream = pbi.getWayStream(); !wayStream.isNull(); wayStream.next())
+				if (hasKeyId<osmpbf::IWayStream>(wayStream, keyStringIndex))
+					++matchingWays;
+
+			for (osmpbf::INodeStream nodeStream = pbi.getNodeStream(); !nodeStream.isNull(); nodeStream.next())
+				if (hasKeyId<osmpbf::INodeStream>(nodeStream, keyStringIndex))
+					++matchingNodes;
+
+			if (!matchingWays && !matchingNodes) {
+				++droppedBlocks;
+				continue;
+			}
+
+			// the whole block is kept, copy the original blob instead of re-encoding it
+			if (matchingWays == pbi.waysSize() && matchingNodes == pbi.nodesSize() && !pbi.relationsSize()) {
+				outFile.writeRawBlob(rawBlob);
+				++copiedBlocks;
 				continue;
+			}
 
 			for (osmpbf::IWayStream wayStream = pbi.getWayStream(); !wayStream.isNull(); wayStream.next())
 				if (hasKeyId<osmpbf::IWayStream>(wayStream, keyStringIndex))
@@ -464,112 +526,66 @@ int extract(const char * inputFileName, const char * outputFileName, const char
 
 				pbo.flush(outputBuffer);
 				outFile.writeBlob(osmpbf::BLOB_OSMData, outputBuffer.data(), outputBuffer.size(), true);
+				++encodedBlocks;
 			}
 		}
 	} while(buffer.type);
 
+	if (verbose)
+		std::cout << "blocks copied: " << copiedBlocks << ", re-encoded: " << encodedBlocks << ", dropped: " << droppedBlocks << std::endl;
+
 	inFile.close();
 	outFile.close();
 
 	return 0;
 }
 
-int extractWays(const char * inputFileName, const char * outputFileName, bool verbose) {
+int extractComplete(const char * inputFileName, const char * outputFileName, osmpbf::RCFilterPtr filter, bool verbose) {
 	if (!outputFileName) {
 		std::cerr << "ERROR: output file parameter is missing" << std::endl;
 		return -1;
 	}
 
-	osmpbf::BlobFileIn inFile(inputFileName);
-	osmpbf::BlobFileOut outFile(outputFileName);
-
-	osmpbf::BlobDataBuffer buffer;
-
-	inFile.setVerboseOutput(verbose);
-	outFile.setVerboseOutput(verbose);
-
-	osmpbf::PrimitiveBlockOutputAdaptor pbo;
-
-	std::set< int64_t > nodes;
-
-	inFile.open();
-	outFile.open();
-
-	uint32_t pbiCount = 0;
+	osmpbf::Extractor extractor(inputFileName);
+	extractor.setFilter(filter);
+	extractor.setVerboseOutput(verbose);
 
-	// collect ways and node ids
-	std::cout << "collecting ways and node refs ..."; std::cout.flush();
-	do {
-		inFile.readBlob(buffer);
-
-		if (buffer.type == osmpbf::BLOB_OSMData) {
-			osmpbf::PrimitiveBlockInputAdaptor pbi(buffer.data, buffer.availableBytes);
-
-			// extract node ids and
-			for (osmpbf::IWayStream way = pbi.getWayStream(); !way.isNull(); way.next()) {
-				pbo << way;
-
-				generics::DeltaFieldConstForwardIterator<int64_t> it;
-
-				for(it = way.refBegin(); it != way.refEnd(); ++it)
-					nodes.insert(*it);
-
-				// flush ways
-				if (pbo.waysSize() == 8000) {
-					std::string outputBuffer;
-					pbo.flush(outputBuffer);
-					outFile.writeBlob(osmpbf::BLOB_OSMData, outputBuffer.data(), outputBuffer.size(), true);
-				}
-			}
-
-			std::cout << '\r';
-			std::cout << "collecting ways and node refs ... " << ++pbiCount;
-			std::cout.flush();
-		}
-	} while(buffer.type);
-	std::cout << std::endl;
+	if (!extractor.run(outputFileName))
+		return -1;
 
-	pbiCount = 0;
-	inFile.seek(0);
+	std::cout << "extracted " << extractor.nodes().size() << " nodes, " << extractor.ways().size() << " ways, " <<
+		extractor.relations().size() << " relations" << std::endl;
 
-	// collect node data
-	std::cout << "collecting node data ..."; std::cout.flush();
-	do {
-		inFile.readBlob(buffer);
-
-		if (buffer.type == osmpbf::BLOB_OSMData) {
-			osmpbf::PrimitiveBlockInputAdaptor pbi(buffer.data, buffer.availableBytes);
+	return 0;
+}
 
-			// extract node ids and
-			for (osmpbf::INodeStream node = pbi.getNodeStream(); !node.isNull(); node.next()) {
-				if (nodes.count(node.id()))
-					pbo << node;
+int extractMatchComplete(const char * inputFileName, const char * outputFileName, const char * matchString, bool verbose) {
+	if (!matchString) {
+		std::cerr << "ERROR: no match string supplied" << std::endl;
+		return -1;
+	}
 
-				// flush nodes
-				if (pbo.nodesSize(osmpbf::PlainNode) + pbo.nodesSize(osmpbf::DenseNode) == 8000) {
-					std::string outputBuffer;
-					pbo.flush(outputBuffer);
-					outFile.writeBlob(osmpbf::BLOB_OSMData, outputBuffer.data(), outputBuffer.size(), true);
-				}
-			}
+	std::string keyString = matchString;
+	std::size_t delimiter = keyString.find('=');
 
-			std::cout << '\r';
-			std::cout << "collecting node data ... " << ++pbiCount;
-			std::cout.flush();
-		}
-	} while(buffer.type);
-	std::cout << std::endl;
+	osmpbf::RCFilterPtr filter;
+	if (delimiter != std::string::npos)
+		filter.reset(new osmpbf::KeyValueTagFilter(keyString.substr(0, delimiter), keyString.substr(delimiter + 1)));
+	else
+		filter.reset(new osmpbf::KeyOnlyTagFilter(keyString));
 
-	inFile.close();
-	outFile.close();
+	return extractComplete(inputFileName, outputFileName, filter, verbose);
+}
 
-	return 0;
+int extractWays(const char * inputFileName, const char * outputFileName, bool verbose) {
+	return extractComplete(inputFileName, outputFileName, osmpbf::RCFilterPtr(new osmpbf::PrimitiveTypeFilter(osmpbf::WayPrimitive)), verbose);
 }
 
 /* parameters:
  * -o file_name ... out file
  * -c file_name ... file to compare with
  * -m match_string ... work only on primitives matching
+ * -z compression ... recompress blobs using none, zlib, lz4 or zstd
  * -v ... verbose output
  */
 struct MyParameters {
@@ -577,6 +593,7 @@ struct MyParameters {
 	char * outputFileName;
 	char * compareFileName;
 	char * matchString;
+	char * compression;
 	bool verbose;
 
 	MyParameters(int argc, char * argv[]) :
@@ -584,6 +601,7 @@ struct MyParameters {
 		outputFileName(NULL),
 		compareFileName(NULL),
 		matchString(NULL),
+		compression(NULL),
 		verbose(false)
 	{
 		int p = 2;
@@ -617,6 +635,15 @@ struct MyParameters {
 
 					matchString = argv[p];
 					break;
+				case 'z':
+					p++;
+					if ((p >= argc - 1) || (argv[p][0] == '-')) {
+						std::cerr << "ERROR: invalid compression parameter" << std::endl;
+						return;
+					}
+
+					compression = argv[p];
+					break;
 				case 'v':
 					verbose = true;
 					break;
@@ -641,6 +668,7 @@ struct MyParameters {
 #define MODE_BLOB_STATS 's'
 #define MODE_BLOB_DATA_STATS 'S'
 #define MODE_EXTRACT_WAYS 'w'
+#define MODE_EXTRACT_COMPLETE 'x'
 
 int main(int argc, char * argv[]) {
 	if (argc < 3) {
@@ -657,7 +685,7 @@ int main(int argc, char * argv[]) {
 
 	switch (argv[1][0]) {
 	case MODE_COPY_BLOBS:
-		return copyBlobs(params.inputFileName, params.outputFileName, params.verbose);
+		return copyBlobs(params.inputFileName, params.outputFileName, params.compression, params.verbose);
 	case MODE_COMPARE:
 		return compare(params.inputFileName, params.compareFileName, params.verbose);
 	case MODE_BLOB_STATS:
@@ -670,6 +698,8 @@ int main(int argc, char * argv[]) {
 		return extract(params.inputFileName, params.outputFileName, params.matchString, params.verbose);
 	case MODE_EXTRACT_WAYS:
 		return extractWays(params.inputFileName, params.outputFileName, params.verbose);
+	case MODE_EXTRACT_COMPLETE:
+		return extractMatchComplete(params.inputFileName, params.outputFileName, params.matchString, params.verbose);
 	default:
 		std::cerr << "ERROR: unknown mode \"" << argv[1][0] << '\"' << std::endl;
 		return -1;
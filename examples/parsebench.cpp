@@ -0,0 +1,162 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2015 Daniel Bahrdt.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <osmpbf/parsehelpers.h>
+#include <osmpbf/blobfile.h>
+#include <osmpbf/inode.h>
+#include <osmpbf/iway.h>
+#include <osmpbf/irelation.h>
+
+/**
+  * Compares the scan throughput of floating threads with pinned executor workers.
+  * Every block is parsed and all node coordinates, way refs and relation members are touched.
+  * On multi-socket machines pinned workers keep their blob buffers and parse state on their own
+  * memory node, floating threads may access them across the interconnect.
+  */
+
+struct Checksum {
+	uint64_t value;
+	Checksum() : value(0) {}
+	void operator()(osmpbf::PrimitiveBlockInputAdaptor & pbi) {
+		uint64_t sum = 0;
+		for (osmpbf::INodeStream node = pbi.getNodeStream(); !node.isNull(); node.next()) {
+			sum += node.id() + node.lati() + node.loni();
+		}
+		for (osmpbf::IWayStream way = pbi.getWayStream(); !way.isNull(); way.next()) {
+			for(osmpbf::IWay::RefIterator refIt(way.refBegin()), refEnd(way.refEnd()); refIt != refEnd; ++refIt) {
+				sum += *refIt;
+			}
+		}
+		for (osmpbf::IRelationStream relation = pbi.getRelationStream(); !relation.isNull(); relation.next()) {
+			for(osmpbf::IMemberStream mem(relation.getMemberStream()); !mem.isNull(); mem.next()) {
+				sum += mem.id();
+			}
+		}
+		value += sum;
+	}
+};
+
+///file to scan, read from memory if data is set
+struct Input {
+	std::string fileName;
+	std::vector<char> data;
+	osmpbf::BlobFileIn * blobFile() const {
+		return data.empty() ? new osmpbf::BlobFileIn(fileName) : new osmpbf::BlobFileIn(data.data(), data.size());
+	}
+};
+
+template<typename T_SCAN>
+void benchmark(const std::string & name, const Input & input, uint32_t repeats, T_SCAN scan) {
+	double best = 0.0;
+	uint64_t checksum = 0;
+	osmpbf::SizeType bytes = 0;
+	for(uint32_t i(0); i < repeats; ++i) {
+		osmpbf::OSMFileIn inFile(input.blobFile());
+		if (!inFile.open()) {
+			std::cerr << "Could not open file " << input.fileName << std::endl;
+			return;
+		}
+		bytes = inFile.dataSize();
+
+		auto start = std::chrono::steady_clock::now();
+		checksum = scan(inFile);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (!i || seconds < best) {
+			best = seconds;
+		}
+	}
+	std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(3)
+		<< std::setw(10) << best << " s " << std::setw(10) << std::setprecision(1) << bytes / best / (1 << 20) << " MiB/s"
+		<< "  checksum " << checksum << std::endl;
+}
+
+void help() {
+	std::cout << "Benchmark the parse helpers with floating and pinned threads\n";
+	std::cout << "prg [-t number_of_threads] [-r repeats] [-m] filename\n";
+	std::cout << "-m reads the file into memory first and scans it from there, excluding I/O\n";
+	std::cout << "The best of all repeats is printed" << std::endl;
+}
+
+int main(int argc, char ** argv) {
+	Input input;
+	bool inMemory = false;
+	uint32_t threadCount = std::max<uint32_t>(std::thread::hardware_concurrency(), 1);
+	uint32_t repeats = 3;
+
+	for(int i(1); i < argc; ++i) {
+		std::string token(argv[i]);
+		if (token == "-t" && i+1 < argc) {
+			threadCount = ::atoi(argv[i+1]);
+			++i;
+		}
+		else if (token == "-r" && i+1 < argc) {
+			repeats = std::max(::atoi(argv[i+1]), 1);
+			++i;
+		}
+		else if (token == "-m") {
+			inMemory = true;
+		}
+		else if(token == "--help" || token == "-h") {
+			help();
+			return 0;
+		}
+		else {
+			input.fileName = token;
+		}
+	}
+
+	if (inMemory) {
+		std::ifstream file(input.fileName, std::ios::binary);
+		input.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		if (input.data.empty()) {
+			std::cerr << "Could not read file " << input.fileName << std::endl;
+			return -1;
+		}
+	}
+
+	auto merge = [](Checksum & target, Checksum & source) { target.value += source.value; };
+	auto process = [](Checksum & checksum, osmpbf::PrimitiveBlockInputAdaptor & pbi) { checksum(pbi); };
+	auto makeLocal = []() { return Checksum(); };
+
+	benchmark("floating threads", input, repeats, [&](osmpbf::OSMFileIn & inFile) {
+		return osmpbf::parseFileReduce(inFile, makeLocal, process, merge, threadCount).value;
+	});
+
+	{
+		osmpbf::Executor executor(threadCount);
+		benchmark("executor", input, repeats, [&](osmpbf::OSMFileIn & inFile) {
+			return osmpbf::parseFileReduce(executor, inFile, makeLocal, process, merge).value;
+		});
+	}
+
+	{
+		osmpbf::Executor executor(threadCount, true);
+		benchmark("pinned executor", input, repeats, [&](osmpbf::OSMFileIn & inFile) {
+			return osmpbf::parseFileReduce(executor, inFile, makeLocal, process, merge).value;
+		});
+	}
+
+	return 0;
+}
@@ -0,0 +1,168 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#include <osmpbf/blobbufferpool.h>
+
+#include <cassert>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace osmpbf
+{
+
+constexpr uint32_t BlobBufferPool::MIN_BUFFER_SIZE;
+constexpr uint32_t BlobBufferPool::MAX_BUFFER_SIZE;
+constexpr uint32_t BlobBufferPool::HUGE_PAGE_SIZE;
+constexpr int BlobBufferPool::CLASS_COUNT;
+
+static_assert((BlobBufferPool::MIN_BUFFER_SIZE << (BlobBufferPool::CLASS_COUNT - 1)) == BlobBufferPool::MAX_BUFFER_SIZE, "size classes have to end at MAX_BUFFER_SIZE");
+
+BlobBufferPool::BlobBufferPool(SizeType maxCachedBytes, bool hugePages) :
+m_MaxCachedBytes(maxCachedBytes),
+m_HugePages(hugePages),
+m_CachedBytes(0),
+m_Hits(0),
+m_Misses(0)
+{}
+
+BlobBufferPool::~BlobBufferPool()
+{
+	trim();
+}
+
+char * BlobBufferPool::allocate(uint32_t size, uint32_t & capacity)
+{
+	int index = sizeClass(size);
+	if (index < 0)
+	{
+		++m_Misses;
+		capacity = size;
+		return new char[size];
+	}
+
+	capacity = classSize(index);
+
+	SizeClass & sc = m_Classes[index];
+	{
+		std::lock_guard<std::mutex> lck(sc.lock);
+		if (!sc.buffers.empty())
+		{
+			char * result = sc.buffers.back();
+			sc.buffers.pop_back();
+			m_CachedBytes -= capacity;
+			++m_Hits;
+			return result;
+		}
+	}
+
+	++m_Misses;
+	return allocateChunk(capacity);
+}
+
+void BlobBufferPool::release(char * data, uint32_t capacity)
+{
+	if (!data)
+		return;
+
+	if (capacity > MAX_BUFFER_SIZE)
+	{
+		delete[] data;
+		return;
+	}
+
+	int index = sizeClass(capacity);
+	assert(index >= 0 && classSize(index) == capacity);
+
+	if (m_CachedBytes + capacity <= m_MaxCachedBytes)
+	{
+		SizeClass & sc = m_Classes[index];
+		std::lock_guard<std::mutex> lck(sc.lock);
+		sc.buffers.push_back(data);
+		m_CachedBytes += capacity;
+		return;
+	}
+
+	freeChunk(data, capacity);
+}
+
+void BlobBufferPool::trim()
+{
+	for (int index = 0; index < CLASS_COUNT; ++index)
+	{
+		SizeClass & sc = m_Classes[index];
+		std::lock_guard<std::mutex> lck(sc.lock);
+		for (char * data : sc.buffers)
+		{
+			freeChunk(data, classSize(index));
+			m_CachedBytes -= classSize(index);
+		}
+		sc.buffers.clear();
+	}
+}
+
+BlobBufferPool & BlobBufferPool::defaultPool()
+{
+	//leaked on purpose, buffers in static objects may be released after any destructor ran
+	static BlobBufferPool * pool = new BlobBufferPool();
+	return *pool;
+}
+
+int BlobBufferPool::sizeClass(uint32_t size)
+{
+	for (int index = 0; index < CLASS_COUNT; ++index)
+	{
+		if (size <= classSize(index))
+			return index;
+	}
+	return -1;
+}
+
+char * BlobBufferPool::allocateChunk(uint32_t size)
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (m_HugePages && size >= HUGE_PAGE_SIZE)
+	{
+		void * data = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (data == MAP_FAILED)
+			throw std::bad_alloc();
+
+		::madvise(data, size, MADV_HUGEPAGE);
+		return static_cast<char *>(data);
+	}
+#endif
+	return new char[size];
+}
+
+void BlobBufferPool::freeChunk(char * data, uint32_t size)
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (m_HugePages && size >= HUGE_PAGE_SIZE)
+	{
+		::munmap(data, size);
+		return;
+	}
+#endif
+	delete[] data;
+}
+
+} // namespace osmpbf
@@ -24,33 +24,77 @@
 
 #include "osmblob.pb.h"
 
+#include <google/protobuf/io/coded_stream.h>
+
 #include <iostream>
 #include <limits>
 #include <zlib.h>
 #include <assert.h>
 #include <memory>
+#include <algorithm>
+
+#ifdef OSMPBF_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef OSMPBF_WITH_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
 
 namespace osmpbf
 {
 
-bool inflateData(const char * source, uint32_t sourceSize, char * dest, uint32_t destSize)
+namespace
 {
-	int ret;
-	z_stream stream;
+	///zlib inflate state of a thread, reset for every blob instead of being allocated again
+	struct Inflater
+	{
+		z_stream stream;
+		bool initialized;
 
-	stream.zalloc = Z_NULL;
-	stream.zfree = Z_NULL;
-	stream.opaque = Z_NULL;
-	stream.avail_in = sourceSize;
-	stream.next_in = (Bytef *)source;
-	stream.avail_out = destSize;
-	stream.next_out = (Bytef *)dest;
+		Inflater() : initialized(false)
+		{
+			stream.zalloc = Z_NULL;
+			stream.zfree = Z_NULL;
+			stream.opaque = Z_NULL;
+			stream.avail_in = 0;
+			stream.next_in = Z_NULL;
+		}
+
+		~Inflater()
+		{
+			if (initialized)
+				inflateEnd(&stream);
+		}
+
+		///stream ready for a new blob, NULL on errors
+		z_stream * begin()
+		{
+			if (!initialized)
+				initialized = (inflateInit(&stream) == Z_OK);
+			else if (inflateReset(&stream) != Z_OK)
+				return NULL;
 
-	ret = inflateInit(&stream);
-	if (ret != Z_OK)
+			return initialized ? &stream : NULL;
+		}
+	};
+}
+
+bool inflateData(const char * source, uint32_t sourceSize, char * dest, uint32_t destSize)
+{
+	thread_local Inflater inflater;
+
+	z_stream * stream = inflater.begin();
+	if (!stream)
 		return false;
 
-	ret = inflate(&stream, Z_FINISH);
+	stream->avail_in = sourceSize;
+	stream->next_in = (Bytef *)source;
+	stream->avail_out = destSize;
+	stream->next_out = (Bytef *)dest;
+
+	int ret = inflate(stream, Z_FINISH);
 
 	assert(ret != Z_STREAM_ERROR);
 
@@ -58,25 +102,21 @@ bool inflateData(const char * source, uint32_t sourceSize, char * dest, uint32_t
 	{
 	case Z_NEED_DICT:
 		std::cerr << "ERROR: zlib - Z_NEED_DICT" << std::endl;
-		inflateEnd(&stream);
 		return false;
 	case Z_DATA_ERROR:
 		std::cerr << "ERROR: zlib - Z_DATA_ERROR" << std::endl;
-		inflateEnd(&stream);
 		return false;
 	case Z_MEM_ERROR:
 		std::cerr << "ERROR: zlib - Z_MEM_ERROR" << std::endl;
-		inflateEnd(&stream);
 		return false;
 	default:
 		break;
 	}
 
-	inflateEnd(&stream);
 	return true;
 }
 
-uint32_t deflateData(const char * source, uint32_t sourceSize, char *& dest, uint32_t & destSize)
+uint32_t deflateData(const char * source, uint32_t sourceSize, char *& dest, uint32_t & destSize, int level)
 {
 	int ret;
 	z_stream stream;
@@ -85,7 +125,7 @@ uint32_t deflateData(const char * source, uint32_t sourceSize, char *& dest, uin
 	stream.zfree = Z_NULL;
 	stream.opaque = Z_NULL;
 
-	ret = deflateInit(&stream, Z_BEST_COMPRESSION);
+	ret = deflateInit(&stream, level < 0 ? Z_BEST_COMPRESSION : level);
 	assert(ret != Z_STREAM_ERROR);
 
 	//overvlow will result in error during stream decoding
@@ -122,6 +162,75 @@ uint32_t deflateData(const char * source, uint32_t sourceSize, char *& dest, uin
 	}
 }
 
+#ifdef OSMPBF_WITH_LZ4
+bool lz4DecompressData(const char * source, uint32_t sourceSize, char * dest, uint32_t destSize)
+{
+	int ret = LZ4_decompress_safe(source, dest, (int) sourceSize, (int) destSize);
+	if (ret < 0 || (uint32_t) ret != destSize)
+	{
+		std::cerr << "ERROR: lz4 - invalid compressed data" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+uint32_t lz4CompressData(const char * source, uint32_t sourceSize, char *& dest, uint32_t & destSize, int level)
+{
+	destSize = (uint32_t) LZ4_compressBound((int) sourceSize);
+	dest = new char[destSize];
+
+	// levels above 0 select the (slower) high compression variant
+	int ret = (level > 0) ?
+		LZ4_compress_HC(source, dest, (int) sourceSize, (int) destSize, level) :
+		LZ4_compress_default(source, dest, (int) sourceSize, (int) destSize);
+
+	if (ret <= 0)
+	{
+		std::cerr << "ERROR: lz4 - input not compressable" << std::endl;
+		return 0;
+	}
+
+	return (uint32_t) ret;
+}
+#endif
+
+#ifdef OSMPBF_WITH_ZSTD
+bool zstdDecompressData(const char * source, uint32_t sourceSize, char * dest, uint32_t destSize)
+{
+	size_t ret = ZSTD_decompress(dest, destSize, source, sourceSize);
+	if (ZSTD_isError(ret))
+	{
+		std::cerr << "ERROR: zstd - " << ZSTD_getErrorName(ret) << std::endl;
+		return false;
+	}
+
+	if (ret != destSize)
+	{
+		std::cerr << "ERROR: zstd - unexpected uncompressed size" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+uint32_t zstdCompressData(const char * source, uint32_t sourceSize, char *& dest, uint32_t & destSize, int level)
+{
+	destSize = (uint32_t) ZSTD_compressBound(sourceSize);
+	dest = new char[destSize];
+
+	// 3 is zstd's default level
+	size_t ret = ZSTD_compress(dest, destSize, source, sourceSize, level < 0 ? 3 : level);
+	if (ZSTD_isError(ret))
+	{
+		std::cerr << "ERROR: zstd - " << ZSTD_getErrorName(ret) << std::endl;
+		return 0;
+	}
+
+	return (uint32_t) ret;
+}
+#endif
+
 AbstractBlobFile::AbstractBlobFile(const std::string & fileName)
 	: m_FileName(fileName),
 	  m_FileDescriptor(-1),
@@ -131,8 +240,22 @@ AbstractBlobFile::AbstractBlobFile(const std::string & fileName)
 }
 
 BlobFileIn::BlobFileIn(const std::string & fileName)
-	: AbstractBlobFile(fileName), m_FileData(NULL)
+	: AbstractBlobFile(fileName), m_Source(SOURCE_Path), m_MemoryData(NULL), m_MemorySize(0),
+	  m_FileData(NULL), m_FilePos(0), m_FileSize(0), m_EndPos(0), m_BufferPool(&BlobBufferPool::defaultPool())
+{
+}
+
+BlobFileIn::BlobFileIn(const char * data, SizeType size)
+	: AbstractBlobFile("<memory>"), m_Source(SOURCE_Memory), m_MemoryData(data), m_MemorySize(size),
+	  m_FileData(NULL), m_FilePos(0), m_FileSize(0), m_EndPos(0), m_BufferPool(&BlobBufferPool::defaultPool())
+{
+}
+
+BlobFileIn::BlobFileIn(int fileDescriptor)
+	: AbstractBlobFile("<descriptor " + std::to_string(fileDescriptor) + ">"), m_Source(SOURCE_Descriptor), m_MemoryData(NULL), m_MemorySize(0),
+	  m_FileData(NULL), m_FilePos(0), m_FileSize(0), m_EndPos(0), m_BufferPool(&BlobBufferPool::defaultPool())
 {
+	m_FileDescriptor = fileDescriptor;
 }
 
 BlobFileIn::~BlobFileIn()
@@ -148,39 +271,58 @@ bool BlobFileIn::open()
 
 	m_FileData = NULL;
 	m_FileSize = 0;
+	m_EndPos = 0;
 	m_FilePos = 0;
 
-	m_FileDescriptor = osmpbf::open(m_FileName.c_str(), IO_OPEN_READ_ONLY);
-	if (m_FileDescriptor < 0) {
-		std::cerr << "ERROR: Could not open file: " << m_FileName << std::endl;
+	if (m_Source == SOURCE_Memory) {
+		if (!m_MemoryData || !m_MemorySize) {
+			std::cerr << "ERROR: memory region is empty" << std::endl;
+			return false;
+		}
+		//m_FileData is only read from
+		m_FileData = const_cast<char *>(m_MemoryData);
+		m_FileSize = m_MemorySize;
+		m_EndPos = m_FileSize;
+
+		if (m_VerboseOutput) std::cout << "done" << std::endl;
+		return true;
+	}
+
+	if (m_Source == SOURCE_Path) {
+		m_FileDescriptor = osmpbf::open(m_FileName.c_str(), IO_OPEN_READ_ONLY);
+		if (m_FileDescriptor < 0) {
+			std::cerr << "ERROR: Could not open file: " << m_FileName << std::endl;
+			return false;
+		}
+	}
+	else if (m_FileDescriptor < 0) {
+		std::cerr << "ERROR: invalid file descriptor" << std::endl;
 		return false;
 	}
 	
 	uint64_t fileSize = osmpbf::fileSize(m_FileDescriptor);
 	if (!fileSize) {
 		std::cerr << "ERROR: File is empty or non-existent" << std::endl;
-		osmpbf::close(m_FileDescriptor);
-		m_FileDescriptor = -1;
+		closeDescriptor();
 		return false;
 	}
 	
 	if (fileSize > (std::numeric_limits<SizeType>::max)())
 	{
 		std::cerr << "ERROR: input file is larger than " << ((std::numeric_limits<SizeType>::max)() >> 30) << " GiB" << std::endl;
-		osmpbf::close(m_FileDescriptor);
-		m_FileDescriptor = -1;
+		closeDescriptor();
 		return false;
 	}
 
 	m_FileSize = SizeType(fileSize);
+	m_EndPos = m_FileSize;
 
 	m_FileData = (char *) mmap(0, m_FileSize, MM_PROT_READ, MM_MAP_SHARED, m_FileDescriptor, 0);
 
 	if (!osmpbf::validMmapAddress(m_FileData))
 	{
 		std::cerr << "ERROR: could not mmap file" << std::endl;
-		osmpbf::close(m_FileDescriptor);
-		m_FileDescriptor = -1;
+		closeDescriptor();
 		m_FileData = NULL;
 		return false;
 	}
@@ -194,14 +336,24 @@ void BlobFileIn::close()
 	if (m_FileData)
 	{
 		if (m_VerboseOutput) std::cout << "closing file ...";
-		osmpbf::munmap(m_FileData, m_FileSize);
-		osmpbf::close(m_FileDescriptor);
+		if (m_Source != SOURCE_Memory)
+			osmpbf::munmap(m_FileData, m_FileSize);
+		closeDescriptor();
 		if (m_VerboseOutput) std::cout << "done" << std::endl;
 
 		m_FileData = NULL;
 	}
 }
 
+void BlobFileIn::closeDescriptor()
+{
+	if (m_Source == SOURCE_Path && m_FileDescriptor >= 0)
+	{
+		osmpbf::close(m_FileDescriptor);
+		m_FileDescriptor = -1;
+	}
+}
+
 void BlobFileIn::seek(OffsetType position)
 {
 	m_FilePos = position;
@@ -209,6 +361,7 @@ void BlobFileIn::seek(OffsetType position)
 
 SizeType BlobFileIn::position() const
 {
+	std::lock_guard<std::mutex> lck(m_fileLock);
 	return m_FilePos;
 }
 
@@ -217,13 +370,93 @@ SizeType BlobFileIn::size() const
 	return m_FileSize;
 }
 
+void BlobFileIn::setEnd(SizeType end)
+{
+	m_EndPos = std::min(end, m_FileSize);
+}
+
+namespace
+{
+	///serialized start of a BlobHeader of type "OSMData": field 1 (type) of length 7
+	const char OSMDATA_SIGNATURE[] = "\x0A\x07OSMData";
+	constexpr std::size_t OSMDATA_SIGNATURE_SIZE = sizeof(OSMDATA_SIGNATURE) - 1;
+
+	///BlobHeader of the calling thread, parsing clears it but keeps the memory of its type string
+	BlobHeader & threadBlobHeader()
+	{
+		thread_local BlobHeader blobHeader;
+		return blobHeader;
+	}
+}
+
+bool BlobFileIn::blobAt(SizeType position, BlobDataType & type, SizeType & body, uint32_t & bodyLength) const
+{
+	if (!m_FileData || position + sizeof(uint32_t) > m_FileSize)
+		return false;
+
+	uint32_t headerLength;
+	::memmove(&headerLength, m_FileData + position, sizeof(uint32_t));
+	headerLength = osmpbf::net2hostLong(headerLength);
+
+	if (!headerLength || headerLength >= MAX_BLOB_HEADER_SIZE || position + sizeof(uint32_t) + headerLength > m_FileSize)
+		return false;
+
+	BlobHeader & blobHeader = threadBlobHeader();
+	if (!blobHeader.ParseFromArray(m_FileData + position + sizeof(uint32_t), headerLength))
+		return false;
+
+	if (blobHeader.type() == "OSMData")
+		type = BLOB_OSMData;
+	else if (blobHeader.type() == "OSMHeader")
+		type = BLOB_OSMHeader;
+	else
+		return false;
+
+	if (blobHeader.datasize() <= 0 || uint32_t(blobHeader.datasize()) >= MAX_BLOB_BODY_SIZE)
+		return false;
+
+	body = position + sizeof(uint32_t) + headerLength;
+	bodyLength = blobHeader.datasize();
+	return body + bodyLength <= m_FileSize;
+}
+
+SizeType BlobFileIn::findBlob(SizeType position) const
+{
+	if (!m_FileData)
+		return m_FileSize;
+
+	//the signature follows the length prefix of the header
+	const char * end = m_FileData + m_FileSize;
+	const char * it = m_FileData + std::min<SizeType>(position + sizeof(uint32_t), m_FileSize);
+
+	while ((it = std::search(it, end, OSMDATA_SIGNATURE, OSMDATA_SIGNATURE + OSMDATA_SIGNATURE_SIZE)) != end)
+	{
+		SizeType candidate = SizeType(it - m_FileData) - sizeof(uint32_t);
+		BlobDataType type;
+		SizeType body;
+		uint32_t bodyLength;
+		//compressed data may contain the signature by chance, the next blob has to be valid as well
+		if (blobAt(candidate, type, body, bodyLength) && type == BLOB_OSMData)
+		{
+			SizeType next = body + bodyLength;
+			if (next == m_FileSize || blobAt(next, type, body, bodyLength))
+				return candidate;
+		}
+		++it;
+	}
+
+	return m_FileSize;
+}
+
 void BlobFileIn::readBlob(BlobDataBuffer & buffer)
 {
-	buffer.type = readBlob(buffer.data, buffer.totalBytes, buffer.availableBytes);
+	buffer.type = readBlob(buffer.data, buffer.totalBytes, buffer.availableBytes, NULL, &buffer.pool);
 }
 
-constexpr uint32_t MAX_HEADER_SIZE = 64 << 10;
-constexpr uint32_t MAX_BODY_SIZE = 32 << 20;
+void BlobFileIn::readBlob(BlobDataBuffer & buffer, RawBlobRef & rawBlob)
+{
+	buffer.type = readBlob(buffer.data, buffer.totalBytes, buffer.availableBytes, &rawBlob, &buffer.pool);
+}
 
 ///NOT thread-safe! Has to be guarded by m_fileLock
 ///Accesses m_filePos
@@ -242,30 +475,43 @@ void * BlobFileIn::fileData(SizeType _position)
 void BlobFileIn::readBlobHeader(uint32_t & blobLength, osmpbf::BlobDataType & blobDataType)
 {
 	blobDataType = BLOB_Invalid;
+	blobLength = 0;
 
 	if (m_VerboseOutput) std::cout << "checking blob header ..." << std::endl;
 
+	if (m_FilePos + sizeof(uint32_t) > m_FileSize)
+	{
+		std::cerr << "ERROR: truncated blob header size" << std::endl;
+		return;
+	}
+
 	uint32_t headerLength;
 	::memmove(&headerLength, fileData(), sizeof(uint32_t));
 	headerLength = osmpbf::net2hostLong(headerLength);
 
 	if (m_VerboseOutput) std::cout << "header length : " << headerLength << " B" << std::endl;
 
-	if (!headerLength || headerLength >= MAX_HEADER_SIZE)
+	if (!headerLength || headerLength >= MAX_BLOB_HEADER_SIZE)
 	{
 		std::cerr << "ERROR: invalid blob header size found:" << headerLength;
-		if (headerLength >= MAX_HEADER_SIZE)
-			std::cerr << " (max: " << MAX_HEADER_SIZE << ')';
+		if (headerLength >= MAX_BLOB_HEADER_SIZE)
+			std::cerr << " (max: " << MAX_BLOB_HEADER_SIZE << ')';
 
 		std::cerr << std::endl;
 		return;
 	}
 
+	if (m_FilePos + sizeof(uint32_t) + headerLength > m_FileSize)
+	{
+		std::cerr << "ERROR: truncated blob header" << std::endl;
+		return;
+	}
+
 	m_FilePos += 4;
 
 	if (m_VerboseOutput) std::cout << "parsing blob header ..." << std::endl;
 
-	BlobHeader * blobHeader = new BlobHeader();
+	BlobHeader * blobHeader = &threadBlobHeader();
 
 	if (!blobHeader->ParseFromArray(fileData(), headerLength))
 	{
@@ -290,95 +536,282 @@ void BlobFileIn::readBlobHeader(uint32_t & blobLength, osmpbf::BlobDataType & bl
 			blobDataType = BLOB_OSMData;
 
 		blobLength = blobHeader->datasize();
-	}
 
-	delete blobHeader;
+		//the body has to be inside the mapping
+		if (m_FilePos + blobLength > m_FileSize)
+		{
+			std::cerr << "ERROR: truncated blob" << std::endl;
+			blobDataType = BLOB_Invalid;
+			blobLength = 0;
+		}
+	}
 }
 
 BlobDataType BlobFileIn::readBlob(char * & buffer, uint32_t & bufferSize, uint32_t & availableDataSize)
 {
-	//we do some "speculative" pre-allocation here to reduce the time spend in the lock
-	std::unique_ptr<Blob> blob(new Blob());
-	
-	std::unique_lock<std::mutex> lck(m_fileLock);
-	if (m_FilePos >= m_FileSize)
-		return BLOB_Invalid;
+	return readBlob(buffer, bufferSize, availableDataSize, NULL, NULL);
+}
 
-	if (m_VerboseOutput) std::cout << "== blob ==" << std::endl;
+namespace
+{
+	///make @buffer hold at least @size bytes, its contents are discarded
+	void reserveBuffer(char * & buffer, uint32_t & bufferSize, uint32_t size, BlobBufferPool ** bufferOwner, BlobBufferPool * pool)
+	{
+		if (bufferSize >= size)
+			return;
 
-	uint32_t blobLength;
-	BlobDataType blobDataType;
+		if (!bufferOwner)
+		{
+			if (buffer) delete[] buffer;
+			buffer = new char[size];
+			bufferSize = size;
+			return;
+		}
 
-	readBlobHeader(blobLength, blobDataType);
+		if (*bufferOwner)
+			(*bufferOwner)->release(buffer, bufferSize);
+		else if (buffer)
+			delete[] buffer;
 
-	if (blobLength >= MAX_BODY_SIZE)
+		if (pool)
+		{
+			buffer = pool->allocate(size, bufferSize);
+		}
+		else
+		{
+			buffer = new char[size];
+			bufferSize = size;
+		}
+		*bufferOwner = pool;
+	}
+
+	///payload of a serialized Blob, pointing into the serialized data
+	struct BlobPayload {
+		const char * data;
+		uint32_t length;
+		///COMPRESSION_None for raw data
+		BlobCompression compression;
+		bool hasData;
+		bool unsupported;
+		bool hasRawSize;
+		int32_t rawSize;
+
+		BlobPayload() : data(NULL), length(0), compression(COMPRESSION_None), hasData(false), unsupported(false), hasRawSize(false), rawSize(0) {}
+	};
+
+	/**
+	 * read the fields of the serialized Blob @data without copying its payload (as Blob::ParseFromArray() would).
+	 * Field numbers are those of osmblob.proto
+	 */
+	bool parseBlobPayload(const char * data, uint32_t length, BlobPayload & payload)
 	{
-		std::cerr << "ERROR: invalid blob size found:" << blobLength << " (max: " << MAX_BODY_SIZE << ')' << std::endl;
-		return BLOB_Invalid;
+		enum {FIELD_Raw = 1, FIELD_RawSize = 2, FIELD_Zlib = 3, FIELD_Lzma = 4, FIELD_Bzip2 = 5, FIELD_Lz4 = 6, FIELD_Zstd = 7};
+		enum {WIRE_Varint = 0, WIRE_Fixed64 = 1, WIRE_LengthDelimited = 2, WIRE_Fixed32 = 5};
+
+		google::protobuf::io::CodedInputStream input(reinterpret_cast<const uint8_t *>(data), (int) length);
+
+		while (uint32_t tag = input.ReadTag())
+		{
+			uint32_t field = tag >> 3;
+			switch (tag & 7)
+			{
+			case WIRE_Varint:
+			{
+				uint64_t value;
+				if (!input.ReadVarint64(&value))
+					return false;
+				if (field == FIELD_RawSize)
+				{
+					payload.hasRawSize = true;
+					payload.rawSize = (int32_t) value;
+				}
+				break;
+			}
+			case WIRE_Fixed64:
+				if (!input.Skip(8))
+					return false;
+				break;
+			case WIRE_Fixed32:
+				if (!input.Skip(4))
+					return false;
+				break;
+			case WIRE_LengthDelimited:
+			{
+				uint32_t size;
+				if (!input.ReadVarint32(&size))
+					return false;
+
+				const char * fieldData = data + input.CurrentPosition();
+				if (!input.Skip((int) size))
+					return false;
+
+				BlobCompression compression = COMPRESSION_None;
+				switch (field)
+				{
+				case FIELD_Raw:
+					break;
+				case FIELD_Zlib:
+					compression = COMPRESSION_Zlib;
+					break;
+				case FIELD_Lz4:
+					compression = COMPRESSION_Lz4;
+					break;
+				case FIELD_Zstd:
+					compression = COMPRESSION_Zstd;
+					break;
+				case FIELD_Lzma:
+				case FIELD_Bzip2:
+					payload.unsupported = true;
+					continue;
+				default:
+					continue;
+				}
+
+				payload.data = fieldData;
+				payload.length = size;
+				payload.compression = compression;
+				payload.hasData = true;
+				break;
+			}
+			default:
+				return false;
+			}
+		}
+
+		//ReadTag() returns 0 at the end of the data as well as on malformed tags
+		return input.CurrentPosition() == (int) length;
 	}
-	
-	if (blobDataType && blobLength)
+
+	///parse the serialized Blob @data and decompress it into @buffer (see reserveBuffer()).
+	///The payload is decompressed straight from @data, no intermediate copies are made
+	bool decodeBlobData(const char * data, uint32_t length, char * & buffer, uint32_t & bufferSize, uint32_t & availableDataSize,
+		BlobBufferPool ** bufferOwner, BlobBufferPool * pool, bool verbose)
 	{
-		SizeType myFilePos = m_FilePos;
-		m_FilePos += blobLength;
-		lck.unlock();
-		
-		if (m_VerboseOutput) std::cout << "parsing blob ..." << std::endl;
+		BlobPayload payload;
+
+		if (verbose) std::cout << "parsing blob ..." << std::endl;
 
-		if (!blob->ParseFromArray(fileData(myFilePos), blobLength))
+		if (!parseBlobPayload(data, length, payload))
 		{
 			std::cerr << "ERROR: invalid blob structure" << std::endl;
-			return BLOB_Invalid;
+			return false;
 		}
 
-		if (blob->has_raw_size())
+		if (!payload.hasData || (payload.compression != COMPRESSION_None && !payload.hasRawSize))
 		{
-			if (m_VerboseOutput) std::cout << "found compressed blob data" << std::endl;
-			if (m_VerboseOutput) std::cout << "uncompressed size : " << blob->raw_size() << "B ( " << blob->raw_size() / 1024.f << " KiB )" << std::endl;
-
-			std::string * compressedData = blob->release_zlib_data();
-			availableDataSize = blob->raw_size();
+			if (payload.unsupported)
+				std::cerr << "ERROR: unsupported blob compression" << std::endl;
+			else
+				std::cerr << "ERROR: blob without data" << std::endl;
+			return false;
+		}
 
-			blob.reset(0);
+		if (payload.compression != COMPRESSION_None)
+		{
+			if (verbose) std::cout << "found compressed blob data" << std::endl;
+			if (verbose) std::cout << "uncompressed size : " << payload.rawSize << "B ( " << payload.rawSize / 1024.f << " KiB )" << std::endl;
 
-			if (bufferSize < availableDataSize)
+			if (!BlobFileOut::compressionSupported(payload.compression))
 			{
-				if (buffer) delete[] buffer;
-				buffer = new char[availableDataSize];
+				std::cerr << "ERROR: found " << (payload.compression == COMPRESSION_Zstd ? "zstd" : "lz4")
+					<< " compressed blob, but osmpbf was built without support for it" << std::endl;
+				return false;
+			}
 
-				bufferSize = availableDataSize;
+			if (payload.rawSize < 0)
+			{
+				std::cerr << "ERROR: invalid uncompressed blob size " << payload.rawSize << std::endl;
+				return false;
 			}
 
-			if (m_VerboseOutput) std::cout << "decompressing data ... ";
-			
-			assert(compressedData->length() < std::numeric_limits<uint32_t>::max());
-			inflateData(compressedData->data(), (uint32_t) compressedData->length(), buffer, availableDataSize);
+			availableDataSize = (uint32_t) payload.rawSize;
+
+			reserveBuffer(buffer, bufferSize, availableDataSize, bufferOwner, pool);
 
-			if (m_VerboseOutput) std::cout << "done" << std::endl;
+			if (verbose) std::cout << "decompressing data ... ";
 
-			delete compressedData;
+			bool decompressed = false;
+			switch (payload.compression)
+			{
+			case COMPRESSION_Zlib:
+				decompressed = inflateData(payload.data, payload.length, buffer, availableDataSize);
+				break;
+#ifdef OSMPBF_WITH_ZSTD
+			case COMPRESSION_Zstd:
+				decompressed = zstdDecompressData(payload.data, payload.length, buffer, availableDataSize);
+				break;
+#endif
+#ifdef OSMPBF_WITH_LZ4
+			case COMPRESSION_Lz4:
+				decompressed = lz4DecompressData(payload.data, payload.length, buffer, availableDataSize);
+				break;
+#endif
+			default:
+				break;
+			}
+
+			if (!decompressed)
+				return false;
+
+			if (verbose) std::cout << "done" << std::endl;
 		}
 		else
 		{
-			if (m_VerboseOutput) std::cout << "found uncompressed blob data" << std::endl;
+			if (verbose) std::cout << "found uncompressed blob data" << std::endl;
 
-			std::string * uncompressedData = blob->release_raw();
-			assert(uncompressedData->length() < std::numeric_limits<uint32_t>::max());
-			availableDataSize = (uint32_t) uncompressedData->length();
+			availableDataSize = payload.length;
 
-			blob.reset(0);
+			reserveBuffer(buffer, bufferSize, availableDataSize, bufferOwner, pool);
 
-			if (bufferSize < availableDataSize)
-			{
-				if (buffer) delete[] buffer;
-				buffer = new char[availableDataSize];
+			memmove(buffer, payload.data, availableDataSize);
+		}
 
-				bufferSize = availableDataSize;
-			}
+		return true;
+	}
+}
 
-			memmove(buffer, uncompressedData->data(), availableDataSize);
-			delete uncompressedData;
+bool decodeBlob(const char * data, uint32_t length, BlobDataBuffer & buffer, BlobBufferPool * pool)
+{
+	return decodeBlobData(data, length, buffer.data, buffer.totalBytes, buffer.availableBytes, &buffer.pool, pool, false);
+}
+
+BlobDataType BlobFileIn::readBlob(char * & buffer, uint32_t & bufferSize, uint32_t & availableDataSize, RawBlobRef * rawBlob, BlobBufferPool ** bufferOwner)
+{
+	std::unique_lock<std::mutex> lck(m_fileLock);
+	if (m_FilePos >= m_EndPos)
+		return BLOB_Invalid;
+
+	if (m_VerboseOutput) std::cout << "== blob ==" << std::endl;
+
+	SizeType blobPos = m_FilePos;
+
+	uint32_t blobLength;
+	BlobDataType blobDataType;
+
+	readBlobHeader(blobLength, blobDataType);
+
+	if (blobLength >= MAX_BLOB_BODY_SIZE)
+	{
+		std::cerr << "ERROR: invalid blob size found:" << blobLength << " (max: " << MAX_BLOB_BODY_SIZE << ')' << std::endl;
+		return BLOB_Invalid;
+	}
+	
+	if (blobDataType && blobLength)
+	{
+		SizeType myFilePos = m_FilePos;
+		m_FilePos += blobLength;
+		lck.unlock();
+
+		if (rawBlob)
+		{
+			rawBlob->type = blobDataType;
+			rawBlob->offset = blobPos;
+			rawBlob->data = m_FileData + blobPos;
+			rawBlob->length = (uint32_t) (myFilePos + blobLength - blobPos);
 		}
+		
+		if (!decodeBlobData(static_cast<const char *>(fileData(myFilePos)), blobLength, buffer, bufferSize, availableDataSize, bufferOwner, m_BufferPool, m_VerboseOutput))
+			return BLOB_Invalid;
 
 		return blobDataType;
 	}
@@ -392,9 +825,73 @@ BlobDataType BlobFileIn::readBlob(char * & buffer, uint32_t & bufferSize, uint32
 	return BLOB_Invalid;
 }
 
+bool BlobFileIn::readRawBlob(RawBlobRef & rawBlob)
+{
+	std::lock_guard<std::mutex> lck(m_fileLock);
+	if (m_FilePos >= m_EndPos)
+		return false;
+
+	if (m_VerboseOutput) std::cout << "== blob ==" << std::endl;
+
+	SizeType blobPos = m_FilePos;
+
+	uint32_t blobLength = 0;
+	BlobDataType blobDataType;
+
+	readBlobHeader(blobLength, blobDataType);
+
+	if (blobLength >= MAX_BLOB_BODY_SIZE)
+	{
+		std::cerr << "ERROR: invalid blob size found:" << blobLength << " (max: " << MAX_BLOB_BODY_SIZE << ')' << std::endl;
+		return false;
+	}
+
+	if (!blobDataType || !blobLength)
+	{
+		if (!blobDataType)
+			std::cerr << "ERROR: invalid blob type" << std::endl;
+		if (!blobLength)
+			std::cerr << "ERROR: invalid blob size" << std::endl;
+		return false;
+	}
+
+	m_FilePos += blobLength;
+
+	rawBlob.type = blobDataType;
+	rawBlob.offset = blobPos;
+	rawBlob.data = m_FileData + blobPos;
+	rawBlob.length = (uint32_t) (m_FilePos - blobPos);
+
+	return true;
+}
+
+bool BlobFileIn::readBlobAt(SizeType offset, BlobDataBuffer & buffer, SizeType * next) const
+{
+	BlobDataType type;
+	SizeType body;
+	uint32_t bodyLength;
+	if (!blobAt(offset, type, body, bodyLength))
+	{
+		std::cerr << "ERROR: no valid blob found at offset " << offset << std::endl;
+		buffer.type = BLOB_Invalid;
+		return false;
+	}
+
+	if (!decodeBlobData(m_FileData + body, bodyLength, buffer.data, buffer.totalBytes, buffer.availableBytes, &buffer.pool, m_BufferPool, false))
+	{
+		buffer.type = BLOB_Invalid;
+		return false;
+	}
+
+	buffer.type = type;
+	if (next)
+		*next = body + bodyLength;
+	return true;
+}
+
 bool BlobFileIn::skipBlob()
 {
-	if (m_FilePos >= m_FileSize)
+	if (m_FilePos >= m_EndPos)
 		return false;
 
 	if (m_VerboseOutput) std::cout << "== blob ==" << std::endl;
@@ -420,7 +917,7 @@ bool BlobFileIn::skipBlob()
 
 
 BlobFileOut::BlobFileOut(const std::string & fileName)
-	: AbstractBlobFile(fileName), m_CurrentSize(0)
+	: AbstractBlobFile(fileName), m_CurrentSize(0), m_Compression(COMPRESSION_Zlib), m_CompressionLevel(-1)
 {
 }
 
@@ -470,6 +967,91 @@ bool BlobFileOut::writeBlob(const BlobDataBuffer & buffer, bool compress)
 	return writeBlob(buffer.type, buffer.data, buffer.availableBytes, compress);
 }
 
+bool BlobFileOut::compressionSupported(BlobCompression compression)
+{
+	switch (compression)
+	{
+	case COMPRESSION_None:
+	case COMPRESSION_Zlib:
+		return true;
+#ifdef OSMPBF_WITH_LZ4
+	case COMPRESSION_Lz4:
+		return true;
+#endif
+#ifdef OSMPBF_WITH_ZSTD
+	case COMPRESSION_Zstd:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+bool BlobFileOut::setCompression(BlobCompression compression, int level)
+{
+	if (!compressionSupported(compression))
+	{
+		std::cerr << "ERROR: requested blob compression is not supported by this build" << std::endl;
+		return false;
+	}
+
+	//negative levels select the codec's default
+	int maxLevel = 0;
+	switch (compression)
+	{
+#ifdef OSMPBF_WITH_ZSTD
+	case COMPRESSION_Zstd:
+		maxLevel = ZSTD_maxCLevel();
+		break;
+#endif
+#ifdef OSMPBF_WITH_LZ4
+	case COMPRESSION_Lz4:
+		maxLevel = LZ4HC_CLEVEL_MAX;
+		break;
+#endif
+	case COMPRESSION_Zlib:
+		maxLevel = Z_BEST_COMPRESSION;
+		break;
+	default:
+		//the level is ignored
+		maxLevel = std::numeric_limits<int>::max();
+		break;
+	}
+
+	if (level > maxLevel)
+	{
+		std::cerr << "ERROR: invalid blob compression level " << level << " (max: " << maxLevel << ')' << std::endl;
+		return false;
+	}
+
+	m_Compression = compression;
+	m_CompressionLevel = level;
+	return true;
+}
+
+bool BlobFileOut::writeRawBlob(const RawBlobRef & rawBlob)
+{
+	if (rawBlob.type == BLOB_Invalid || !rawBlob.data)
+		return false;
+
+	if (m_VerboseOutput) std::cout << "writing raw blob...";
+
+	SignedSizeType written = osmpbf::write(m_FileDescriptor, rawBlob.data, rawBlob.length);
+	if (written != (SignedSizeType) rawBlob.length)
+	{
+		std::cerr << "error writing raw blob" << std::endl;
+		return false;
+	}
+
+	if (m_VerboseOutput) std::cout << "done" << std::endl;
+
+	SizeType pos = position();
+	if (m_CurrentSize < pos)
+		m_CurrentSize = pos;
+
+	return true;
+}
+
 bool BlobFileOut::writeBlob(osmpbf::BlobDataType type, const char * buffer, uint32_t bufferSize, bool compress)
 {
 	if (type == BLOB_Invalid)
@@ -478,19 +1060,46 @@ bool BlobFileOut::writeBlob(osmpbf::BlobDataType type, const char * buffer, uint
 	if (m_VerboseOutput) std::cout << "preparing blob data:" << std::endl;
 	Blob * blob = new Blob();
 
-	if (compress)
+	if (compress && m_Compression != COMPRESSION_None)
 	{
-		char * zlibBuffer = NULL;
-		uint32_t zlibBufferSize = 0;
-		uint32_t zlibDataAvailable = 0;
+		char * compressedBuffer = NULL;
+		uint32_t compressedBufferSize = 0;
+		uint32_t compressedDataAvailable = 0;
 
 		if (m_VerboseOutput) std::cout << "compressing data ... ";
-		zlibDataAvailable = deflateData(buffer, bufferSize, zlibBuffer, zlibBufferSize);
-		if (m_VerboseOutput) std::cout << "done" << std::endl;
-
 		blob->set_raw_size(bufferSize);
-		blob->set_zlib_data((void *)zlibBuffer, zlibDataAvailable);
-		delete[] zlibBuffer;
+
+		switch (m_Compression)
+		{
+#ifdef OSMPBF_WITH_ZSTD
+		case COMPRESSION_Zstd:
+			compressedDataAvailable = zstdCompressData(buffer, bufferSize, compressedBuffer, compressedBufferSize, m_CompressionLevel);
+			blob->set_zstd_data((void *)compressedBuffer, compressedDataAvailable);
+			break;
+#endif
+#ifdef OSMPBF_WITH_LZ4
+		case COMPRESSION_Lz4:
+			compressedDataAvailable = lz4CompressData(buffer, bufferSize, compressedBuffer, compressedBufferSize, m_CompressionLevel);
+			blob->set_lz4_data((void *)compressedBuffer, compressedDataAvailable);
+			break;
+#endif
+		default:
+			compressedDataAvailable = deflateData(buffer, bufferSize, compressedBuffer, compressedBufferSize, m_CompressionLevel);
+			blob->set_zlib_data((void *)compressedBuffer, compressedDataAvailable);
+			break;
+		}
+
+		delete[] compressedBuffer;
+
+		//an empty compressed field with raw_size set would be a corrupt blob
+		if (!compressedDataAvailable)
+		{
+			std::cerr << "ERROR: failed to compress blob" << std::endl;
+			delete blob;
+			return false;
+		}
+
+		if (m_VerboseOutput) std::cout << "done" << std::endl;
 	}
 	else
 	{
@@ -0,0 +1,263 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#include <osmpbf/blobstream.h>
+#include <osmpbf/blobfile.h>
+#include <osmpbf/fileio.h>
+#include <osmpbf/net.h>
+
+#include "osmblob.pb.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace osmpbf
+{
+
+BlobStreamIn::BlobStreamIn(int fileDescriptor, uint32_t readAhead, BlobBufferPool * pool) :
+	m_FileDescriptor(fileDescriptor),
+	m_ReadAhead(std::max<uint32_t>(readAhead, 1)),
+	m_BufferPool(pool),
+	m_Position(0),
+	m_BytesRead(0),
+	m_EndOfInput(false),
+	m_Failed(false),
+	m_Stop(false)
+{
+	m_Reader = std::thread(&BlobStreamIn::run, this);
+}
+
+BlobStreamIn::~BlobStreamIn()
+{
+	{
+		std::lock_guard<std::mutex> lck(m_Lock);
+		m_Stop = true;
+	}
+	m_NotFull.notify_all();
+	if (m_Reader.joinable())
+		m_Reader.join();
+}
+
+void BlobStreamIn::readBlob(BlobDataBuffer & buffer)
+{
+	Chunk chunk;
+	{
+		std::unique_lock<std::mutex> lck(m_Lock);
+		m_NotEmpty.wait(lck, [this]() { return !m_Queue.empty() || m_EndOfInput; });
+		if (m_Queue.empty())
+		{
+			buffer.type = BLOB_Invalid;
+			return;
+		}
+		chunk = std::move(m_Queue.front());
+		m_Queue.pop_front();
+		m_Position += chunk.length;
+	}
+	m_NotFull.notify_one();
+
+	//decompress outside of the lock
+	if (decodeBlob(chunk.data.data, chunk.data.availableBytes, buffer, m_BufferPool))
+	{
+		buffer.type = chunk.type;
+		return;
+	}
+
+	//a blob that does not decode ends the input like a read error, later blobs are not handed out
+	buffer.type = BLOB_Invalid;
+	{
+		std::lock_guard<std::mutex> lck(m_Lock);
+		m_Failed = true;
+		m_Stop = true;
+		m_EndOfInput = true;
+		m_Queue.clear();
+	}
+	m_NotEmpty.notify_all();
+	m_NotFull.notify_all();
+}
+
+bool BlobStreamIn::hasNext() const
+{
+	std::unique_lock<std::mutex> lck(m_Lock);
+	m_NotEmpty.wait(lck, [this]() { return !m_Queue.empty() || m_EndOfInput; });
+	return !m_Queue.empty();
+}
+
+SizeType BlobStreamIn::position() const
+{
+	std::lock_guard<std::mutex> lck(m_Lock);
+	return m_Position;
+}
+
+SizeType BlobStreamIn::bytesRead() const
+{
+	std::lock_guard<std::mutex> lck(m_Lock);
+	return m_BytesRead;
+}
+
+bool BlobStreamIn::failed() const
+{
+	std::lock_guard<std::mutex> lck(m_Lock);
+	return m_Failed;
+}
+
+void BlobStreamIn::run()
+{
+	std::string headerData;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lck(m_Lock);
+			m_NotFull.wait(lck, [this]() { return m_Stop || m_Queue.size() < m_ReadAhead; });
+			if (m_Stop)
+				break;
+		}
+
+		Chunk chunk;
+		if (!readChunk(chunk, headerData))
+			break;
+
+		{
+			std::lock_guard<std::mutex> lck(m_Lock);
+			if (m_Stop)
+				break;
+			m_BytesRead += chunk.length;
+			m_Queue.emplace_back(std::move(chunk));
+		}
+		m_NotEmpty.notify_one();
+	}
+
+	{
+		std::lock_guard<std::mutex> lck(m_Lock);
+		m_EndOfInput = true;
+	}
+	m_NotEmpty.notify_all();
+}
+
+SizeType BlobStreamIn::readFully(char * buffer, SizeType count)
+{
+	SizeType done = 0;
+	while (done < count)
+	{
+		SignedSizeType ret = osmpbf::read(m_FileDescriptor, buffer + done, count - done);
+		if (ret > 0)
+		{
+			done += ret;
+		}
+		else if (ret < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		else
+		{
+			if (ret < 0)
+			{
+				std::cerr << "ERROR: could not read input: " << std::strerror(errno) << std::endl;
+				std::lock_guard<std::mutex> lck(m_Lock);
+				m_Failed = true;
+			}
+			break;
+		}
+	}
+	return done;
+}
+
+bool BlobStreamIn::readChunk(Chunk & chunk, std::string & headerData)
+{
+	auto fail = [this]() {
+		std::lock_guard<std::mutex> lck(m_Lock);
+		m_Failed = true;
+		return false;
+	};
+
+	uint32_t headerLength;
+	SizeType count = readFully(reinterpret_cast<char *>(&headerLength), sizeof(uint32_t));
+	if (!count)
+		return false;
+
+	if (count != sizeof(uint32_t))
+	{
+		std::cerr << "ERROR: truncated blob header size" << std::endl;
+		return fail();
+	}
+
+	headerLength = osmpbf::net2hostLong(headerLength);
+	if (!headerLength || headerLength >= MAX_BLOB_HEADER_SIZE)
+	{
+		std::cerr << "ERROR: invalid blob header size found:" << headerLength << std::endl;
+		return fail();
+	}
+
+	headerData.resize(headerLength);
+	if (readFully(&headerData[0], headerLength) != headerLength)
+	{
+		std::cerr << "ERROR: truncated blob header" << std::endl;
+		return fail();
+	}
+
+	BlobHeader blobHeader;
+	if (!blobHeader.ParseFromString(headerData))
+	{
+		std::cerr << "ERROR: invalid blob header structure" << std::endl;
+		return fail();
+	}
+
+	if (blobHeader.type() == "OSMHeader")
+		chunk.type = BLOB_OSMHeader;
+	else if (blobHeader.type() == "OSMData")
+		chunk.type = BLOB_OSMData;
+	else
+	{
+		std::cerr << "ERROR: invalid blob type" << std::endl;
+		return fail();
+	}
+
+	uint32_t blobLength = blobHeader.datasize();
+	if (!blobLength || blobLength >= MAX_BLOB_BODY_SIZE)
+	{
+		std::cerr << "ERROR: invalid blob size found:" << blobLength << " (max: " << MAX_BLOB_BODY_SIZE << ')' << std::endl;
+		return fail();
+	}
+
+	BlobDataBuffer & data = chunk.data;
+	if (m_BufferPool)
+	{
+		data.data = m_BufferPool->allocate(blobLength, data.totalBytes);
+		data.pool = m_BufferPool;
+	}
+	else
+	{
+		data.data = new char[blobLength];
+		data.totalBytes = blobLength;
+	}
+	data.availableBytes = blobLength;
+
+	if (readFully(data.data, blobLength) != blobLength)
+	{
+		std::cerr << "ERROR: truncated blob" << std::endl;
+		return fail();
+	}
+
+	chunk.length = (uint32_t) (sizeof(uint32_t) + headerLength + blobLength);
+	return true;
+}
+
+} // namespace osmpbf
@@ -0,0 +1,184 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#include <osmpbf/blockcache.h>
+#include <osmpbf/blobfile.h>
+
+#include <algorithm>
+
+namespace osmpbf
+{
+
+BlockCache::BlockCache(BlobFileIn * file, SizeType capacity, uint32_t shardCount) :
+	m_File(file),
+	m_Capacity(capacity),
+	m_ShardCapacity(capacity / std::max<uint32_t>(shardCount, 1)),
+	m_Shards(std::max<uint32_t>(shardCount, 1)),
+	m_Hits(0),
+	m_Misses(0),
+	m_Evictions(0)
+{}
+
+BlockCache::~BlockCache() {}
+
+BlockCache::BufferPtr BlockCache::buffer(SizeType offset)
+{
+	Shard & s = shard(offset);
+	{
+		std::lock_guard<std::mutex> lck(s.lock);
+		if (Entry * entry = find(s, offset))
+		{
+			++m_Hits;
+			return entry->buffer;
+		}
+	}
+
+	++m_Misses;
+	//read outside of the lock, concurrent misses of the same blob may read it twice
+	BufferPtr result = read(offset);
+	if (!result)
+		return result;
+
+	std::lock_guard<std::mutex> lck(s.lock);
+	return insert(s, offset, result)->buffer;
+}
+
+BlockCache::AdaptorRef BlockCache::adaptor(SizeType offset)
+{
+	return lockAdaptor(offset, true);
+}
+
+BlockCache::AdaptorRef BlockCache::tryAdaptor(SizeType offset)
+{
+	return lockAdaptor(offset, false);
+}
+
+void BlockCache::clear()
+{
+	for (Shard & s : m_Shards)
+	{
+		std::lock_guard<std::mutex> lck(s.lock);
+		s.entries.clear();
+		s.index.clear();
+		s.bytes = 0;
+	}
+}
+
+SizeType BlockCache::usedBytes() const
+{
+	SizeType result = 0;
+	for (const Shard & s : m_Shards)
+	{
+		std::lock_guard<std::mutex> lck(s.lock);
+		result += s.bytes;
+	}
+	return result;
+}
+
+std::size_t BlockCache::size() const
+{
+	std::size_t result = 0;
+	for (const Shard & s : m_Shards)
+	{
+		std::lock_guard<std::mutex> lck(s.lock);
+		result += s.entries.size();
+	}
+	return result;
+}
+
+BlockCache::Entry * BlockCache::find(Shard & shard, SizeType offset)
+{
+	std::unordered_map<SizeType, EntryList::iterator>::iterator it = shard.index.find(offset);
+	if (it == shard.index.end())
+		return NULL;
+
+	shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+	return &shard.entries.front();
+}
+
+BlockCache::Entry * BlockCache::insert(Shard & shard, SizeType offset, const BufferPtr & buffer)
+{
+	if (Entry * entry = find(shard, offset))
+		return entry;
+
+	Entry entry;
+	entry.offset = offset;
+	entry.buffer = buffer;
+	entry.bytes = buffer->totalBytes;
+	shard.entries.push_front(entry);
+	shard.index[offset] = shard.entries.begin();
+	shard.bytes += entry.bytes;
+
+	evict(shard);
+	return &shard.entries.front();
+}
+
+void BlockCache::evict(Shard & shard)
+{
+	while (shard.bytes > m_ShardCapacity && shard.entries.size() > 1)
+	{
+		const Entry & victim = shard.entries.back();
+		shard.bytes -= victim.bytes;
+		shard.index.erase(victim.offset);
+		shard.entries.pop_back();
+		++m_Evictions;
+	}
+}
+
+BlockCache::BufferPtr BlockCache::read(SizeType offset)
+{
+	std::shared_ptr<BlobDataBuffer> result = std::make_shared<BlobDataBuffer>();
+	if (!m_File->readBlobAt(offset, *result))
+		return BufferPtr();
+	return result;
+}
+
+BlockCache::AdaptorRef BlockCache::lockAdaptor(SizeType offset, bool wait)
+{
+	BufferPtr data = buffer(offset);
+	if (!data)
+		return AdaptorRef();
+
+	Shard & s = shard(offset);
+	AdaptorRef::SlotPtr slot;
+	{
+		std::lock_guard<std::mutex> lck(s.lock);
+		Entry * entry = insert(s, offset, data);
+		if (!entry->adaptor)
+		{
+			entry->adaptor = std::make_shared<AdaptorRef::Slot>();
+			entry->bytes += data->availableBytes;
+			s.bytes += data->availableBytes;
+			evict(s);
+		}
+		slot = entry->adaptor;
+	}
+
+	AdaptorRef result = wait ? AdaptorRef(slot) : AdaptorRef(slot, std::try_to_lock);
+	//parse under the lock of the slot, only the first user parses
+	if (!result.isNull() && !slot->parsed)
+	{
+		slot->adaptor.parseData(data->data, data->availableBytes);
+		slot->parsed = true;
+	}
+	return result;
+}
+
+} // namespace osmpbf
@@ -0,0 +1,789 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#include <osmpbf/compiledfilter.h>
+
+#include <osmpbf/primitiveblockinputadaptor.h>
+#include <osmpbf/inode.h>
+#include <osmpbf/iway.h>
+#include <osmpbf/irelation.h>
+
+#include "osmformat.pb.h"
+
+#include <cstdlib>
+
+namespace osmpbf
+{
+
+// CompiledFilterProgram
+
+CompiledFilterProgram::CompiledFilterProgram(const RCFilterPtr & filter) :
+m_Monotone(true),
+m_MaskWords(0)
+{
+	emit(filter.get());
+
+	m_MaskWords = (uint32_t) ((m_Leaves.size() + 63) / 64);
+	m_AnyKeyMask.assign(m_MaskWords, 0);
+	m_AnyValueMask.assign(m_MaskWords, 0);
+	for (uint32_t i = 0; i < m_Leaves.size(); ++i)
+	{
+		if (m_Leaves[i].keyMatch == Leaf::KEY_Any)
+			m_AnyKeyMask[i >> 6] |= uint64_t(1) << (i & 63);
+		if (m_Leaves[i].valueMatch == Leaf::VALUE_Any)
+			m_AnyValueMask[i >> 6] |= uint64_t(1) << (i & 63);
+	}
+}
+
+void CompiledFilterProgram::emit(const AbstractTagFilter * filter)
+{
+	if (!filter)
+	{
+		m_Program.emplace_back(OP_Const, 0);
+		return;
+	}
+
+	if (const ConstantReturnFilter * f = dynamic_cast<const ConstantReturnFilter *>(filter))
+	{
+		m_Program.emplace_back(OP_Const, f->value() ? 1 : 0);
+	}
+	else if (const PrimitiveTypeFilter * f = dynamic_cast<const PrimitiveTypeFilter *>(filter))
+	{
+		m_Program.emplace_back(OP_Type, (uint32_t) f->filteredTypes());
+	}
+	else if (const InversionFilter * f = dynamic_cast<const InversionFilter *>(filter))
+	{
+		//a null-child cannot match anything
+		if (!f->child())
+		{
+			m_Program.emplace_back(OP_Const, 1);
+			return;
+		}
+
+		emit(f->child());
+		m_Program.emplace_back(OP_Not, 0);
+		m_Monotone = false;
+	}
+	else if (const AndTagFilter * f = dynamic_cast<const AndTagFilter *>(filter))
+	{
+		emitOr(f->children(), true);
+	}
+	else if (const OrTagFilter * f = dynamic_cast<const OrTagFilter *>(filter))
+	{
+		emitOr(f->children(), false);
+	}
+	else if (const IntTagFilter * f = dynamic_cast<const IntTagFilter *>(filter))
+	{
+		if (f->key().empty())
+		{
+			m_Program.emplace_back(OP_Const, 0);
+			return;
+		}
+
+		Leaf leaf;
+		leaf.valueMatch = Leaf::VALUE_Int;
+		leaf.intValue = f->value();
+
+		uint32_t id = addLeaf(leaf);
+		addKey(id, f->key());
+		m_Program.emplace_back(OP_Leaf, id);
+	}
+	else if (const NumericTagFilter * f = dynamic_cast<const NumericTagFilter *>(filter))
+	{
+		if (f->key().empty())
+		{
+			m_Program.emplace_back(OP_Const, 0);
+			return;
+		}
+
+		Leaf leaf;
+		leaf.valueMatch = Leaf::VALUE_Numeric;
+		leaf.comparison = f->comparison();
+		leaf.minValue = f->minValue();
+		leaf.maxValue = f->maxValue();
+
+		uint32_t id = addLeaf(leaf);
+		addKey(id, f->key());
+		m_Program.emplace_back(OP_Leaf, id);
+	}
+	else if (const KeyValueTagFilter * f = dynamic_cast<const KeyValueTagFilter *>(filter))
+	{
+		if (f->key().empty())
+		{
+			m_Program.emplace_back(OP_Const, 0);
+			return;
+		}
+
+		Leaf leaf;
+		leaf.valueMatch = Leaf::VALUE_Set;
+
+		uint32_t id = addLeaf(leaf);
+		addKey(id, f->key());
+		addValue(id, f->value());
+		m_Program.emplace_back(OP_Leaf, id);
+	}
+	else if (const KeyMultiValueTagFilter * f = dynamic_cast<const KeyMultiValueTagFilter *>(filter))
+	{
+		if (f->key().empty() || f->values().empty())
+		{
+			m_Program.emplace_back(OP_Const, 0);
+			return;
+		}
+
+		Leaf leaf;
+		leaf.valueMatch = Leaf::VALUE_Set;
+
+		uint32_t id = addLeaf(leaf);
+		addKey(id, f->key());
+		for (const std::string & value : f->values())
+			addValue(id, value);
+		m_Program.emplace_back(OP_Leaf, id);
+	}
+	else if (const KeyOnlyTagFilter * f = dynamic_cast<const KeyOnlyTagFilter *>(filter))
+	{
+		if (f->key().empty())
+		{
+			m_Program.emplace_back(OP_Const, 0);
+			return;
+		}
+
+		uint32_t id = addLeaf(Leaf());
+		addKey(id, f->key());
+		m_Program.emplace_back(OP_Leaf, id);
+	}
+	else if (const MultiKeyTagFilter * f = dynamic_cast<const MultiKeyTagFilter *>(filter))
+	{
+		if (f->keys().empty())
+		{
+			m_Program.emplace_back(OP_Const, 0);
+			return;
+		}
+
+		uint32_t id = addLeaf(Leaf());
+		for (const std::string & key : f->keys())
+			addKey(id, key);
+		m_Program.emplace_back(OP_Leaf, id);
+	}
+	else if (const MultiKeyMultiValueTagFilter * f = dynamic_cast<const MultiKeyMultiValueTagFilter *>(filter))
+	{
+		//values are bound to their key, so every key needs its own leaf
+		std::vector<uint32_t> leaves;
+		for (const auto & keyValues : f->valueMap())
+		{
+			if (keyValues.second.empty())
+				continue;
+
+			Leaf leaf;
+			leaf.valueMatch = Leaf::VALUE_Set;
+
+			uint32_t id = addLeaf(leaf);
+			addKey(id, keyValues.first);
+			for (const std::string & value : keyValues.second)
+				addValue(id, value);
+			leaves.push_back(id);
+		}
+
+		if (leaves.empty())
+		{
+			m_Program.emplace_back(OP_Const, 0);
+			return;
+		}
+
+		std::vector<std::size_t> jumps;
+		for (std::size_t i = 0; i < leaves.size(); ++i)
+		{
+			if (i)
+			{
+				jumps.push_back(m_Program.size());
+				m_Program.emplace_back(OP_JumpIfTrue, 0);
+			}
+			m_Program.emplace_back(OP_Leaf, leaves[i]);
+		}
+
+		for (std::size_t jump : jumps)
+			m_Program[jump].arg = (uint32_t) m_Program.size();
+	}
+	else if (const RegexKeyTagFilter * f = dynamic_cast<const RegexKeyTagFilter *>(filter))
+	{
+		Leaf leaf;
+		leaf.keyMatch = Leaf::KEY_Regex;
+		leaf.regex = f->matcher();
+
+		m_Program.emplace_back(OP_Leaf, addLeaf(leaf));
+	}
+	else if (const RegexValueTagFilter * f = dynamic_cast<const RegexValueTagFilter *>(filter))
+	{
+		Leaf leaf;
+		leaf.keyMatch = f->key().empty() ? Leaf::KEY_Any : Leaf::KEY_Set;
+		leaf.valueMatch = Leaf::VALUE_Regex;
+		leaf.regex = f->matcher();
+
+		uint32_t id = addLeaf(leaf);
+		if (!f->key().empty())
+			addKey(id, f->key());
+		m_Program.emplace_back(OP_Leaf, id);
+	}
+	else if (const AbstractLocationFilter * f = dynamic_cast<const AbstractLocationFilter *>(filter))
+	{
+		m_Locations.emplace_back(f->copy());
+		m_Program.emplace_back(OP_Location, (uint32_t) (m_Locations.size() - 1));
+	}
+	else
+	{
+		//no compiled form available, evaluate a private copy of the original filter
+		m_Fallbacks.emplace_back(filter->copy());
+		m_Program.emplace_back(OP_Call, (uint32_t) (m_Fallbacks.size() - 1));
+	}
+}
+
+void CompiledFilterProgram::emitOr(const AbstractMultiTagFilter::FilterList & children, bool isAnd)
+{
+	if (children.empty())
+	{
+		m_Program.emplace_back(OP_Const, isAnd ? 1 : 0);
+		return;
+	}
+
+	std::vector<std::size_t> jumps;
+	for (AbstractMultiTagFilter::FilterList::const_iterator it = children.cbegin(); it != children.cend(); ++it)
+	{
+		if (it != children.cbegin())
+		{
+			jumps.push_back(m_Program.size());
+			m_Program.emplace_back(isAnd ? OP_JumpIfFalse : OP_JumpIfTrue, 0);
+		}
+
+		emit(*it);
+	}
+
+	for (std::size_t jump : jumps)
+		m_Program[jump].arg = (uint32_t) m_Program.size();
+}
+
+uint32_t CompiledFilterProgram::addLeaf(const Leaf & leaf)
+{
+	uint32_t id = (uint32_t) m_Leaves.size();
+	m_Leaves.push_back(leaf);
+
+	if (leaf.keyMatch == Leaf::KEY_Regex)
+		m_RegexKeyLeaves.push_back(id);
+
+	if (leaf.valueMatch == Leaf::VALUE_Int)
+		m_IntValueLeaves.push_back(id);
+
+	if (leaf.valueMatch == Leaf::VALUE_Regex)
+		m_RegexValueLeaves.push_back(id);
+
+	if (leaf.valueMatch == Leaf::VALUE_Numeric)
+		m_NumericValueLeaves.push_back(id);
+
+	return id;
+}
+
+void CompiledFilterProgram::addKey(uint32_t leaf, const std::string & key)
+{
+	m_KeyLeaves[key].push_back(leaf);
+}
+
+void CompiledFilterProgram::addValue(uint32_t leaf, const std::string & value)
+{
+	m_ValueLeaves[value].push_back(leaf);
+}
+
+void CompiledFilterProgram::keyMask(const std::string & str, uint64_t * keyMask) const
+{
+	StringLeafMap::const_iterator it = m_KeyLeaves.find(str);
+	if (it != m_KeyLeaves.cend())
+	{
+		for (uint32_t leaf : it->second)
+			keyMask[leaf >> 6] |= uint64_t(1) << (leaf & 63);
+	}
+
+	for (uint32_t leaf : m_RegexKeyLeaves)
+	{
+		if (m_Leaves[leaf].regex->matches(str))
+			keyMask[leaf >> 6] |= uint64_t(1) << (leaf & 63);
+	}
+
+	for (uint32_t w = 0; w < m_MaskWords; ++w)
+		keyMask[w] |= m_AnyKeyMask[w];
+}
+
+void CompiledFilterProgram::valueMask(const std::string & str, uint64_t * valueMask) const
+{
+	StringLeafMap::const_iterator it = m_ValueLeaves.find(str);
+	if (it != m_ValueLeaves.cend())
+	{
+		for (uint32_t leaf : it->second)
+			valueMask[leaf >> 6] |= uint64_t(1) << (leaf & 63);
+	}
+
+	if (!m_IntValueLeaves.empty() && !str.empty())
+	{
+		char * endptr;
+		long intValue = strtol(str.c_str(), &endptr, 10);
+
+		if (*endptr == '\0')
+		{
+			for (uint32_t leaf : m_IntValueLeaves)
+			{
+				if (m_Leaves[leaf].intValue == intValue)
+					valueMask[leaf >> 6] |= uint64_t(1) << (leaf & 63);
+			}
+		}
+	}
+
+	//every string of the block is parsed once while binding
+	double numericValue;
+	if (!m_NumericValueLeaves.empty() && NumericTagFilter::parseNumber(str, numericValue))
+	{
+		for (uint32_t leaf : m_NumericValueLeaves)
+		{
+			const Leaf & l = m_Leaves[leaf];
+			if (NumericTagFilter::compare(l.comparison, numericValue, l.minValue, l.maxValue))
+				valueMask[leaf >> 6] |= uint64_t(1) << (leaf & 63);
+		}
+	}
+
+	for (uint32_t leaf : m_RegexValueLeaves)
+	{
+		if (m_Leaves[leaf].regex->matches(str))
+			valueMask[leaf >> 6] |= uint64_t(1) << (leaf & 63);
+	}
+
+	for (uint32_t w = 0; w < m_MaskWords; ++w)
+		valueMask[w] |= m_AnyValueMask[w];
+}
+
+// CompiledFilter
+
+CompiledFilter::CompiledFilter() :
+CompiledFilter(RCFilterPtr())
+{}
+
+CompiledFilter::CompiledFilter(const RCFilterPtr & filter) :
+CompiledFilter(CompiledFilterProgramPtr(new CompiledFilterProgram(filter)))
+{}
+
+CompiledFilter::CompiledFilter(const CompiledFilterProgramPtr & program) :
+m_MaskWords(0),
+m_PBI(0),
+m_NodeIndex(0)
+{
+	setProgram(program);
+}
+
+CompiledFilter::CompiledFilter(const CompiledFilter & other) :
+CompiledFilter(other.m_Program)
+{}
+
+CompiledFilter::~CompiledFilter()
+{}
+
+CompiledFilter & CompiledFilter::operator=(const CompiledFilter & other)
+{
+	if (this != &other)
+		setProgram(other.m_Program);
+
+	return *this;
+}
+
+void CompiledFilter::compile(const RCFilterPtr & filter)
+{
+	setProgram(CompiledFilterProgramPtr(new CompiledFilterProgram(filter)));
+}
+
+void CompiledFilter::setProgram(const CompiledFilterProgramPtr & program)
+{
+	m_Program = program;
+	m_MaskWords = m_Program->m_MaskWords;
+
+	//fallback filters have caches and thus must not be shared
+	m_Fallbacks.clear();
+	for (const RCFilterPtr & fallback : m_Program->m_Fallbacks)
+		m_Fallbacks.emplace_back(fallback->copy());
+
+	//bindings are not copied, see AbstractTagFilter::copy()
+	m_PBI = 0;
+	m_pbiId = PrimitiveBlockInputAdaptor::IdType();
+	m_KeyMasks.clear();
+	m_ValueMasks.clear();
+	m_Hits.assign(m_MaskWords, 0);
+	m_Scratch.assign(2 * m_MaskWords, 0);
+}
+
+void CompiledFilter::assignInputAdaptor(const PrimitiveBlockInputAdaptor * pbi)
+{
+	m_PBI = pbi;
+	//same reasoning as in AbstractTagFilterWithCache: the pointer alone does not identify the block
+	m_pbiId = PrimitiveBlockInputAdaptor::IdType();
+
+	for (RCFilterPtr & fallback : m_Fallbacks)
+		fallback->assignInputAdaptor(pbi);
+}
+
+void CompiledFilter::bind()
+{
+	m_KeyMasks.clear();
+	m_ValueMasks.clear();
+
+	if (!m_PBI)
+		return;
+
+	m_pbiId = m_PBI->id();
+
+	if (!m_MaskWords || m_PBI->isNull())
+		return;
+
+	std::size_t stringTableSize = (std::size_t) m_PBI->stringTableSize();
+	m_KeyMasks.assign(stringTableSize * m_MaskWords, 0);
+	m_ValueMasks.assign(stringTableSize * m_MaskWords, 0);
+
+	for (std::size_t id = 0; id < stringTableSize; ++id)
+	{
+		const std::string & str = m_PBI->queryStringTable((int) id);
+		m_Program->keyMask(str, &m_KeyMasks[id * m_MaskWords]);
+		m_Program->valueMask(str, &m_ValueMasks[id * m_MaskWords]);
+	}
+}
+
+bool CompiledFilter::rebuildCache()
+{
+	bind();
+
+	for (RCFilterPtr & fallback : m_Fallbacks)
+		fallback->rebuildCache();
+
+	if (!m_PBI)
+		return true;
+	if (m_PBI->isNull())
+		return false;
+
+	return mayMatch();
+}
+
+bool CompiledFilter::mayMatch()
+{
+	//with an inversion any leaf being absent may lead to a match
+	if (!m_Program->m_Monotone)
+		return true;
+
+	//a leaf may hit if some string satisfies its key and some string satisfies its value
+	MaskVector keyUnion(m_MaskWords, 0), valueUnion(m_MaskWords, 0);
+	for (std::size_t i = 0, s = m_KeyMasks.size(); i < s; ++i)
+	{
+		keyUnion[i % m_MaskWords] |= m_KeyMasks[i];
+		valueUnion[i % m_MaskWords] |= m_ValueMasks[i];
+	}
+
+	int availableTypes = NoPrimitive;
+	if (m_PBI->nodesSize())
+		availableTypes |= NodePrimitive;
+	if (m_PBI->waysSize())
+		availableTypes |= WayPrimitive;
+	if (m_PBI->relationsSize())
+		availableTypes |= RelationPrimitive;
+
+	bool acc = false;
+	for (uint32_t pc = 0, size = (uint32_t) m_Program->m_Program.size(); pc < size;)
+	{
+		const CompiledFilterProgram::Instruction & ins = m_Program->m_Program[pc++];
+		switch (ins.op)
+		{
+		case CompiledFilterProgram::OP_Const:
+			acc = ins.arg;
+			break;
+		case CompiledFilterProgram::OP_Type:
+			acc = availableTypes & ins.arg;
+			break;
+		case CompiledFilterProgram::OP_Leaf:
+			acc = (keyUnion[ins.arg >> 6] & valueUnion[ins.arg >> 6]) >> (ins.arg & 63) & 1;
+			break;
+		case CompiledFilterProgram::OP_Call:
+			//the fallback caches were just rebuilt, this is the cheapest sound answer
+			acc = true;
+			break;
+		case CompiledFilterProgram::OP_Location:
+			acc = availableTypes & NodePrimitive;
+			break;
+		case CompiledFilterProgram::OP_Not:
+			acc = !acc;
+			break;
+		case CompiledFilterProgram::OP_JumpIfFalse:
+			if (!acc)
+				pc = ins.arg;
+			break;
+		case CompiledFilterProgram::OP_JumpIfTrue:
+			if (acc)
+				pc = ins.arg;
+			break;
+		}
+	}
+
+	return acc;
+}
+
+void CompiledFilter::collectHits(const IPrimitive & primitive)
+{
+	clearHits();
+
+	const int tagsSize = primitive.tagsSize();
+
+	if (m_PBI && !m_KeyMasks.empty() && *m_PBI == *primitive.controller())
+	{
+		const std::size_t stringCount = m_KeyMasks.size() / m_MaskWords;
+		for (int i = 0; i < tagsSize; ++i)
+			addHits(primitive.keyId(i), primitive.valueId(i), stringCount);
+		return;
+	}
+
+	//not bound to the primitive's block, compare the strings
+	const uint32_t words = m_MaskWords;
+	uint64_t * tagKeyMask = m_Scratch.data();
+	uint64_t * tagValueMask = tagKeyMask + words;
+	for (int i = 0; i < tagsSize; ++i)
+	{
+		for (uint32_t w = 0; w < 2 * words; ++w)
+			tagKeyMask[w] = 0;
+
+		m_Program->keyMask(primitive.key(i), tagKeyMask);
+		m_Program->valueMask(primitive.value(i), tagValueMask);
+
+		for (uint32_t w = 0; w < words; ++w)
+			m_Hits[w] |= tagKeyMask[w] & tagValueMask[w];
+	}
+}
+
+bool CompiledFilter::execute(PrimitiveType type, const IPrimitive * primitive)
+{
+	const CompiledFilterProgram::Instruction * program = m_Program->m_Program.data();
+	const uint32_t size = (uint32_t) m_Program->m_Program.size();
+
+	bool acc = false;
+	bool hitsValid = !primitive;
+
+	for (uint32_t pc = 0; pc < size;)
+	{
+		const CompiledFilterProgram::Instruction & ins = program[pc++];
+		switch (ins.op)
+		{
+		case CompiledFilterProgram::OP_Const:
+			acc = ins.arg;
+			break;
+		case CompiledFilterProgram::OP_Type:
+			acc = type & ins.arg;
+			break;
+		case CompiledFilterProgram::OP_Leaf:
+			if (!hitsValid)
+			{
+				collectHits(*primitive);
+				hitsValid = true;
+			}
+			acc = (m_Hits[ins.arg >> 6] >> (ins.arg & 63)) & 1;
+			break;
+		case CompiledFilterProgram::OP_Call:
+			acc = m_Fallbacks[ins.arg]->matches(*primitive);
+			break;
+		case CompiledFilterProgram::OP_Location:
+			if (type != NodePrimitive)
+				acc = false;
+			else if (primitive)
+				acc = m_Program->location(ins.arg)->contains(INode(*primitive));
+			else
+				acc = m_LocationSelections[ins.arg][m_NodeIndex];
+			break;
+		case CompiledFilterProgram::OP_Not:
+			acc = !acc;
+			break;
+		case CompiledFilterProgram::OP_JumpIfFalse:
+			if (!acc)
+				pc = ins.arg;
+			break;
+		case CompiledFilterProgram::OP_JumpIfTrue:
+			if (acc)
+				pc = ins.arg;
+			break;
+		}
+	}
+
+	return acc;
+}
+
+bool CompiledFilter::matches(const IPrimitive & primitive)
+{
+	if (m_PBI && m_PBI->id() != m_pbiId)
+		bind();
+
+	return execute(primitive.type(), &primitive);
+}
+
+BlockSelection CompiledFilter::evaluateBlock(PrimitiveBlockInputAdaptor & pbi, PrimitiveType type)
+{
+	BlockSelection selection;
+
+	if (m_PBI != &pbi)
+		assignInputAdaptor(&pbi);
+
+	if (pbi.isNull())
+		return selection;
+
+	//fallback filters need real primitives
+	if (!m_Fallbacks.empty())
+	{
+		switch (type)
+		{
+		case NodePrimitive:
+			selection.reserve(pbi.nodesSize());
+			for (INodeStream node(pbi.getNodeStream()); !node.isNull(); node.next())
+				selection.push_back(matches(node));
+			break;
+		case WayPrimitive:
+			selection.reserve(pbi.waysSize());
+			for (IWayStream way(pbi.getWayStream()); !way.isNull(); way.next())
+				selection.push_back(matches(way));
+			break;
+		case RelationPrimitive:
+			selection.reserve(pbi.relationsSize());
+			for (IRelationStream relation(pbi.getRelationStream()); !relation.isNull(); relation.next())
+				selection.push_back(matches(relation));
+			break;
+		default:
+			break;
+		}
+		return selection;
+	}
+
+	if (pbi.id() != m_pbiId)
+		bind();
+
+	const std::size_t stringCount = m_MaskWords ? m_KeyMasks.size() / m_MaskWords : 0;
+
+	//location filters decide every node on its own, test all coordinates in one go
+	const bool perNode = type == NodePrimitive && !m_Program->m_Locations.empty();
+	if (perNode)
+	{
+		m_LocationSelections.resize(m_Program->m_Locations.size());
+		for (std::size_t i = 0; i < m_LocationSelections.size(); ++i)
+		{
+			m_LocationSelections[i].clear();
+			m_Program->location((uint32_t) i)->evaluateNodes(pbi, m_LocationSelections[i]);
+		}
+	}
+
+	//result for primitives without any relevant tag
+	clearHits();
+	const bool untaggedResult = perNode ? false : execute(type, NULL);
+
+	switch (type)
+	{
+	case NodePrimitive:
+		selection.reserve(pbi.nodesSize());
+
+		for (crosby::binary::PrimitiveGroup * group : pbi.m_PlainNodesGroups)
+		{
+			for (const crosby::binary::Node & node : group->nodes())
+			{
+				clearHits();
+				for (int i = 0, s = node.keys_size(); i < s; ++i)
+					addHits(node.keys(i), node.vals(i), stringCount);
+				m_NodeIndex = selection.size();
+				selection.push_back((perNode || hasHits()) ? execute(type, NULL) : untaggedResult);
+			}
+		}
+
+		for (DenseNodesData & data : pbi.m_DenseNodesGroups)
+		{
+			const crosby::binary::DenseNodes & dense = data.group()->dense();
+			const int nodesSize = dense.id_size();
+			const int keysValsSize = dense.keys_vals_size();
+
+			//keys_vals is empty if no node in this group has tags
+			if (!keysValsSize || !stringCount)
+			{
+				if (!perNode)
+				{
+					selection.insert(selection.end(), nodesSize, untaggedResult);
+					continue;
+				}
+
+				clearHits();
+				for (int n = 0; n < nodesSize; ++n)
+				{
+					m_NodeIndex = selection.size();
+					selection.push_back(execute(type, NULL));
+				}
+				continue;
+			}
+
+			//keys_vals holds key, value pairs for each node delimited by 0
+			const int32_t * keysVals = dense.keys_vals().data();
+			int pos = 0;
+			for (int n = 0; n < nodesSize; ++n)
+			{
+				clearHits();
+				while (pos < keysValsSize && keysVals[pos])
+				{
+					if (pos + 1 < keysValsSize)
+						addHits((uint32_t) keysVals[pos], (uint32_t) keysVals[pos + 1], stringCount);
+					pos += 2;
+				}
+				++pos;
+
+				m_NodeIndex = selection.size();
+				selection.push_back((perNode || hasHits()) ? execute(type, NULL) : untaggedResult);
+			}
+		}
+		break;
+	case WayPrimitive:
+		selection.reserve(pbi.waysSize());
+
+		for (crosby::binary::PrimitiveGroup * group : pbi.m_WaysGroups)
+		{
+			for (const crosby::binary::Way & way : group->ways())
+			{
+				clearHits();
+				for (int i = 0, s = way.keys_size(); i < s; ++i)
+					addHits(way.keys(i), way.vals(i), stringCount);
+				selection.push_back(hasHits() ? execute(type, NULL) : untaggedResult);
+			}
+		}
+		break;
+	case RelationPrimitive:
+		selection.reserve(pbi.relationsSize());
+
+		for (crosby::binary::PrimitiveGroup * group : pbi.m_RelationsGroups)
+		{
+			for (const crosby::binary::Relation & relation : group->relations())
+			{
+				clearHits();
+				for (int i = 0, s = relation.keys_size(); i < s; ++i)
+					addHits(relation.keys(i), relation.vals(i), stringCount);
+				selection.push_back(hasHits() ? execute(type, NULL) : untaggedResult);
+			}
+		}
+		break;
+	default:
+		break;
+	}
+
+	return selection;
+}
+
+} // namespace osmpbf
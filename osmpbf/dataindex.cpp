@@ -32,7 +32,7 @@ namespace osmpbf
 
 // DenseNodesData
 
-DenseNodesData::DenseNodesData(const DenseNodesData & other) : m_Group(other.m_Group), m_KeyValIndex(other.m_KeyValIndex) {}
+DenseNodesData::DenseNodesData(const DenseNodesData & other) : m_Group(other.m_Group), m_KeyValIndex(other.m_KeyValIndex), m_DataUnpacked(other.m_DataUnpacked) {}
 
 DenseNodesData::DenseNodesData(crosby::binary::PrimitiveGroup * denseNodesGroup, bool unpack)
 	: m_Group(denseNodesGroup)
@@ -45,6 +45,7 @@ DenseNodesData & DenseNodesData::operator=(const DenseNodesData & other)
 {
 	m_Group = other.m_Group;
 	m_KeyValIndex = other.m_KeyValIndex;
+	m_DataUnpacked = other.m_DataUnpacked;
 
 	return *this;
 }
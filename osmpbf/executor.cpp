@@ -0,0 +1,297 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#include <osmpbf/executor.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace osmpbf
+{
+
+namespace
+{
+	//worker index of the current thread, only valid if tls_Executor matches
+	thread_local const Executor * tls_Executor = NULL;
+	thread_local int tls_Worker = -1;
+
+	///cpus the process may run on, interleaved by socket: cpu 0 of socket 0, cpu 0 of socket 1, cpu 1 of socket 0, ...
+	std::vector<int> pinningOrder()
+	{
+		std::vector<int> result;
+#if defined(__linux__)
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		if (sched_getaffinity(0, sizeof(allowed), &allowed))
+			return result;
+
+		std::map< int, std::vector<int> > packages;
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+		{
+			if (!CPU_ISSET(cpu, &allowed))
+				continue;
+
+			int package = 0;
+			std::ifstream topology("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/physical_package_id");
+			if (!(topology >> package))
+				package = 0;
+			packages[package].push_back(cpu);
+		}
+
+		for (std::size_t i = 0; result.size() < (std::size_t) CPU_COUNT(&allowed); ++i)
+		{
+			for (const auto & package : packages)
+			{
+				if (i < package.second.size())
+					result.push_back(package.second[i]);
+			}
+		}
+#endif
+		return result;
+	}
+
+	bool pinCurrentThread(int cpu)
+	{
+#if defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+		(void) cpu;
+		return false;
+#endif
+	}
+}
+
+Executor::Executor(uint32_t threadCount, bool pinWorkers) :
+m_Queued(0),
+m_Stop(false)
+{
+	if (!threadCount)
+		threadCount = std::max<int>(std::thread::hardware_concurrency(), 1);
+
+	for (uint32_t i = 0; i <= threadCount; ++i)
+		m_Queues.emplace_back(new TaskQueue());
+
+	if (pinWorkers)
+	{
+		std::vector<int> cpus = pinningOrder();
+		for (uint32_t i = 0; i < threadCount && !cpus.empty(); ++i)
+			m_WorkerCpus.push_back(cpus[i % cpus.size()]);
+	}
+
+	m_Threads.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; ++i)
+		m_Threads.emplace_back(&Executor::work, this, i);
+}
+
+Executor::~Executor()
+{
+	{
+		std::lock_guard<std::mutex> lck(m_SleepLock);
+		m_Stop = true;
+	}
+	m_WakeUp.notify_all();
+
+	for (std::thread & thread : m_Threads)
+		thread.join();
+}
+
+void Executor::submit(Task task)
+{
+	submit(std::move(task), NULL);
+}
+
+void Executor::submit(Task task, const TaskGroup * group)
+{
+	int worker = currentWorker();
+	TaskQueue & queue = *m_Queues[worker < 0 ? m_Threads.size() : (std::size_t) worker];
+
+	//counted before the task can be popped, the counter never drops below the number of queued tasks
+	{
+		std::lock_guard<std::mutex> lck(queue.lock);
+		++m_Queued;
+		queue.tasks.push_back(QueuedTask{std::move(task), group});
+	}
+
+	//a worker about to sleep checks m_Queued under the sleep lock, so it either saw the task or is waiting
+	{
+		std::lock_guard<std::mutex> lck(m_SleepLock);
+	}
+	m_WakeUp.notify_one();
+}
+
+bool Executor::runPendingTask()
+{
+	return runGroupTask(NULL);
+}
+
+bool Executor::runGroupTask(const TaskGroup * group)
+{
+	Task task;
+	if (!popTask(currentWorker(), task, group))
+		return false;
+
+	task();
+	return true;
+}
+
+int Executor::currentWorker() const
+{
+	return tls_Executor == this ? tls_Worker : -1;
+}
+
+Executor & Executor::defaultExecutor()
+{
+	static Executor executor;
+	return executor;
+}
+
+bool Executor::popTask(int worker, Task & task, const TaskGroup * group)
+{
+	std::size_t queueCount = m_Queues.size();
+
+	//own tasks first, newest first as their data is likely still in the cache
+	if (worker >= 0)
+	{
+		TaskQueue & queue = *m_Queues[worker];
+		std::lock_guard<std::mutex> lck(queue.lock);
+		for (std::deque<QueuedTask>::reverse_iterator it = queue.tasks.rbegin(); it != queue.tasks.rend(); ++it)
+		{
+			if (group && it->group != group)
+				continue;
+
+			task = std::move(it->task);
+			queue.tasks.erase(std::next(it).base());
+			--m_Queued;
+			return true;
+		}
+	}
+
+	//then external submissions and the oldest tasks of the other workers
+	std::size_t workerCount = queueCount - 1;
+	std::size_t start = worker >= 0 ? (std::size_t) worker + 1 : 0;
+	for (std::size_t i = 0; i < queueCount; ++i)
+	{
+		std::size_t victim = i ? (start + i - 1) % workerCount : workerCount;
+		if ((int) victim == worker)
+			continue;
+
+		TaskQueue & queue = *m_Queues[victim];
+		std::lock_guard<std::mutex> lck(queue.lock);
+		for (std::deque<QueuedTask>::iterator it = queue.tasks.begin(); it != queue.tasks.end(); ++it)
+		{
+			if (group && it->group != group)
+				continue;
+
+			task = std::move(it->task);
+			queue.tasks.erase(it);
+			--m_Queued;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Executor::work(uint32_t index)
+{
+	tls_Executor = this;
+	tls_Worker = (int) index;
+
+	//pin before anything is allocated on this thread
+	if (!m_WorkerCpus.empty() && !pinCurrentThread(m_WorkerCpus[index]))
+		std::cerr << "ERROR: could not pin worker " << index << " to cpu " << m_WorkerCpus[index] << std::endl;
+
+	Task task;
+	while (true)
+	{
+		if (popTask((int) index, task, NULL))
+		{
+			task();
+			task = Task();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lck(m_SleepLock);
+		if (m_Stop && !m_Queued)
+			break;
+
+		m_WakeUp.wait(lck, [this]() { return m_Queued > 0 || m_Stop; });
+	}
+
+	tls_Executor = NULL;
+	tls_Worker = -1;
+}
+
+// TaskGroup
+
+TaskGroup::TaskGroup(Executor & executor) :
+m_Executor(executor),
+m_Pending(0)
+{}
+
+TaskGroup::~TaskGroup()
+{
+	wait();
+}
+
+void TaskGroup::run(Executor::Task task)
+{
+	++m_Pending;
+
+	m_Executor.submit([this, task]()
+	{
+		task();
+
+		//the group may be destroyed as soon as the waiter sees the last decrement
+		std::lock_guard<std::mutex> lck(m_Lock);
+		if (--m_Pending == 0)
+			m_Done.notify_all();
+	}, this);
+}
+
+void TaskGroup::wait()
+{
+	while (m_Pending)
+	{
+		//help with own tasks instead of blocking, this keeps nested groups from starving the pool
+		if (m_Executor.runGroupTask(this))
+			continue;
+
+		//the remaining tasks are running, recheck from time to time for newly queued work
+		std::unique_lock<std::mutex> lck(m_Lock);
+		m_Done.wait_for(lck, std::chrono::milliseconds(1), [this]() { return m_Pending == 0; });
+	}
+
+	//wait for the last task to leave its critical section
+	std::lock_guard<std::mutex> lck(m_Lock);
+}
+
+} // namespace osmpbf
@@ -0,0 +1,487 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#include <osmpbf/extractor.h>
+
+#include <osmpbf/blobfile.h>
+#include <osmpbf/executor.h>
+#include <osmpbf/primitiveblockinputadaptor.h>
+#include <osmpbf/primitiveblockoutputadaptor.h>
+#include <osmpbf/inode.h>
+#include <osmpbf/iway.h>
+#include <osmpbf/irelation.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace osmpbf
+{
+
+Extractor::Extractor(const std::string & inputFileName) :
+m_InputFileName(inputFileName),
+m_Executor(NULL),
+m_ThreadCount(0),
+m_VerboseOutput(false),
+m_CopiedBlobs(0),
+m_EncodedBlobs(0),
+m_DroppedBlobs(0)
+{}
+
+Extractor::~Extractor() {}
+
+bool Extractor::run(const std::string & outputFileName)
+{
+	if (!m_Filter)
+	{
+		std::cerr << "ERROR: Extractor: no filter set" << std::endl;
+		return false;
+	}
+
+	if (!m_ThreadCount)
+		m_ThreadCount = m_Executor ? m_Executor->threadCount() : std::max<int>(std::thread::hardware_concurrency(), 1);
+
+	m_Nodes.clear();
+	m_Ways.clear();
+	m_Relations.clear();
+	m_SubRelations.clear();
+
+	//the raw blob references stay valid as long as inFile is open
+	BlobFileIn inFile(m_InputFileName);
+	inFile.setVerboseOutput(m_VerboseOutput);
+
+	if (!inFile.open() || !scan(inFile))
+		return false;
+
+	//an incomplete selection would not be referentially complete
+	if (!selectMatching())
+		return false;
+	closeRelations();
+	if (!selectRelationMembers() || !selectWayRefs())
+		return false;
+
+	if (m_VerboseOutput)
+		std::cout << "Extractor: selected " << m_Nodes.size() << " nodes, " << m_Ways.size() << " ways, " << m_Relations.size() << " relations" << std::endl;
+
+	bool result = write(outputFileName);
+
+	inFile.close();
+	return result;
+}
+
+bool Extractor::scan(BlobFileIn & inFile)
+{
+	m_Blobs.clear();
+	m_HeaderBlob = RawBlobRef();
+
+	BlobInfo blob;
+	while (inFile.readRawBlob(blob.raw))
+	{
+		if (blob.raw.type == BLOB_OSMData)
+			m_Blobs.push_back(blob);
+		else if (blob.raw.type == BLOB_OSMHeader && m_HeaderBlob.type == BLOB_Invalid)
+			m_HeaderBlob = blob.raw;
+	}
+
+	//readRawBlob() fails on invalid blob headers as well as at the end of the file
+	if (inFile.position() < inFile.size())
+	{
+		std::cerr << "ERROR: Extractor: invalid blob at offset " << inFile.position() << " in " << m_InputFileName << std::endl;
+		return false;
+	}
+
+	if (m_HeaderBlob.type == BLOB_Invalid)
+	{
+		std::cerr << "ERROR: Extractor: no header blob found in " << m_InputFileName << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool Extractor::forEachBlob(const std::function<bool(const BlobInfo &)> & predicate, const BlobProcessor & processor,
+	const BlobSkipHandler & skipped)
+{
+	std::atomic<std::size_t> next(0);
+	std::atomic<bool> failed(false);
+
+	auto worker = [&](uint32_t threadIndex)
+	{
+		//every thread maps the file on its own, so it can seek freely
+		BlobFileIn inFile(m_InputFileName);
+		if (!inFile.open())
+		{
+			failed = true;
+			return;
+		}
+
+		BlobDataBuffer buffer;
+		PrimitiveBlockInputAdaptor pbi;
+
+		for (std::size_t i = next++; i < m_Blobs.size() && !failed; i = next++)
+		{
+			if (!predicate(m_Blobs[i]))
+			{
+				if (skipped)
+					skipped(i, false);
+				continue;
+			}
+
+			inFile.seek(m_Blobs[i].raw.offset);
+			inFile.readBlob(buffer);
+			if (buffer.type != BLOB_OSMData)
+			{
+				failed = true;
+				if (skipped)
+					skipped(i, true);
+				break;
+			}
+
+			pbi.parseData(buffer.data, buffer.availableBytes);
+			if (!pbi.isNull())
+				processor(i, pbi, threadIndex);
+			else if (skipped)
+				skipped(i, false);
+		}
+
+		inFile.close();
+	};
+
+	if (m_Executor)
+	{
+		TaskGroup group(*m_Executor);
+		for (uint32_t t = 0; t < m_ThreadCount; ++t)
+			group.run([&worker, t]() { worker(t); });
+		group.wait();
+	}
+	else
+	{
+		std::vector<std::thread> threads;
+		for (uint32_t t = 1; t < m_ThreadCount; ++t)
+			threads.emplace_back(worker, t);
+
+		worker(0);
+
+		for (std::thread & thread : threads)
+			thread.join();
+	}
+
+	if (failed)
+		std::cerr << "ERROR: Extractor: failed to read " << m_InputFileName << std::endl;
+
+	return !failed;
+}
+
+bool Extractor::selectMatching()
+{
+	CompiledFilterProgramPtr program = std::make_shared<const CompiledFilterProgram>(m_Filter);
+
+	std::vector<CompiledFilter> filters(m_ThreadCount, CompiledFilter(program));
+	std::vector<IdBitSet> nodes(m_ThreadCount), ways(m_ThreadCount), relations(m_ThreadCount);
+	std::vector< std::vector< std::pair<int64_t, int64_t> > > subRelations(m_ThreadCount);
+
+	bool result = forEachBlob([](const BlobInfo &) { return true; },
+		[&](std::size_t index, PrimitiveBlockInputAdaptor & pbi, uint32_t t)
+		{
+			m_Blobs[index].hasWays = pbi.waysSize() > 0;
+			m_Blobs[index].hasRelations = pbi.relationsSize() > 0;
+
+			std::size_t i;
+
+			if (pbi.nodesSize())
+			{
+				BlockSelection selection = filters[t].evaluateBlock(pbi, NodePrimitive);
+				i = 0;
+				for (INodeStream node = pbi.getNodeStream(); !node.isNull(); node.next(), ++i)
+					if (selection[i])
+						nodes[t].insert(node.id());
+			}
+
+			if (pbi.waysSize())
+			{
+				BlockSelection selection = filters[t].evaluateBlock(pbi, WayPrimitive);
+				i = 0;
+				for (IWayStream way = pbi.getWayStream(); !way.isNull(); way.next(), ++i)
+					if (selection[i])
+						ways[t].insert(way.id());
+			}
+
+			if (pbi.relationsSize())
+			{
+				BlockSelection selection = filters[t].evaluateBlock(pbi, RelationPrimitive);
+				i = 0;
+				for (IRelationStream relation = pbi.getRelationStream(); !relation.isNull(); relation.next(), ++i)
+				{
+					if (selection[i])
+						relations[t].insert(relation.id());
+
+					for (IMemberStream member = relation.getMemberStream(); !member.isNull(); member.next())
+						if (member.type() == RelationPrimitive)
+							subRelations[t].emplace_back(relation.id(), member.id());
+				}
+			}
+		});
+
+	for (uint32_t t = 0; t < m_ThreadCount; ++t)
+	{
+		m_Nodes.merge(nodes[t]);
+		m_Ways.merge(ways[t]);
+		m_Relations.merge(relations[t]);
+		m_SubRelations.insert(m_SubRelations.end(), subRelations[t].begin(), subRelations[t].end());
+	}
+
+	return result;
+}
+
+void Extractor::closeRelations()
+{
+	//relation hierarchies are shallow, iterate until no sub relation is added
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (const std::pair<int64_t, int64_t> & edge : m_SubRelations)
+			if (m_Relations.count(edge.first) && m_Relations.insert(edge.second))
+				changed = true;
+	}
+
+	m_SubRelations.clear();
+	m_SubRelations.shrink_to_fit();
+}
+
+bool Extractor::selectRelationMembers()
+{
+	if (m_Relations.empty())
+		return true;
+
+	std::vector<IdBitSet> nodes(m_ThreadCount), ways(m_ThreadCount);
+
+	bool result = forEachBlob([](const BlobInfo & blob) { return blob.hasRelations; },
+		[&](std::size_t, PrimitiveBlockInputAdaptor & pbi, uint32_t t)
+		{
+			for (IRelationStream relation = pbi.getRelationStream(); !relation.isNull(); relation.next())
+			{
+				if (!m_Relations.count(relation.id()))
+					continue;
+
+				for (IMemberStream member = relation.getMemberStream(); !member.isNull(); member.next())
+				{
+					if (member.type() == NodePrimitive)
+						nodes[t].insert(member.id());
+					else if (member.type() == WayPrimitive)
+						ways[t].insert(member.id());
+				}
+			}
+		});
+
+	for (uint32_t t = 0; t < m_ThreadCount; ++t)
+	{
+		m_Nodes.merge(nodes[t]);
+		m_Ways.merge(ways[t]);
+	}
+
+	return result;
+}
+
+bool Extractor::selectWayRefs()
+{
+	if (m_Ways.empty())
+		return true;
+
+	std::vector<IdBitSet> nodes(m_ThreadCount);
+
+	bool result = forEachBlob([](const BlobInfo & blob) { return blob.hasWays; },
+		[&](std::size_t, PrimitiveBlockInputAdaptor & pbi, uint32_t t)
+		{
+			for (IWayStream way = pbi.getWayStream(); !way.isNull(); way.next())
+			{
+				if (!m_Ways.count(way.id()))
+					continue;
+
+				for (generics::DeltaFieldConstForwardIterator<int64_t> it = way.refBegin(); it != way.refEnd(); ++it)
+					nodes[t].insert(*it);
+			}
+		});
+
+	for (uint32_t t = 0; t < m_ThreadCount; ++t)
+		m_Nodes.merge(nodes[t]);
+
+	return result;
+}
+
+bool Extractor::write(const std::string & outputFileName)
+{
+	enum Action {ACTION_Pending, ACTION_Failed, ACTION_Drop, ACTION_Copy, ACTION_Encode};
+
+	struct Result {
+		Action action;
+		std::string data;
+		Result() : action(ACTION_Pending) {}
+	};
+
+	m_CopiedBlobs = m_EncodedBlobs = m_DroppedBlobs = 0;
+
+	BlobFileOut outFile(outputFileName);
+	outFile.setVerboseOutput(m_VerboseOutput);
+
+	if (!outFile.open())
+		return false;
+
+	outFile.writeRawBlob(m_HeaderBlob);
+
+	//blobs are encoded in parallel and written in input order,
+	//workers stay at most window blobs ahead of the writer
+	const std::size_t window = 4 * m_ThreadCount;
+	std::vector<Result> results(m_Blobs.size());
+	std::size_t written = 0;
+	bool done = false;
+	//set by the writer when it stops, waiting workers give up
+	bool aborted = false;
+	std::mutex lock;
+	std::condition_variable resultReady, blobWritten;
+
+	auto encode = [&](std::size_t index, PrimitiveBlockInputAdaptor & pbi, uint32_t)
+	{
+		{
+			std::unique_lock<std::mutex> lck(lock);
+			blobWritten.wait(lck, [&]() { return index < written + window || aborted; });
+			if (aborted)
+				return;
+		}
+
+		int keptNodes = 0, keptWays = 0, keptRelations = 0;
+
+		for (INodeStream node = pbi.getNodeStream(); !node.isNull(); node.next())
+			keptNodes += m_Nodes.count(node.id());
+		for (IWayStream way = pbi.getWayStream(); !way.isNull(); way.next())
+			keptWays += m_Ways.count(way.id());
+		for (IRelationStream relation = pbi.getRelationStream(); !relation.isNull(); relation.next())
+			keptRelations += m_Relations.count(relation.id());
+
+		Result result;
+
+		if (!keptNodes && !keptWays && !keptRelations)
+		{
+			result.action = ACTION_Drop;
+		}
+		else if (keptNodes == pbi.nodesSize() && keptWays == pbi.waysSize() && keptRelations == pbi.relationsSize())
+		{
+			result.action = ACTION_Copy;
+		}
+		else
+		{
+			PrimitiveBlockOutputAdaptor pbo;
+			pbo.setGranularity(pbi.granularity());
+			pbo.setLatOffset(pbi.latOffset());
+			pbo.setLonOffset(pbi.lonOffset());
+
+			for (INodeStream node = pbi.getNodeStream(); !node.isNull(); node.next())
+				if (m_Nodes.count(node.id()))
+					pbo << node;
+			for (IWayStream way = pbi.getWayStream(); !way.isNull(); way.next())
+				if (m_Ways.count(way.id()))
+					pbo << way;
+			for (IRelationStream relation = pbi.getRelationStream(); !relation.isNull(); relation.next())
+				if (m_Relations.count(relation.id()))
+					pbo << relation;
+
+			pbo.flush(result.data);
+			result.action = ACTION_Encode;
+		}
+
+		std::lock_guard<std::mutex> lck(lock);
+		results[index] = std::move(result);
+		resultReady.notify_all();
+	};
+
+	//every blob gets a result, otherwise the writer would wait for it forever
+	auto skip = [&](std::size_t index, bool failed)
+	{
+		std::lock_guard<std::mutex> lck(lock);
+		results[index].action = failed ? ACTION_Failed : ACTION_Drop;
+		resultReady.notify_all();
+	};
+
+	bool readOk = true;
+	std::thread producer([&]()
+	{
+		readOk = forEachBlob([](const BlobInfo &) { return true; }, encode, skip);
+
+		std::lock_guard<std::mutex> lck(lock);
+		done = true;
+		resultReady.notify_all();
+	});
+
+	bool writeOk = true;
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		Result result;
+		{
+			std::unique_lock<std::mutex> lck(lock);
+			resultReady.wait(lck, [&]() { return results[i].action != ACTION_Pending || done; });
+
+			if (results[i].action == ACTION_Pending || results[i].action == ACTION_Failed)
+				break;
+
+			result = std::move(results[i]);
+		}
+
+		if (writeOk)
+		{
+			switch (result.action)
+			{
+			case ACTION_Copy:
+				writeOk = outFile.writeRawBlob(m_Blobs[i].raw);
+				++m_CopiedBlobs;
+				break;
+			case ACTION_Encode:
+				writeOk = outFile.writeBlob(BLOB_OSMData, result.data.data(), result.data.size(), true);
+				++m_EncodedBlobs;
+				break;
+			default:
+				++m_DroppedBlobs;
+				break;
+			}
+		}
+
+		std::lock_guard<std::mutex> lck(lock);
+		written = i + 1;
+		blobWritten.notify_all();
+	}
+
+	{
+		std::lock_guard<std::mutex> lck(lock);
+		aborted = true;
+		blobWritten.notify_all();
+	}
+
+	producer.join();
+	outFile.close();
+
+	if (m_VerboseOutput)
+		std::cout << "Extractor: blobs copied: " << m_CopiedBlobs << ", re-encoded: " << m_EncodedBlobs << ", dropped: " << m_DroppedBlobs << std::endl;
+
+	return readOk && writeOk;
+}
+
+} // namespace osmpbf
@@ -100,6 +100,10 @@ SignedSizeType lseek(int fd, OffsetType offset, int whence) {
 	return ::lseek(fd, offset, common::__seek_flags_from_my_seek_flags(whence));
 }
 
+SignedSizeType read(int fd, void * buffer, SizeType count) {
+	return ::read(fd, buffer, count);
+}
+
 SignedSizeType write(int fd, const void * buffer, SizeType count) {
 	return ::write(fd, buffer, count);
 }
@@ -132,6 +136,10 @@ SignedSizeType lseek(int fd, OffsetType offset, int whence) {
 	return _lseek(fd, offset, common::__seek_flags_from_my_seek_flags(whence));
 }
 
+SignedSizeType read(int fd, void * buffer, SizeType count) {
+	return _read(fd, buffer, count);
+}
+
 SignedSizeType write(int fd, const void * buffer, SizeType count) {
 	return _write(fd, buffer, count);
 }
@@ -166,6 +174,10 @@ SignedSizeType lseek(int fd, OffsetType offset, int whence) {
 	return MY_NAME_SPACE::lseek(fd, offset, whence);
 }
 
+SignedSizeType read(int fd, void * buffer, SizeType count) {
+	return MY_NAME_SPACE::read(fd, buffer, count);
+}
+
 SignedSizeType write(int fd, const void * buffer, SizeType count) {
 	return MY_NAME_SPACE::write(fd, buffer, count);
 }
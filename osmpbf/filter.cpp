@@ -22,18 +22,33 @@
 
 #include <osmpbf/primitiveblockinputadaptor.h>
 #include <osmpbf/iprimitive.h>
+#include <osmpbf/inode.h>
+#include <osmpbf/iway.h>
 #include <osmpbf/irelation.h>
 
+#include "osmformat.pb.h"
+
+#include <cctype>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <initializer_list>
 #include <array>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
 
 namespace osmpbf
 {
 
 AbstractTagFilter::AbstractTagFilter() :
 generics::RefCountObject()
+#ifdef OSMPBF_FILTER_PROFILING
+, m_Profile(std::make_shared<ProfileCounters>())
+#endif
 {}
 
 AbstractTagFilter::~AbstractTagFilter()
@@ -45,18 +60,197 @@ void AbstractTagFilter::assignInputAdaptor(const PrimitiveBlockInputAdaptor *)
 
 bool AbstractTagFilter::rebuildCache()
 {
+	profileRebuild();
 	return true;
 }
 
 bool AbstractTagFilter::matches(const IPrimitive & primitive)
 {
+#ifdef OSMPBF_FILTER_PROFILING
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool result = p_matches(primitive);
+	uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+	m_Profile->calls.fetch_add(1, std::memory_order_relaxed);
+	m_Profile->hits.fetch_add(result ? 1 : 0, std::memory_order_relaxed);
+	m_Profile->nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+	return result;
+#else
 	return p_matches(primitive);
+#endif
+}
+
+bool AbstractTagFilter::profilingEnabled()
+{
+#ifdef OSMPBF_FILTER_PROFILING
+	return true;
+#else
+	return false;
+#endif
+}
+
+FilterProfile AbstractTagFilter::profile() const
+{
+	FilterProfile result;
+#ifdef OSMPBF_FILTER_PROFILING
+	result.calls = m_Profile->calls.load(std::memory_order_relaxed);
+	result.hits = m_Profile->hits.load(std::memory_order_relaxed);
+	result.rebuilds = m_Profile->rebuilds.load(std::memory_order_relaxed);
+	result.nanoseconds = m_Profile->nanoseconds.load(std::memory_order_relaxed);
+#endif
+	return result;
+}
+
+void AbstractTagFilter::resetProfile()
+{
+#ifdef OSMPBF_FILTER_PROFILING
+	m_Profile->calls = 0;
+	m_Profile->hits = 0;
+	m_Profile->rebuilds = 0;
+	m_Profile->nanoseconds = 0;
+#endif
+}
+
+namespace
+{
+
+std::string describeFilter(const AbstractTagFilter * filter)
+{
+	std::ostringstream out;
+
+	if (const ConstantReturnFilter * f = dynamic_cast<const ConstantReturnFilter *>(filter))
+		out << "Constant " << (f->value() ? "true" : "false");
+	else if (const PrimitiveTypeFilter * f = dynamic_cast<const PrimitiveTypeFilter *>(filter))
+		out << "PrimitiveType " << (int) f->filteredTypes();
+	else if (dynamic_cast<const InversionFilter *>(filter))
+		out << "Not";
+	else if (dynamic_cast<const AndTagFilter *>(filter))
+		out << "And";
+	else if (dynamic_cast<const OrTagFilter *>(filter))
+		out << "Or";
+	else if (const NumericTagFilter * f = dynamic_cast<const NumericTagFilter *>(filter))
+		out << "Numeric " << f->key() << " (" << f->minValue() << ", " << f->maxValue() << ")";
+	else if (const IntTagFilter * f = dynamic_cast<const IntTagFilter *>(filter))
+		out << "Int " << f->key() << " = " << f->value();
+	else if (const BoolTagFilter * f = dynamic_cast<const BoolTagFilter *>(filter))
+		out << "Bool " << f->key() << " = " << (f->value() ? "true" : "false");
+	else if (const KeyValueTagFilter * f = dynamic_cast<const KeyValueTagFilter *>(filter))
+		out << "KeyValue " << f->key() << " = " << f->value();
+	else if (const KeyMultiValueTagFilter * f = dynamic_cast<const KeyMultiValueTagFilter *>(filter))
+		out << "KeyMultiValue " << f->key();
+	else if (const KeyOnlyTagFilter * f = dynamic_cast<const KeyOnlyTagFilter *>(filter))
+		out << "KeyOnly " << f->key();
+	else if (dynamic_cast<const MultiKeyTagFilter *>(filter))
+		out << "MultiKey";
+	else if (dynamic_cast<const MultiKeyMultiValueTagFilter *>(filter))
+		out << "MultiKeyMultiValue";
+	else if (dynamic_cast<const RegexKeyTagFilter *>(filter))
+		out << "RegexKey";
+	else if (const RegexValueTagFilter * f = dynamic_cast<const RegexValueTagFilter *>(filter))
+		out << "RegexValue " << (f->key().empty() ? "*" : f->key());
+	else if (dynamic_cast<const BBoxNodeFilter *>(filter))
+		out << "BBoxNode";
+	else if (dynamic_cast<const PolygonNodeFilter *>(filter))
+		out << "PolygonNode";
+	else
+		out << "Filter";
+
+	return out.str();
+}
+
+void dumpProfileNode(std::ostream & out, const AbstractTagFilter * filter, int depth, std::unordered_set<const AbstractTagFilter *> & visited)
+{
+	std::vector<const AbstractTagFilter *> children;
+	if (const AbstractMultiTagFilter * f = dynamic_cast<const AbstractMultiTagFilter *>(filter))
+		children.assign(f->children().begin(), f->children().end());
+	else if (const InversionFilter * f = dynamic_cast<const InversionFilter *>(filter))
+		if (f->child())
+			children.push_back(f->child());
+
+	FilterProfile profile = filter->profile();
+
+	//time spent in this node without its children
+	uint64_t childNanoseconds = 0;
+	for (const AbstractTagFilter * child : children)
+		childNanoseconds += child->profile().nanoseconds;
+	uint64_t selfNanoseconds = profile.nanoseconds > childNanoseconds ? profile.nanoseconds - childNanoseconds : 0;
+
+	out << std::setw(12) << profile.calls << std::setw(12) << profile.hits
+		<< std::setw(8) << std::fixed << std::setprecision(1) << (profile.calls ? 100.0 * profile.hits / profile.calls : 0.0)
+		<< std::setw(10) << profile.rebuilds
+		<< std::setw(12) << std::setprecision(3) << profile.nanoseconds / 1e6
+		<< std::setw(12) << selfNanoseconds / 1e6 << "  "
+		<< std::string(2 * depth, ' ') << describeFilter(filter);
+
+	//shared sub dags are printed once
+	if (!visited.insert(filter).second)
+	{
+		out << " (shared, see above)\n";
+		return;
+	}
+	out << '\n';
+
+	for (const AbstractTagFilter * child : children)
+		dumpProfileNode(out, child, depth + 1, visited);
+}
+
+} // namespace
+
+void AbstractTagFilter::dumpProfile(std::ostream & out) const
+{
+	if (!profilingEnabled())
+		out << "filter profiling is disabled, build with OSMPBF_FILTER_PROFILING\n";
+
+	std::unordered_set<const AbstractTagFilter *> visited;
+	out << std::setw(12) << "calls" << std::setw(12) << "hits" << std::setw(8) << "hit%" << std::setw(10) << "rebuilds"
+		<< std::setw(12) << "total ms" << std::setw(12) << "self ms" << "  filter\n";
+	dumpProfileNode(out, this, 0, visited);
+	out << std::flush;
+}
+
+BlockSelection AbstractTagFilter::evaluateBlock(PrimitiveBlockInputAdaptor & pbi, PrimitiveType type)
+{
+	BlockSelection selection;
+
+	if (pbi.isNull())
+		return selection;
+
+	switch (type)
+	{
+	case NodePrimitive:
+		selection.reserve(pbi.nodesSize());
+		for (INodeStream node(pbi.getNodeStream()); !node.isNull(); node.next())
+			selection.push_back(matches(node));
+		break;
+	case WayPrimitive:
+		selection.reserve(pbi.waysSize());
+		for (IWayStream way(pbi.getWayStream()); !way.isNull(); way.next())
+			selection.push_back(matches(way));
+		break;
+	case RelationPrimitive:
+		selection.reserve(pbi.relationsSize());
+		for (IRelationStream relation(pbi.getRelationStream()); !relation.isNull(); relation.next())
+			selection.push_back(matches(relation));
+		break;
+	default:
+		break;
+	}
+
+	return selection;
 }
 
 AbstractTagFilter* AbstractTagFilter::copy() const
 {
 	AbstractTagFilter::CopyMap cm;
-	return this->copy(cm);
+	AbstractTagFilter * result = this->copy(cm);
+
+#ifdef OSMPBF_FILTER_PROFILING
+	//copies count into the counters of their original
+	for (CopyMap::value_type & it : cm)
+		it.second->m_Profile = it.first->m_Profile;
+#endif
+
+	return result;
 }
 
 AbstractTagFilter * AbstractTagFilter::copy(AbstractTagFilter * other, AbstractTagFilter::CopyMap & copies) const
@@ -169,6 +363,7 @@ ConstantReturnFilter::~ConstantReturnFilter() {}
 
 bool ConstantReturnFilter::rebuildCache()
 {
+	profileRebuild();
 	return m_returnValue;
 }
 
@@ -249,6 +444,15 @@ bool PrimitiveTypeFilter::p_uncached_match(const IPrimitive & primitive)
 
 // AbstractMultiTagFilter
 
+constexpr uint64_t AbstractMultiTagFilter::SAMPLE_INTERVAL;
+constexpr uint32_t AbstractMultiTagFilter::DEFAULT_REORDER_INTERVAL;
+
+AbstractMultiTagFilter::AbstractMultiTagFilter() :
+AbstractTagFilter(),
+m_ReorderInterval(DEFAULT_REORDER_INTERVAL),
+m_BlockCount(0)
+{}
+
 AbstractMultiTagFilter::~AbstractMultiTagFilter()
 {
 	for (FilterList::const_iterator it = m_Children.cbegin(); it != m_Children.cend(); ++it)
@@ -269,12 +473,135 @@ AbstractTagFilter * AbstractMultiTagFilter::addChild(AbstractTagFilter * child)
 {
 	if (child)
 	{
-		m_Children.push_front(child);
+		m_Children.push_back(child);
+		m_ChildStats.push_back(ChildStats());
 		child->rcInc();
 	}
 	return child;
 }
 
+const AbstractMultiTagFilter::FilterList & AbstractMultiTagFilter::children() const
+{
+	return m_Children;
+}
+
+const AbstractMultiTagFilter::ChildStatsList & AbstractMultiTagFilter::childStats() const
+{
+	return m_ChildStats;
+}
+
+void AbstractMultiTagFilter::resetChildStats()
+{
+	std::fill(m_ChildStats.begin(), m_ChildStats.end(), ChildStats());
+}
+
+void AbstractMultiTagFilter::setReorderInterval(uint32_t blocks)
+{
+	m_ReorderInterval = blocks;
+	m_BlockCount = 0;
+}
+
+uint32_t AbstractMultiTagFilter::reorderInterval() const
+{
+	return m_ReorderInterval;
+}
+
+void AbstractMultiTagFilter::reorderChildren()
+{
+	if (m_Children.size() < 2)
+		return;
+
+	//children without timing samples yet are assumed to cost as much as the cheapest known one
+	double minCost = 0.0;
+	for (const ChildStats & stats : m_ChildStats)
+	{
+		if (stats.samples && (minCost == 0.0 || stats.cost() < minCost))
+			minCost = stats.cost();
+	}
+	if (minCost == 0.0)
+		minCost = 1.0;
+
+	std::vector<double> rank(m_Children.size());
+	for (std::size_t i = 0; i < m_Children.size(); ++i)
+	{
+		const ChildStats & stats = m_ChildStats[i];
+		rank[i] = (stats.samples ? stats.cost() : minCost) / stats.decisiveRate();
+	}
+
+	std::vector<std::size_t> order(m_Children.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&rank](std::size_t a, std::size_t b) { return rank[a] < rank[b]; });
+
+	FilterList children;
+	ChildStatsList childStats;
+	children.reserve(order.size());
+	childStats.reserve(order.size());
+	for (std::size_t i : order)
+	{
+		children.push_back(m_Children[i]);
+		childStats.push_back(m_ChildStats[i]);
+	}
+
+	m_Children.swap(children);
+	m_ChildStats.swap(childStats);
+}
+
+void AbstractMultiTagFilter::copyChildren(AbstractMultiTagFilter * other, CopyMap & copies) const
+{
+	for (FilterList::const_iterator it = m_Children.cbegin(); it != m_Children.cend(); ++it)
+	{
+		if (copies.count(*it))
+		{
+			other->addChild(copies.at(*it));
+		}
+		else
+		{
+			other->addChild(AbstractTagFilter::copy(*it, copies));
+		}
+	}
+	other->m_ReorderInterval = m_ReorderInterval;
+}
+
+void AbstractMultiTagFilter::observe(const IPrimitive & primitive)
+{
+	if (!m_ReorderInterval)
+		return;
+
+	const PrimitiveBlockInputAdaptor * controller = primitive.controller();
+	if (!controller || controller->id() == m_LastBlock)
+		return;
+
+	m_LastBlock = controller->id();
+	if (++m_BlockCount >= m_ReorderInterval)
+	{
+		m_BlockCount = 0;
+		reorderChildren();
+	}
+}
+
+bool AbstractMultiTagFilter::evaluateChild(std::size_t index, const IPrimitive & primitive, bool decisiveResult)
+{
+	ChildStats & stats = m_ChildStats[index];
+	bool result;
+
+	if (++stats.evaluations % SAMPLE_INTERVAL == 0)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		result = m_Children[index]->matches(primitive);
+		stats.sampledNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		++stats.samples;
+	}
+	else
+	{
+		result = m_Children[index]->matches(primitive);
+	}
+
+	if (result == decisiveResult)
+		++stats.decisive;
+
+	return result;
+}
+
 //AbstractTagFilterWithCache
 
 AbstractTagFilterWithCache::AbstractTagFilterWithCache() :
@@ -299,6 +626,7 @@ void AbstractTagFilterWithCache::assignInputAdaptor(const PrimitiveBlockInputAda
 
 bool AbstractTagFilterWithCache::rebuildCache()
 {
+	profileRebuild();
 	markClean();
 	return p_rebuildCache();
 }
@@ -351,6 +679,7 @@ OrTagFilter::OrTagFilter(std::initializer_list<AbstractTagFilter*> l)
 
 bool OrTagFilter::rebuildCache()
 {
+	profileRebuild();
 	bool result = false;
 	for (FilterList::const_iterator it(m_Children.cbegin()), end(m_Children.cend()); it != end; ++it)
 	{
@@ -362,9 +691,11 @@ bool OrTagFilter::rebuildCache()
 
 bool OrTagFilter::p_matches(const IPrimitive & primitive)
 {
-	for (FilterList::const_iterator it(m_Children.cbegin()), end(m_Children.cend()); it != end; ++it)
+	observe(primitive);
+
+	for (std::size_t i = 0, s = m_Children.size(); i < s; ++i)
 	{
-		if ((*it)->matches(primitive))
+		if (evaluateChild(i, primitive, true))
 		{
 			return true;
 		}
@@ -380,19 +711,7 @@ AbstractTagFilter* OrTagFilter::copy(AbstractTagFilter::CopyMap& copies) const
 		return copies.at(this);
 	}
 	OrTagFilter * myCopy = new OrTagFilter();
-	for (FilterList::const_iterator it = m_Children.cbegin(); it != m_Children.cend(); ++it)
-	{
-		if (copies.count(*it))
-		{
-			myCopy->m_Children.push_front(copies.at(*it));
-		}
-		else
-		{
-			myCopy->m_Children.push_front( AbstractTagFilter::copy(*it, copies));
-		}
-		myCopy->m_Children.front()->rcInc();
-	}
-	myCopy->m_Children.reverse();
+	copyChildren(myCopy, copies);
 	copies[this] = myCopy;
 	return myCopy;
 }
@@ -409,6 +728,7 @@ AndTagFilter::AndTagFilter(std::initializer_list<AbstractTagFilter*> l)
 
 bool AndTagFilter::rebuildCache()
 {
+	profileRebuild();
 	bool result = true;
 	for (FilterList::const_iterator it(m_Children.cbegin()), end(m_Children.cend()); it != end; ++it)
 	{
@@ -419,9 +739,11 @@ bool AndTagFilter::rebuildCache()
 
 bool AndTagFilter::p_matches(const IPrimitive & primitive)
 {
-	for (FilterList::const_iterator it(m_Children.cbegin()), end(m_Children.cend()); it != end; ++it)
+	observe(primitive);
+
+	for (std::size_t i = 0, s = m_Children.size(); i < s; ++i)
 	{
-		if (!(*it)->matches(primitive))
+		if (!evaluateChild(i, primitive, false))
 		{
 			return false;
 		}
@@ -437,19 +759,7 @@ AbstractTagFilter* AndTagFilter::copy(AbstractTagFilter::CopyMap& copies) const
 		return copies.at(this);
 	}
 	AndTagFilter * myCopy = new AndTagFilter();
-	for (FilterList::const_iterator it = m_Children.cbegin(); it != m_Children.cend(); ++it)
-	{
-		if (copies.count(*it))
-		{
-			myCopy->m_Children.push_front(copies.at(*it));
-		}
-		else
-		{
-			myCopy->m_Children.push_front( AbstractTagFilter::copy(*it, copies));
-		}
-		myCopy->m_Children.front()->rcInc();
-	}
-	myCopy->m_Children.reverse();
+	copyChildren(myCopy, copies);
 	copies[this] = myCopy;
 	return myCopy;
 }
@@ -684,6 +994,11 @@ void KeyMultiValueTagFilter::clearValues()
 	m_ValueSet.clear();
 }
 
+const KeyMultiValueTagFilter::ValueSet & KeyMultiValueTagFilter::values() const
+{
+	return m_ValueSet;
+}
+
 KeyMultiValueTagFilter & KeyMultiValueTagFilter::operator<<(const std::string & value)
 {
 	addValue(value);
@@ -824,6 +1139,11 @@ void MultiKeyTagFilter::clearValues()
 	markDirty();
 }
 
+const MultiKeyTagFilter::ValueSet & MultiKeyTagFilter::keys() const
+{
+	return m_KeySet;
+}
+
 bool MultiKeyTagFilter::p_cached_match(const IPrimitive& primitive)
 {
 	if (m_KeySet.empty())
@@ -888,6 +1208,11 @@ void MultiKeyMultiValueTagFilter::clearValues()
 	m_ValueMap.clear();
 }
 
+const MultiKeyMultiValueTagFilter::ValueMap & MultiKeyMultiValueTagFilter::valueMap() const
+{
+	return m_ValueMap;
+}
+
 bool MultiKeyMultiValueTagFilter::p_matches(const IPrimitive& primitive)
 {
 	for(int i(0), s(primitive.tagsSize()); i < s; ++i)
@@ -917,22 +1242,20 @@ AbstractTagFilter* MultiKeyMultiValueTagFilter::copy(AbstractTagFilter::CopyMap
 	return myCopy;
 }
 
-RegexKeyTagFilter::RegexKeyTagFilter(std::regex_constants::match_flag_type flags) :
-m_matchFlags(flags)
+RegexKeyTagFilter::RegexKeyTagFilter(const RegexMatcherPtr & matcher) :
+m_Matcher(matcher)
 {}
 
 RegexKeyTagFilter::RegexKeyTagFilter() :
-RegexKeyTagFilter(std::regex_constants::match_default)
+m_Matcher(new RegexMatcher())
 {}
 
 RegexKeyTagFilter::RegexKeyTagFilter(const std::string & regexString, std::regex_constants::match_flag_type flags) :
-m_regex(regexString),
-m_matchFlags(flags)
+m_Matcher(new RegexMatcher(regexString, flags))
 {}
 
 RegexKeyTagFilter::RegexKeyTagFilter(const std::regex & regex, std::regex_constants::match_flag_type flags) :
-m_regex(regex),
-m_matchFlags(flags)
+m_Matcher(new RegexMatcher(regex, flags))
 {}
 
 RegexKeyTagFilter::~RegexKeyTagFilter()
@@ -940,19 +1263,31 @@ RegexKeyTagFilter::~RegexKeyTagFilter()
 
 void RegexKeyTagFilter::setRegex(const std::regex & regex, std::regex_constants::match_flag_type flags)
 {
-	m_regex = regex;
-	m_matchFlags = flags;
+	m_Matcher.reset(new RegexMatcher(regex, flags));
 	markDirty();
 }
 
 void RegexKeyTagFilter::setRegex(const std::string & regexString, std::regex_constants::match_flag_type flags)
 {
-	m_regex.assign(regexString);
-	m_matchFlags = flags;
+	m_Matcher.reset(new RegexMatcher(regexString, flags));
 	markDirty();
 }
 
-// RegexKeyTagFilter
+const std::regex & RegexKeyTagFilter::regex() const
+{
+	return m_Matcher->regex();
+}
+
+std::regex_constants::match_flag_type RegexKeyTagFilter::matchFlags() const
+{
+	return m_Matcher->matchFlags();
+}
+
+const RegexMatcherPtr & RegexKeyTagFilter::matcher() const
+{
+	return m_Matcher;
+}
+
 bool RegexKeyTagFilter::p_rebuildCache()
 {
 	m_IdSet.clear();
@@ -969,7 +1304,7 @@ bool RegexKeyTagFilter::p_rebuildCache()
 
 	for (uint32_t id(0), s(m_PBI->stringTableSize()); id < s; ++id)
 	{
-		if (std::regex_match(m_PBI->queryStringTable(id), m_regex, m_matchFlags))
+		if (m_Matcher->matches(m_PBI->queryStringTable(id)))
 		{
 			m_IdSet.insert(id);
 		}
@@ -984,7 +1319,8 @@ AbstractTagFilter* RegexKeyTagFilter::copy(AbstractTagFilter::CopyMap& copies) c
 	{
 		return copies.at(this);
 	}
-	RegexKeyTagFilter * myCopy = new RegexKeyTagFilter(m_regex, m_matchFlags);
+	//the matcher is thread-safe, sharing it shares the memo
+	RegexKeyTagFilter * myCopy = new RegexKeyTagFilter(m_Matcher);
 	copies[this] = myCopy;
 	return myCopy;
 }
@@ -993,7 +1329,7 @@ bool RegexKeyTagFilter::p_cached_match(const IPrimitive& primitive)
 {
 	for(int i(0), s(primitive.tagsSize()); i < s; ++i)
 	{
-		if (std::regex_match(primitive.key(i), m_regex, m_matchFlags))
+		if (m_IdSet.count(primitive.keyId(i)))
 		{
 			return true;
 		}
@@ -1005,7 +1341,7 @@ bool RegexKeyTagFilter::p_uncached_match(const IPrimitive& primitive)
 {
 	for(int i(0), s(primitive.tagsSize()); i < s; ++i)
 	{
-		if (m_IdSet.count(primitive.keyId(i)))
+		if (m_Matcher->matches(primitive.key(i)))
 		{
 			return true;
 		}
@@ -1013,110 +1349,579 @@ bool RegexKeyTagFilter::p_uncached_match(const IPrimitive& primitive)
 	return false;
 }
 
-// BoolTagFilter
+// RegexValueTagFilter
 
-BoolTagFilter::BoolTagFilter(const std::string & key, bool value) :
-KeyMultiValueTagFilter(key),
-m_Value(value)
-{
-	if (m_Value)
-	{
-		const std::array<std::string, 5> s{ { "True", "true", "Yes", "yes", "1" } };
-		KeyMultiValueTagFilter::setValues(s.begin(), s.end());
-	}
-	else
-	{
-		const std::array<std::string, 5> s{ { "False", "false", "No", "no", "0" } };
-		KeyMultiValueTagFilter::setValues(s.begin(), s.end());
-	}
-}
+RegexValueTagFilter::RegexValueTagFilter(const std::string & key, const RegexMatcherPtr & matcher) :
+m_Key(key),
+m_Matcher(matcher),
+m_KeyId(-1)
+{}
 
-void BoolTagFilter::setValue(bool value)
-{
-	if (m_Value == value)
-		return;
+RegexValueTagFilter::RegexValueTagFilter(const std::string & key, const std::string & regexString, std::regex_constants::match_flag_type flags) :
+RegexValueTagFilter(key, RegexMatcherPtr(new RegexMatcher(regexString, flags)))
+{}
 
-	m_Value = value;
+RegexValueTagFilter::RegexValueTagFilter(const std::string & key, const std::regex & regex, std::regex_constants::match_flag_type flags) :
+RegexValueTagFilter(key, RegexMatcherPtr(new RegexMatcher(regex, flags)))
+{}
 
-	clearValues();
+RegexValueTagFilter::~RegexValueTagFilter()
+{}
 
-	if (m_Value)
-	{
-		const std::array<std::string, 5> s{ { "True", "true", "Yes", "yes", "1" } };
-		KeyMultiValueTagFilter::setValues(s.begin(), s.end());
-	}
-	else
-	{
-		const std::array<std::string, 5> s{ { "False", "false", "No", "no", "0" } };
-		KeyMultiValueTagFilter::setValues(s.begin(), s.end());
-	}
+void RegexValueTagFilter::setKey(const std::string & key)
+{
+	m_Key = key;
+	markDirty();
 }
 
-bool BoolTagFilter::value() const
+const std::string & RegexValueTagFilter::key() const
 {
-	return m_Value;
+	return m_Key;
 }
 
-void BoolTagFilter::addValue(const std::string & value)
+void RegexValueTagFilter::setRegex(const std::regex & regex, std::regex_constants::match_flag_type flags)
 {
-	KeyMultiValueTagFilter::addValue(value);
+	m_Matcher.reset(new RegexMatcher(regex, flags));
+	markDirty();
 }
 
-void BoolTagFilter::clearValues()
+void RegexValueTagFilter::setRegex(const std::string & regexString, std::regex_constants::match_flag_type flags)
 {
-	KeyMultiValueTagFilter::clearValues();
+	m_Matcher.reset(new RegexMatcher(regexString, flags));
+	markDirty();
 }
 
-KeyMultiValueTagFilter & BoolTagFilter::operator<<(const std::string & value)
+const std::regex & RegexValueTagFilter::regex() const
 {
-	KeyMultiValueTagFilter::operator<<(value);
-	return *this;
+	return m_Matcher->regex();
 }
 
-KeyMultiValueTagFilter & BoolTagFilter::operator<<(const char * value)
+std::regex_constants::match_flag_type RegexValueTagFilter::matchFlags() const
 {
-	KeyMultiValueTagFilter::operator<<(value);
-	return *this;
+	return m_Matcher->matchFlags();
 }
 
-AbstractTagFilter* BoolTagFilter::copy(AbstractTagFilter::CopyMap& copies) const
+const RegexMatcherPtr & RegexValueTagFilter::matcher() const
 {
-	if (copies.count(this))
-	{
-		return copies.at(this);
-	}
-	BoolTagFilter * myCopy = new BoolTagFilter(key(), value());
-	copies[this] = myCopy;
-	return myCopy;
+	return m_Matcher;
 }
 
+bool RegexValueTagFilter::p_rebuildCache()
+{
+	m_KeyId = -1;
+	m_IdSet.clear();
 
-// IntTagFilter
+	if (!m_PBI)
+	{
+		return true;
+	}
 
-IntTagFilter::IntTagFilter(const std::string & key, int value) :
-KeyOnlyTagFilter(key), m_Value(value) {}
+	if (m_PBI->isNull())
+	{
+		return false;
+	}
 
-bool IntTagFilter::p_rebuildCache()
-{
-	m_KeyId = findId(m_Key);
+	for (uint32_t id(0), s(m_PBI->stringTableSize()); id < s; ++id)
+	{
+		const std::string & str = m_PBI->queryStringTable(id);
 
-	findValueId();
+		//string id 0 is reserved as delimiter and never a valid key
+		if (id && m_KeyId < 0 && !m_Key.empty() && str == m_Key)
+		{
+			m_KeyId = id;
+		}
 
-	if (!m_PBI) return true;
-	if (m_PBI->isNull()) return false;
+		if (m_Matcher->matches(str))
+		{
+			m_IdSet.insert(id);
+		}
+	}
 
-	return m_KeyId && m_ValueId;
+	if (!m_Key.empty() && m_KeyId < 0)
+	{
+		m_IdSet.clear();
+		return false;
+	}
+
+	return m_IdSet.size();
 }
 
-void IntTagFilter::setValue(int value)
+AbstractTagFilter* RegexValueTagFilter::copy(AbstractTagFilter::CopyMap& copies) const
 {
-	m_Value = value;
-	findValueId();
+	if (copies.count(this))
+	{
+		return copies.at(this);
+	}
+	RegexValueTagFilter * myCopy = new RegexValueTagFilter(m_Key, m_Matcher);
+	copies[this] = myCopy;
+	return myCopy;
 }
 
-int IntTagFilter::value() const
+bool RegexValueTagFilter::p_cached_match(const IPrimitive& primitive)
 {
-	return m_Value;
+	for(int i(0), s(primitive.tagsSize()); i < s; ++i)
+	{
+		if ((m_KeyId < 0 || (int) primitive.keyId(i) == m_KeyId) && m_IdSet.count(primitive.valueId(i)))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool RegexValueTagFilter::p_uncached_match(const IPrimitive& primitive)
+{
+	for(int i(0), s(primitive.tagsSize()); i < s; ++i)
+	{
+		if ((m_Key.empty() || primitive.key(i) == m_Key) && m_Matcher->matches(primitive.value(i)))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// AbstractLocationFilter
+
+namespace
+{
+
+inline int64_t floorDiv(int64_t a, int64_t b)
+{
+	int64_t q = a / b;
+	return (q * b != a && ((a < 0) != (b < 0))) ? q - 1 : q;
+}
+
+inline int64_t ceilDiv(int64_t a, int64_t b)
+{
+	int64_t q = a / b;
+	return (q * b != a && ((a < 0) == (b < 0))) ? q + 1 : q;
+}
+
+inline int64_t toNanoLat(double value)
+{
+	return (int64_t) std::llround(value / COORDINATE_SCALE_FACTOR_LAT);
+}
+
+inline int64_t toNanoLon(double value)
+{
+	return (int64_t) std::llround(value / COORDINATE_SCALE_FACTOR_LON);
+}
+
+} // namespace
+
+AbstractLocationFilter::AbstractLocationFilter() :
+m_MinLat(1),
+m_MinLon(1),
+m_MaxLat(0),
+m_MaxLon(0)
+{
+	m_RawBounds.minLat = m_RawBounds.minLon = 1;
+	m_RawBounds.maxLat = m_RawBounds.maxLon = 0;
+}
+
+AbstractLocationFilter::~AbstractLocationFilter()
+{}
+
+void AbstractLocationFilter::setBoundsi(int64_t minLat, int64_t minLon, int64_t maxLat, int64_t maxLon)
+{
+	m_MinLat = minLat;
+	m_MinLon = minLon;
+	m_MaxLat = maxLat;
+	m_MaxLon = maxLon;
+	markDirty();
+}
+
+AbstractLocationFilter::RawBounds AbstractLocationFilter::rawBounds(const PrimitiveBlockInputAdaptor & pbi) const
+{
+	RawBounds result;
+	result.minLat = result.minLon = 1;
+	result.maxLat = result.maxLon = 0;
+
+	const int64_t granularity = pbi.granularity();
+	if (granularity <= 0 || m_MinLat > m_MaxLat || m_MinLon > m_MaxLon)
+		return result;
+
+	//lat = latOffset + granularity * raw, thus raw in [ceil((min - offset) / g), floor((max - offset) / g)]
+	result.minLat = ceilDiv(m_MinLat - pbi.latOffset(), granularity);
+	result.maxLat = floorDiv(m_MaxLat - pbi.latOffset(), granularity);
+	result.minLon = ceilDiv(m_MinLon - pbi.lonOffset(), granularity);
+	result.maxLon = floorDiv(m_MaxLon - pbi.lonOffset(), granularity);
+	return result;
+}
+
+bool AbstractLocationFilter::contains(const INode & node) const
+{
+	const int64_t lat = node.lati();
+	const int64_t lon = node.loni();
+
+	if (lat < m_MinLat || lat > m_MaxLat || lon < m_MinLon || lon > m_MaxLon)
+		return false;
+
+	return boundsExact() || containsi(lat, lon);
+}
+
+void AbstractLocationFilter::evaluateRaw(const PrimitiveBlockInputAdaptor & pbi, const RawBounds & bounds,
+	const int64_t * lat, const int64_t * lon, std::size_t count, BlockSelection & selection) const
+{
+	//branch-free box test, compilers vectorize this loop
+	std::vector<uint8_t> inside(count);
+	const int64_t minLat = bounds.minLat, maxLat = bounds.maxLat;
+	const int64_t minLon = bounds.minLon, maxLon = bounds.maxLon;
+	for (std::size_t i = 0; i < count; ++i)
+		inside[i] = (lat[i] >= minLat) & (lat[i] <= maxLat) & (lon[i] >= minLon) & (lon[i] <= maxLon);
+
+	if (boundsExact())
+	{
+		selection.insert(selection.end(), inside.begin(), inside.end());
+		return;
+	}
+
+	for (std::size_t i = 0; i < count; ++i)
+		selection.push_back(inside[i] && containsi(pbi.toWGS84Lati(lat[i]), pbi.toWGS84Loni(lon[i])));
+}
+
+void AbstractLocationFilter::evaluateNodes(const PrimitiveBlockInputAdaptor & pbi, BlockSelection & selection) const
+{
+	const RawBounds bounds = rawBounds(pbi);
+
+	if (bounds.empty())
+	{
+		selection.insert(selection.end(), pbi.nodesSize(), false);
+		return;
+	}
+
+	std::vector<int64_t> lat, lon;
+
+	for (crosby::binary::PrimitiveGroup * group : pbi.m_PlainNodesGroups)
+	{
+		const int nodesSize = group->nodes_size();
+		lat.resize(nodesSize);
+		lon.resize(nodesSize);
+		for (int i = 0; i < nodesSize; ++i)
+		{
+			lat[i] = group->nodes(i).lat();
+			lon[i] = group->nodes(i).lon();
+		}
+		evaluateRaw(pbi, bounds, lat.data(), lon.data(), nodesSize, selection);
+	}
+
+	for (const DenseNodesData & data : pbi.m_DenseNodesGroups)
+	{
+		const crosby::binary::DenseNodes & dense = data.group()->dense();
+		const int nodesSize = dense.lat_size();
+
+		if (data.isDataUnpacked())
+		{
+			evaluateRaw(pbi, bounds, dense.lat().data(), dense.lon().data(), nodesSize, selection);
+			continue;
+		}
+
+		//coordinates are delta coded
+		lat.resize(nodesSize);
+		lon.resize(nodesSize);
+		int64_t curLat = 0, curLon = 0;
+		for (int i = 0; i < nodesSize; ++i)
+		{
+			curLat += dense.lat(i);
+			curLon += dense.lon(i);
+			lat[i] = curLat;
+			lon[i] = curLon;
+		}
+		evaluateRaw(pbi, bounds, lat.data(), lon.data(), nodesSize, selection);
+	}
+}
+
+bool AbstractLocationFilter::p_rebuildCache()
+{
+	if (!m_PBI)
+	{
+		return true;
+	}
+
+	if (m_PBI->isNull())
+	{
+		return false;
+	}
+
+	m_RawBounds = rawBounds(*m_PBI);
+	return !m_RawBounds.empty() && m_PBI->nodesSize();
+}
+
+bool AbstractLocationFilter::p_cached_match(const IPrimitive & primitive)
+{
+	if (primitive.type() != NodePrimitive)
+	{
+		return false;
+	}
+
+	INode node(primitive);
+	if (!m_RawBounds.contains(node.rawLat(), node.rawLon()))
+	{
+		return false;
+	}
+
+	return boundsExact() || containsi(node.lati(), node.loni());
+}
+
+bool AbstractLocationFilter::p_uncached_match(const IPrimitive & primitive)
+{
+	if (primitive.type() != NodePrimitive)
+	{
+		return false;
+	}
+
+	return contains(INode(primitive));
+}
+
+// BBoxNodeFilter
+
+BBoxNodeFilter::BBoxNodeFilter(double minLat, double minLon, double maxLat, double maxLon)
+{
+	setBounds(minLat, minLon, maxLat, maxLon);
+}
+
+BBoxNodeFilter::~BBoxNodeFilter()
+{}
+
+void BBoxNodeFilter::setBounds(double minLat, double minLon, double maxLat, double maxLon)
+{
+	setBoundsi(toNanoLat(minLat), toNanoLon(minLon), toNanoLat(maxLat), toNanoLon(maxLon));
+}
+
+bool BBoxNodeFilter::containsi(int64_t lat, int64_t lon) const
+{
+	return lat >= m_MinLat && lat <= m_MaxLat && lon >= m_MinLon && lon <= m_MaxLon;
+}
+
+bool BBoxNodeFilter::boundsExact() const
+{
+	return true;
+}
+
+AbstractTagFilter* BBoxNodeFilter::copy(AbstractTagFilter::CopyMap& copies) const
+{
+	if (copies.count(this))
+	{
+		return copies.at(this);
+	}
+	BBoxNodeFilter * myCopy = new BBoxNodeFilter(0, 0, 0, 0);
+	myCopy->setBoundsi(m_MinLat, m_MinLon, m_MaxLat, m_MaxLon);
+	copies[this] = myCopy;
+	return myCopy;
+}
+
+// PolygonNodeFilter
+
+PolygonNodeFilter::PolygonNodeFilter()
+{}
+
+PolygonNodeFilter::PolygonNodeFilter(const Ring & ring)
+{
+	addRing(ring);
+}
+
+PolygonNodeFilter::~PolygonNodeFilter()
+{}
+
+void PolygonNodeFilter::addRing(const Ring & ring)
+{
+	if (ring.size() < 3)
+	{
+		return;
+	}
+
+	RingI ringI;
+	ringI.reserve(ring.size());
+	for (const std::pair<double, double> & point : ring)
+	{
+		ringI.emplace_back(toNanoLat(point.first), toNanoLon(point.second));
+	}
+
+	m_Rings.push_back(std::move(ringI));
+	updateBounds();
+}
+
+void PolygonNodeFilter::clearRings()
+{
+	m_Rings.clear();
+	updateBounds();
+}
+
+void PolygonNodeFilter::updateBounds()
+{
+	int64_t minLat = 1, minLon = 1, maxLat = 0, maxLon = 0;
+
+	for (const RingI & ring : m_Rings)
+	{
+		for (const std::pair<int64_t, int64_t> & point : ring)
+		{
+			if (minLat > maxLat)
+			{
+				minLat = maxLat = point.first;
+				minLon = maxLon = point.second;
+				continue;
+			}
+			minLat = std::min(minLat, point.first);
+			maxLat = std::max(maxLat, point.first);
+			minLon = std::min(minLon, point.second);
+			maxLon = std::max(maxLon, point.second);
+		}
+	}
+
+	setBoundsi(minLat, minLon, maxLat, maxLon);
+}
+
+bool PolygonNodeFilter::containsi(int64_t lat, int64_t lon) const
+{
+	//crossing number of a ray towards increasing longitude, counted over all rings
+	bool inside = false;
+
+	for (const RingI & ring : m_Rings)
+	{
+		for (std::size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++)
+		{
+			const int64_t latI = ring[i].first, lonI = ring[i].second;
+			const int64_t latJ = ring[j].first, lonJ = ring[j].second;
+
+			if ((latI > lat) == (latJ > lat))
+			{
+				continue;
+			}
+
+			const double crossLon = (double) lonI + (double) (lonJ - lonI) * (double) (lat - latI) / (double) (latJ - latI);
+			if ((double) lon < crossLon)
+			{
+				inside = !inside;
+			}
+		}
+	}
+
+	return inside;
+}
+
+bool PolygonNodeFilter::boundsExact() const
+{
+	return false;
+}
+
+AbstractTagFilter* PolygonNodeFilter::copy(AbstractTagFilter::CopyMap& copies) const
+{
+	if (copies.count(this))
+	{
+		return copies.at(this);
+	}
+	PolygonNodeFilter * myCopy = new PolygonNodeFilter();
+	myCopy->m_Rings = m_Rings;
+	myCopy->updateBounds();
+	copies[this] = myCopy;
+	return myCopy;
+}
+
+// BoolTagFilter
+
+BoolTagFilter::BoolTagFilter(const std::string & key, bool value) :
+KeyMultiValueTagFilter(key),
+m_Value(value)
+{
+	if (m_Value)
+	{
+		const std::array<std::string, 5> s{ { "True", "true", "Yes", "yes", "1" } };
+		KeyMultiValueTagFilter::setValues(s.begin(), s.end());
+	}
+	else
+	{
+		const std::array<std::string, 5> s{ { "False", "false", "No", "no", "0" } };
+		KeyMultiValueTagFilter::setValues(s.begin(), s.end());
+	}
+}
+
+void BoolTagFilter::setValue(bool value)
+{
+	if (m_Value == value)
+		return;
+
+	m_Value = value;
+
+	clearValues();
+
+	if (m_Value)
+	{
+		const std::array<std::string, 5> s{ { "True", "true", "Yes", "yes", "1" } };
+		KeyMultiValueTagFilter::setValues(s.begin(), s.end());
+	}
+	else
+	{
+		const std::array<std::string, 5> s{ { "False", "false", "No", "no", "0" } };
+		KeyMultiValueTagFilter::setValues(s.begin(), s.end());
+	}
+}
+
+bool BoolTagFilter::value() const
+{
+	return m_Value;
+}
+
+void BoolTagFilter::addValue(const std::string & value)
+{
+	KeyMultiValueTagFilter::addValue(value);
+}
+
+void BoolTagFilter::clearValues()
+{
+	KeyMultiValueTagFilter::clearValues();
+}
+
+KeyMultiValueTagFilter & BoolTagFilter::operator<<(const std::string & value)
+{
+	KeyMultiValueTagFilter::operator<<(value);
+	return *this;
+}
+
+KeyMultiValueTagFilter & BoolTagFilter::operator<<(const char * value)
+{
+	KeyMultiValueTagFilter::operator<<(value);
+	return *this;
+}
+
+AbstractTagFilter* BoolTagFilter::copy(AbstractTagFilter::CopyMap& copies) const
+{
+	if (copies.count(this))
+	{
+		return copies.at(this);
+	}
+	BoolTagFilter * myCopy = new BoolTagFilter(key(), value());
+	copies[this] = myCopy;
+	return myCopy;
+}
+
+
+// IntTagFilter
+
+IntTagFilter::IntTagFilter(const std::string & key, int value) :
+KeyOnlyTagFilter(key), m_Value(value) {}
+
+bool IntTagFilter::p_rebuildCache()
+{
+	m_KeyId = findId(m_Key);
+
+	findValueId();
+
+	if (!m_PBI) return true;
+	if (m_PBI->isNull()) return false;
+
+	return m_KeyId && m_ValueId;
+}
+
+void IntTagFilter::setValue(int value)
+{
+	m_Value = value;
+	findValueId();
+}
+
+int IntTagFilter::value() const
+{
+	return m_Value;
 }
 
 bool IntTagFilter::findValueId()
@@ -1194,6 +1999,185 @@ AbstractTagFilter* IntTagFilter::copy(AbstractTagFilter::CopyMap& copies) const
 	return myCopy;
 }
 
+// NumericTagFilter
+
+NumericTagFilter::NumericTagFilter(const std::string & key, Comparison comparison, double value) :
+KeyOnlyTagFilter(key),
+m_Comparison(comparison),
+m_MinValue(value),
+m_MaxValue(value)
+{}
+
+NumericTagFilter::NumericTagFilter(const std::string & key, double minValue, double maxValue) :
+KeyOnlyTagFilter(key),
+m_Comparison(CMP_Between),
+m_MinValue(minValue),
+m_MaxValue(maxValue)
+{}
+
+void NumericTagFilter::setComparison(Comparison comparison, double value)
+{
+	m_Comparison = comparison;
+	m_MinValue = value;
+	m_MaxValue = value;
+}
+
+void NumericTagFilter::setRange(double minValue, double maxValue)
+{
+	m_Comparison = CMP_Between;
+	m_MinValue = minValue;
+	m_MaxValue = maxValue;
+}
+
+bool NumericTagFilter::accepts(double value) const
+{
+	return compare(m_Comparison, value, m_MinValue, m_MaxValue);
+}
+
+bool NumericTagFilter::compare(Comparison comparison, double value, double minValue, double maxValue)
+{
+	switch (comparison)
+	{
+	case CMP_Less:
+		return value < minValue;
+	case CMP_LessEqual:
+		return value <= minValue;
+	case CMP_Equal:
+		return value == minValue;
+	case CMP_NotEqual:
+		return value != minValue;
+	case CMP_GreaterEqual:
+		return value >= minValue;
+	case CMP_Greater:
+		return value > minValue;
+	case CMP_Between:
+		return value >= minValue && value <= maxValue;
+	default:
+		return false;
+	}
+}
+
+bool NumericTagFilter::parseNumber(const std::string & str, double & value)
+{
+	const char * begin = str.c_str();
+	const char * end = begin + str.size();
+
+	while (begin != end && std::isspace((unsigned char) *begin))
+		++begin;
+	while (end != begin && std::isspace((unsigned char) end[-1]))
+		--end;
+
+	if (begin == end)
+		return false;
+
+	//reject what strtod accepts beyond plain decimals (hex, inf, nan)
+	bool hasDigit = false;
+	for (const char * it = begin; it != end; ++it)
+	{
+		if (std::isdigit((unsigned char) *it))
+			hasDigit = true;
+		else if (!std::strchr("+-.eE", *it))
+			return false;
+	}
+
+	if (!hasDigit)
+		return false;
+
+	char * endptr;
+	value = std::strtod(begin, &endptr);
+	return endptr == end;
+}
+
+bool NumericTagFilter::cachedNumber(uint32_t stringId, double & value)
+{
+	if (!m_PBI || m_PBI->isNull() || stringId >= (uint32_t) m_PBI->stringTableSize())
+		return false;
+
+	if (dirty())
+		rebuildCache();
+
+	switch (m_ParseStates[stringId])
+	{
+	case PARSE_Pending:
+		if (!parseNumber(m_PBI->queryStringTable(stringId), m_Values[stringId]))
+		{
+			m_ParseStates[stringId] = PARSE_NaN;
+			return false;
+		}
+		m_ParseStates[stringId] = PARSE_Number;
+		//fall through
+	case PARSE_Number:
+		value = m_Values[stringId];
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool NumericTagFilter::p_rebuildCache()
+{
+	m_KeyId = findId(m_Key);
+
+	//strings are parsed lazily on their first use as value of the key
+	m_ParseStates.assign((m_PBI && !m_PBI->isNull()) ? m_PBI->stringTableSize() : 0, PARSE_Pending);
+	m_Values.resize(m_ParseStates.size());
+
+	if (!m_PBI) return true;
+	if (m_PBI->isNull()) return false;
+
+	return m_KeyId;
+}
+
+bool NumericTagFilter::p_cached_match(const IPrimitive & primitive)
+{
+	m_LatestMatch = -1;
+
+	if (m_Key.empty() || !m_KeyId)
+		return false;
+
+	double value;
+	for (int i = 0; i < primitive.tagsSize(); ++i)
+	{
+		if (primitive.keyId(i) == m_KeyId && cachedNumber(primitive.valueId(i), value) && accepts(value))
+		{
+			m_LatestMatch = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool NumericTagFilter::p_uncached_match(const IPrimitive & primitive)
+{
+	m_LatestMatch = -1;
+
+	if (m_Key.empty())
+		return false;
+
+	double value;
+	for (int i = 0; i < primitive.tagsSize(); ++i)
+	{
+		if (primitive.key(i) == m_Key && parseNumber(primitive.value(i), value) && accepts(value))
+		{
+			m_LatestMatch = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+AbstractTagFilter* NumericTagFilter::copy(AbstractTagFilter::CopyMap& copies) const
+{
+	if (copies.count(this))
+	{
+		return copies.at(this);
+	}
+	NumericTagFilter * myCopy = new NumericTagFilter(key(), m_MinValue, m_MaxValue);
+	myCopy->m_Comparison = m_Comparison;
+	copies[this] = myCopy;
+	return myCopy;
+}
+
 //InvertFilter
 
 InversionFilter::InversionFilter() :
@@ -1227,6 +2211,7 @@ void InversionFilter::assignInputAdaptor(const PrimitiveBlockInputAdaptor* pbi)
 
 bool InversionFilter::rebuildCache()
 {
+	profileRebuild();
 	//if child matches something (not everything) then this matches something as-well
 	//if child matches nothing, then this matches everything
 	//but we still need to rebuild the cache of child nodes so that they have the correct cache info
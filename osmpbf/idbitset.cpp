@@ -0,0 +1,110 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#include <osmpbf/idbitset.h>
+
+#include <bitset>
+
+namespace osmpbf
+{
+
+constexpr int IdBitSet::PAGE_BITS;
+constexpr std::size_t IdBitSet::PAGE_WORDS;
+
+IdBitSet::IdBitSet() :
+m_Size(0)
+{}
+
+bool IdBitSet::insert(int64_t id)
+{
+	uint64_t i = index(id);
+	std::size_t pageIndex = std::size_t(i >> PAGE_BITS);
+	PageTable & table = pages(id);
+
+	if (table.size() <= pageIndex)
+		table.resize(pageIndex + 1);
+
+	Page & page = table[pageIndex];
+	if (page.empty())
+		page.resize(PAGE_WORDS, 0);
+
+	uint64_t & word = page[(i >> 6) & (PAGE_WORDS - 1)];
+	uint64_t bit = uint64_t(1) << (i & 63);
+	if (word & bit)
+		return false;
+
+	word |= bit;
+	++m_Size;
+	return true;
+}
+
+bool IdBitSet::count(int64_t id) const
+{
+	uint64_t i = index(id);
+	std::size_t pageIndex = std::size_t(i >> PAGE_BITS);
+	const PageTable & table = pages(id);
+
+	if (table.size() <= pageIndex || table[pageIndex].empty())
+		return false;
+
+	return (table[pageIndex][(i >> 6) & (PAGE_WORDS - 1)] >> (i & 63)) & 1;
+}
+
+void IdBitSet::merge(const IdBitSet & other)
+{
+	if (&other == this || other.empty())
+		return;
+
+	m_Size = merge(m_Pages, other.m_Pages) + merge(m_NegativePages, other.m_NegativePages);
+}
+
+std::size_t IdBitSet::merge(PageTable & target, const PageTable & source)
+{
+	if (target.size() < source.size())
+		target.resize(source.size());
+
+	std::size_t result = 0;
+	for (std::size_t p = 0; p < target.size(); ++p)
+	{
+		Page & page = target[p];
+		if (p < source.size() && !source[p].empty())
+		{
+			if (page.empty())
+				page = source[p];
+			else
+				for (std::size_t w = 0; w < PAGE_WORDS; ++w)
+					page[w] |= source[p][w];
+		}
+
+		for (uint64_t word : page)
+			result += std::bitset<64>(word).count();
+	}
+
+	return result;
+}
+
+void IdBitSet::clear()
+{
+	m_Pages.clear();
+	m_NegativePages.clear();
+	m_Size = 0;
+}
+
+} // namespace osmpbf
@@ -0,0 +1,261 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#include <osmpbf/idindex.h>
+#include <osmpbf/osmfilein.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+namespace osmpbf
+{
+
+namespace
+{
+	const char INDEX_MAGIC[8] = {'O', 'S', 'M', 'P', 'B', 'F', 'I', 'X'};
+	constexpr uint32_t INDEX_VERSION = 1;
+
+	static_assert(sizeof(IdIndex::BlobRange) == 3 * sizeof(uint64_t), "IdIndex::BlobRange is saved as is");
+
+	///append the id range of the primitives of @stream to @ranges
+	template<typename T_STREAM>
+	void addRange(T_STREAM stream, SizeType offset, std::vector<IdIndex::BlobRange> & ranges)
+	{
+		if (stream.isNull())
+			return;
+
+		IdIndex::BlobRange range;
+		range.minId = std::numeric_limits<int64_t>::max();
+		range.maxId = std::numeric_limits<int64_t>::min();
+		range.offset = offset;
+		for (; !stream.isNull(); stream.next())
+		{
+			range.minId = std::min(range.minId, stream.id());
+			range.maxId = std::max(range.maxId, stream.id());
+		}
+		ranges.push_back(range);
+	}
+}
+
+IdIndex::IdIndex() :
+	m_FileSize(0)
+{
+	clear();
+}
+
+IdIndex::~IdIndex() {}
+
+void IdIndex::clear()
+{
+	for (std::size_t i = 0; i < 3; ++i)
+	{
+		m_Ranges[i].clear();
+		m_Disjoint[i] = true;
+	}
+	m_FileSize = 0;
+}
+
+bool IdIndex::build(OSMFileIn & inFile, uint32_t threadCount)
+{
+	clear();
+
+	if (!threadCount)
+		threadCount = std::max<uint32_t>(std::thread::hardware_concurrency(), 1);
+
+	inFile.reset();
+
+	std::mutex lock;
+	std::atomic<bool> failed(false);
+	auto work = [this, &inFile, &lock, &failed]() {
+		std::vector<BlobRange> local[3];
+		BlobDataBuffer buffer;
+		RawBlobRef rawBlob;
+		PrimitiveBlockInputAdaptor pbi;
+		while (!failed)
+		{
+			//rawBlob is filled once the blob was taken from the file, even if it fails to decode
+			rawBlob.type = BLOB_Invalid;
+			if (!inFile.getNextBlock(buffer, rawBlob))
+			{
+				if (rawBlob.type != BLOB_Invalid)
+					failed = true;
+				break;
+			}
+
+			if (buffer.type != BLOB_OSMData)
+				continue;
+
+			pbi.parseData(buffer.data, buffer.availableBytes);
+			addRange(pbi.getNodeStream(), rawBlob.offset, local[0]);
+			addRange(pbi.getWayStream(), rawBlob.offset, local[1]);
+			addRange(pbi.getRelationStream(), rawBlob.offset, local[2]);
+		}
+
+		std::lock_guard<std::mutex> lck(lock);
+		for (std::size_t i = 0; i < 3; ++i)
+			m_Ranges[i].insert(m_Ranges[i].end(), local[i].begin(), local[i].end());
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; ++i)
+		threads.push_back(std::thread(work));
+	for (std::thread & t : threads)
+		t.join();
+
+	//a blob failing to decode is consumed all the same, only invalid blob headers stop reading early
+	bool complete = !failed && !inFile.hasNext();
+	inFile.reset();
+
+	if (!complete)
+	{
+		std::cerr << "ERROR: could not index all blobs" << std::endl;
+		clear();
+		return false;
+	}
+
+	m_FileSize = inFile.totalSize();
+	finish();
+	return true;
+}
+
+bool IdIndex::save(const std::string & fileName) const
+{
+	std::ofstream out(fileName, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		std::cerr << "ERROR: could not open " << fileName << " for writing" << std::endl;
+		return false;
+	}
+
+	uint64_t fileSize = m_FileSize;
+	out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	out.write(reinterpret_cast<const char *>(&INDEX_VERSION), sizeof(INDEX_VERSION));
+	out.write(reinterpret_cast<const char *>(&fileSize), sizeof(fileSize));
+	for (std::size_t i = 0; i < 3; ++i)
+	{
+		uint64_t count = m_Ranges[i].size();
+		out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+		out.write(reinterpret_cast<const char *>(m_Ranges[i].data()), count * sizeof(BlobRange));
+	}
+
+	if (!out)
+	{
+		std::cerr << "ERROR: could not write " << fileName << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool IdIndex::load(const std::string & fileName)
+{
+	clear();
+
+	std::ifstream in(fileName, std::ios::binary);
+	if (!in)
+	{
+		std::cerr << "ERROR: could not open " << fileName << std::endl;
+		return false;
+	}
+
+	char magic[sizeof(INDEX_MAGIC)];
+	uint32_t version = 0;
+	uint64_t fileSize = 0;
+	in.read(magic, sizeof(magic));
+	in.read(reinterpret_cast<char *>(&version), sizeof(version));
+	in.read(reinterpret_cast<char *>(&fileSize), sizeof(fileSize));
+	if (!in || std::memcmp(magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) || version != INDEX_VERSION)
+	{
+		std::cerr << "ERROR: " << fileName << " is not an id index" << std::endl;
+		return false;
+	}
+
+	for (std::size_t i = 0; i < 3; ++i)
+	{
+		uint64_t count = 0;
+		in.read(reinterpret_cast<char *>(&count), sizeof(count));
+		//grow chunk-wise, a corrupt count must not allocate huge amounts of memory
+		while (in && count)
+		{
+			std::size_t chunk = (std::size_t) std::min<uint64_t>(count, 1 << 16);
+			std::size_t size = m_Ranges[i].size();
+			m_Ranges[i].resize(size + chunk);
+			in.read(reinterpret_cast<char *>(m_Ranges[i].data() + size), chunk * sizeof(BlobRange));
+			count -= chunk;
+		}
+		if (!in)
+		{
+			std::cerr << "ERROR: id index " << fileName << " is truncated" << std::endl;
+			clear();
+			return false;
+		}
+	}
+
+	m_FileSize = fileSize;
+	finish();
+	return true;
+}
+
+void IdIndex::candidates(PrimitiveType type, int64_t id, std::vector<SizeType> & offsets) const
+{
+	offsets.clear();
+	const std::vector<BlobRange> & r = ranges(type);
+
+	//first range starting after id
+	std::vector<BlobRange>::const_iterator end = std::upper_bound(r.cbegin(), r.cend(), id,
+		[](int64_t value, const BlobRange & range) { return value < range.minId; });
+
+	if (disjoint(type))
+	{
+		if (end != r.cbegin() && (end - 1)->maxId >= id)
+			offsets.push_back((end - 1)->offset);
+		return;
+	}
+
+	for (std::vector<BlobRange>::const_iterator it = r.cbegin(); it != end; ++it)
+	{
+		if (it->maxId >= id)
+			offsets.push_back(it->offset);
+	}
+	std::sort(offsets.begin(), offsets.end());
+}
+
+void IdIndex::finish()
+{
+	for (std::size_t i = 0; i < 3; ++i)
+	{
+		std::vector<BlobRange> & r = m_Ranges[i];
+		std::sort(r.begin(), r.end(), [](const BlobRange & a, const BlobRange & b) {
+			return a.minId < b.minId || (a.minId == b.minId && a.offset < b.offset);
+		});
+
+		m_Disjoint[i] = true;
+		for (std::size_t j = 1; j < r.size() && m_Disjoint[i]; ++j)
+			m_Disjoint[i] = r[j-1].maxId < r[j].minId;
+	}
+}
+
+} // namespace osmpbf
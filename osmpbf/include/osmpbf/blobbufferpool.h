@@ -0,0 +1,101 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OSMPBF_BLOBBUFFERPOOL_H
+#define OSMPBF_BLOBBUFFERPOOL_H
+
+#include <osmpbf/typelimits.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace osmpbf
+{
+
+/**
+  * Thread-safe pool of decompression buffers.
+  *
+  * Buffers are handed out in power of two size classes from MIN_BUFFER_SIZE up to MAX_BUFFER_SIZE,
+  * released buffers are kept for reuse as long as the pool caches less than maxCachedBytes.
+  * Larger requests are served by the system allocator. With hugePages buffers of at least
+  * HUGE_PAGE_SIZE are mapped with transparent huge pages (Linux only).
+  *
+  * BlobFileIn draws the buffers of BlobDataBuffers from a pool (defaultPool() unless set otherwise),
+  * a buffer returns to its pool when the BlobDataBuffer is cleared or destroyed.
+  * A pool has to outlive all buffers drawn from it.
+  */
+class BlobBufferPool
+{
+public:
+	static constexpr uint32_t MIN_BUFFER_SIZE = 64 << 10;
+	static constexpr uint32_t MAX_BUFFER_SIZE = 32 << 20;
+	static constexpr uint32_t HUGE_PAGE_SIZE = 2 << 20;
+	static constexpr int CLASS_COUNT = 10;
+public:
+	explicit BlobBufferPool(SizeType maxCachedBytes = 256 << 20, bool hugePages = false);
+	BlobBufferPool(const BlobBufferPool & other) = delete;
+	BlobBufferPool & operator=(const BlobBufferPool & other) = delete;
+	virtual ~BlobBufferPool();
+public:
+	///buffer of at least @size bytes, its actual size is stored in @capacity
+	char * allocate(uint32_t size, uint32_t & capacity);
+	///give back @data of @capacity bytes obtained from allocate()
+	void release(char * data, uint32_t capacity);
+
+	///free all cached buffers
+	void trim();
+
+	inline bool hugePages() const { return m_HugePages; }
+	inline SizeType maxCachedBytes() const { return m_MaxCachedBytes; }
+	inline SizeType cachedBytes() const { return m_CachedBytes; }
+	///number of allocations served from the cache
+	inline uint64_t hits() const { return m_Hits; }
+	///number of allocations served by the system
+	inline uint64_t misses() const { return m_Misses; }
+
+	///process-wide pool, never destroyed
+	static BlobBufferPool & defaultPool();
+private:
+	struct SizeClass {
+		std::mutex lock;
+		std::vector<char *> buffers;
+	};
+private:
+	///smallest size class holding @size bytes or -1 if @size is too large
+	static int sizeClass(uint32_t size);
+	static inline uint32_t classSize(int sizeClass) { return MIN_BUFFER_SIZE << sizeClass; }
+
+	char * allocateChunk(uint32_t size);
+	void freeChunk(char * data, uint32_t size);
+private:
+	std::array<SizeClass, CLASS_COUNT> m_Classes;
+	SizeType m_MaxCachedBytes;
+	bool m_HugePages;
+	std::atomic<SizeType> m_CachedBytes;
+	std::atomic<uint64_t> m_Hits;
+	std::atomic<uint64_t> m_Misses;
+};
+
+} // namespace osmpbf
+
+#endif // OSMPBF_BLOBBUFFERPOOL_H
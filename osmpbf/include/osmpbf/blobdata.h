@@ -21,6 +21,10 @@
 #ifndef OSMPBF_BLOBDATA_H
 #define OSMPBF_BLOBDATA_H
 
+#include <osmpbf/typelimits.h>
+#include <osmpbf/memorybudget.h>
+#include <osmpbf/blobbufferpool.h>
+
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -28,24 +32,69 @@
 namespace osmpbf {
 	enum BlobDataType {BLOB_Invalid = 0, BLOB_OSMHeader = 1, BLOB_OSMData = 2};
 
+	/**
+	 * Reference to a still compressed blob inside the memory mapped input file.
+	 * data points to the complete serialized blob (length prefix, BlobHeader and Blob)
+	 * and stays valid as long as the BlobFileIn it was read from is open.
+	 */
+	struct RawBlobRef {
+		BlobDataType type;
+		///offset of the blob in the input file
+		SizeType offset;
+		const char * data;
+		///total number of bytes of the serialized blob
+		uint32_t length;
+
+		RawBlobRef() : type(BLOB_Invalid), offset(0), data(NULL), length(0) {}
+	};
+
 	struct BlobDataBuffer {
 		BlobDataType type;
 		char * data;
 		uint32_t availableBytes;
 		uint32_t totalBytes;
+		///pool data was drawn from, NULL if it was allocated with new[]
+		BlobBufferPool * pool;
+		///budget totalBytes are charged to, NULL if not charged
+		MemoryBudget * budget;
+		uint32_t chargedBytes;
+
+		///charge totalBytes to @target (replacing a previous charge), released by clear() or uncharge()
+		inline void charge(MemoryBudget * target) {
+			uncharge();
+			if (target) {
+				target->acquire(totalBytes);
+				budget = target;
+				chargedBytes = totalBytes;
+			}
+		}
+
+		inline void uncharge() {
+			if (budget)
+				budget->release(chargedBytes);
+			budget = NULL;
+			chargedBytes = 0;
+		}
 
 		inline void clear() {
-			delete[] data;
+			uncharge();
+			if (pool)
+				pool->release(data, totalBytes);
+			else
+				delete[] data;
 			data = NULL;
+			pool = NULL;
 			availableBytes = 0;
 			totalBytes = 0;
 			type = BLOB_Invalid;
 		}
 
-		BlobDataBuffer() : type(BLOB_Invalid), data(0), availableBytes(0), totalBytes(0) {}
+		BlobDataBuffer() : type(BLOB_Invalid), data(0), availableBytes(0), totalBytes(0), pool(NULL), budget(NULL), chargedBytes(0) {}
+		///copies are not charged
 		BlobDataBuffer(const BlobDataBuffer & other) :
 			type(BLOB_Invalid), data(NULL),
-			availableBytes(other.availableBytes), totalBytes(other.availableBytes)
+			availableBytes(other.availableBytes), totalBytes(other.availableBytes),
+			pool(NULL), budget(NULL), chargedBytes(0)
 		{
 			if (totalBytes) {
 				data = new char[totalBytes];
@@ -56,12 +105,16 @@ namespace osmpbf {
 
 		BlobDataBuffer(BlobDataBuffer && other) :
 			type(other.type), data(other.data),
-			availableBytes(other.availableBytes), totalBytes(other.availableBytes)
+			availableBytes(other.availableBytes), totalBytes(other.totalBytes),
+			pool(other.pool), budget(other.budget), chargedBytes(other.chargedBytes)
 		{
 			other.type = BLOB_Invalid;
 			other.data = 0;
 			other.availableBytes = 0;
 			other.totalBytes = 0;
+			other.pool = NULL;
+			other.budget = NULL;
+			other.chargedBytes = 0;
 		}
 
 		~BlobDataBuffer() { clear(); }
@@ -88,11 +141,17 @@ namespace osmpbf {
 			totalBytes = other.totalBytes;
 			type = other.type;
 			data = other.data;
+			pool = other.pool;
+			budget = other.budget;
+			chargedBytes = other.chargedBytes;
 
 			other.data = NULL;
 			other.availableBytes = 0;
 			other.totalBytes = 0;
 			other.type = BLOB_Invalid;
+			other.pool = NULL;
+			other.budget = NULL;
+			other.chargedBytes = 0;
 
 			return *this;
 		}
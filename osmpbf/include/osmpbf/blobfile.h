@@ -33,6 +33,24 @@
 namespace osmpbf
 {
 
+/**
+ * Compression used for blobs written by BlobFileOut.
+ * lz4 and zstd are only available if the library was built with
+ * OSMPBF_WITH_LZ4 or OSMPBF_WITH_ZSTD respectively.
+ */
+enum BlobCompression {COMPRESSION_None = 0, COMPRESSION_Zlib = 1, COMPRESSION_Lz4 = 2, COMPRESSION_Zstd = 3};
+
+///limits of the serialized BlobHeader and Blob messages
+constexpr uint32_t MAX_BLOB_HEADER_SIZE = 64 << 10;
+constexpr uint32_t MAX_BLOB_BODY_SIZE = 32 << 20;
+
+/**
+ * Decode a serialized Blob message (the part following the BlobHeader) into @buffer, thread-safe.
+ * Buffer space is drawn from @pool, or allocated with new[] if it is NULL. buffer.type is not set.
+ * @return false if the blob is invalid or uses an unsupported compression
+ */
+bool decodeBlob(const char * data, uint32_t length, BlobDataBuffer & buffer, BlobBufferPool * pool);
+
 class AbstractBlobFile
 {
 public:
@@ -64,6 +82,10 @@ class BlobFileIn : public AbstractBlobFile
 {
 public:
 	explicit BlobFileIn(const std::string & fileName);
+	///read from the caller-owned memory @data of @size bytes, which has to stay valid and unchanged while the file is open
+	BlobFileIn(const char * data, SizeType size);
+	///read from the open @fileDescriptor (e.g. a memfd) by mapping it, the descriptor is not closed
+	explicit BlobFileIn(int fileDescriptor);
 	virtual ~BlobFileIn();
 
 	virtual bool open() override;
@@ -71,26 +93,71 @@ public:
 
 	///Only makes sense in single-thread usage
 	virtual void seek(OffsetType position) override;
-	///Only makes sense in single-thread usage
+	///thread-safe, but concurrent reads move the position at any time
 	virtual SizeType position() const override;
 
 	virtual SizeType size() const override;
+
+	///blobs starting at or after @end are not read, clamped to size(). open() resets it to size(). Not thread-safe
+	void setEnd(SizeType end);
+	inline SizeType end() const { return m_EndPos; }
+
+	/**
+	 * offset of the first OSMData blob starting at or after @position, size() if there is none.
+	 * A blob is recognized by the serialized start of its BlobHeader and confirmed by the blob
+	 * following it. Thread-safe, does not move the position.
+	 */
+	SizeType findBlob(SizeType position) const;
+
+	///pool the data of BlobDataBuffers is drawn from, NULL to allocate with new[]. Defaults to BlobBufferPool::defaultPool().
+	///Not thread-safe, the pool has to outlive all buffers read
+	inline void setBufferPool(BlobBufferPool * pool) { m_BufferPool = pool; }
+	inline BlobBufferPool * bufferPool() const { return m_BufferPool; }
 	
 	///thread-safe
 	void readBlob(BlobDataBuffer & buffer);
+	///thread-safe, @rawBlob is set to the still compressed source of @buffer
+	void readBlob(BlobDataBuffer & buffer, RawBlobRef & rawBlob);
 	///thread-safe
 	BlobDataType readBlob(char * & buffer, uint32_t & bufferSize, uint32_t & availableDataSize);
 
+	///thread-safe, reads the next blob without decompressing it
+	bool readRawBlob(RawBlobRef & rawBlob);
+
+	/**
+	 * read the blob starting at @offset (see RawBlobRef::offset) without moving the position, thread-safe.
+	 * @param next set to the offset of the following blob if not NULL
+	 * @return false if there is no valid blob at @offset
+	 */
+	bool readBlobAt(SizeType offset, BlobDataBuffer & buffer, SizeType * next = NULL) const;
+
 	///Only makes sense in single-thread usage
 	bool skipBlob();
 
 protected:
+	enum Source {SOURCE_Path, SOURCE_Descriptor, SOURCE_Memory};
+
+	Source m_Source;
+	///caller-owned data of SOURCE_Memory
+	const char * m_MemoryData;
+	SizeType m_MemorySize;
+
 	char * m_FileData;
-	std::mutex m_fileLock;
+	mutable std::mutex m_fileLock;
 	SizeType m_FilePos;
 	SizeType m_FileSize;
+	SizeType m_EndPos;
+	BlobBufferPool * m_BufferPool;
 
 	void readBlobHeader(uint32_t & blobLength, BlobDataType & blobDataType);
+	///locate the Blob message of the blob at @position without moving the position, false if there is no valid blob
+	bool blobAt(SizeType position, BlobDataType & type, SizeType & body, uint32_t & bodyLength) const;
+	///@bufferOwner pool @buffer was drawn from (NULL for new[]), new buffers are drawn from m_BufferPool and update it.
+	///If @bufferOwner is NULL, buffers are always allocated with new[]
+	BlobDataType readBlob(char * & buffer, uint32_t & bufferSize, uint32_t & availableDataSize, RawBlobRef * rawBlob, BlobBufferPool ** bufferOwner);
+
+	///close m_FileDescriptor if it was opened by open()
+	void closeDescriptor();
 
 	void * fileData();
 	void * fileData(SizeType _position);
@@ -113,11 +180,29 @@ public:
 
 	virtual SizeType size() const override;
 
+	///@return true if @compression is supported by this build of the library
+	static bool compressionSupported(BlobCompression compression);
+
+	/**
+	 * set the compression used for blobs written with compress = true,
+	 * default is zlib with Z_BEST_COMPRESSION
+	 *
+	 * @param level codec specific compression level, a negative value selects the codec's default
+	 * @return false if @compression is not supported or @level exceeds the maximum of the codec
+	 *         (9 for zlib, LZ4HC_CLEVEL_MAX for lz4, ZSTD_maxCLevel() for zstd), the previous setting is kept in that case
+	 */
+	bool setCompression(BlobCompression compression, int level = -1);
+	inline BlobCompression compression() const { return m_Compression; }
+
 	bool writeBlob(const BlobDataBuffer & buffer, bool compress = true);
 	bool writeBlob(BlobDataType type, const char * buffer, uint32_t bufferSize, bool compress = true);
+	///copy a blob read by BlobFileIn verbatim without recompressing it
+	bool writeRawBlob(const RawBlobRef & rawBlob);
 
 protected:
 	SizeType m_CurrentSize;
+	BlobCompression m_Compression;
+	int m_CompressionLevel;
 
 private:
 	BlobFileOut() = delete;
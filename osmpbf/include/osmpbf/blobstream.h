@@ -0,0 +1,115 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OSMPBF_BLOBSTREAM_H
+#define OSMPBF_BLOBSTREAM_H
+
+#include <osmpbf/blobdata.h>
+#include <osmpbf/typelimits.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace osmpbf
+{
+
+/**
+  * Reads length prefixed blobs from a file descriptor that does not have to be seekable or
+  * mmap-able (pipes, stdin, sockets).
+  *
+  * A read-ahead thread reads the still compressed blobs into buffers of the buffer pool, at most
+  * readAhead of them are queued. readBlob() takes the next queued blob and decompresses it outside
+  * of the lock, so concurrent readers decompress in parallel (blocks may not be in order then).
+  *
+  * The descriptor is not closed by BlobStreamIn. The destructor waits for the read-ahead thread,
+  * which finishes a pending read() first: close the writing end of a pipe to stop it early.
+  */
+class BlobStreamIn
+{
+public:
+	///@param readAhead maximum number of compressed blobs queued, at least one
+	///@param pool pool compressed and decompressed buffers are drawn from, NULL to allocate with new[]
+	explicit BlobStreamIn(int fileDescriptor, uint32_t readAhead = 16, BlobBufferPool * pool = &BlobBufferPool::defaultPool());
+	BlobStreamIn(const BlobStreamIn & other) = delete;
+	BlobStreamIn & operator=(const BlobStreamIn & other) = delete;
+	virtual ~BlobStreamIn();
+public:
+	/**
+	 * thread-safe, buffer.type is BLOB_Invalid at the end of the input or on errors.
+	 * A blob that fails to decode sets failed() and ends the input: check failed() after a scan
+	 * to tell a complete scan from a partial one.
+	 */
+	void readBlob(BlobDataBuffer & buffer);
+
+	///thread-safe, waits until the next blob has been read or the end of the input is reached
+	bool hasNext() const;
+
+	///bytes of the blobs handed out by readBlob(), thread-safe
+	SizeType position() const;
+	///bytes read from the descriptor so far, thread-safe
+	SizeType bytesRead() const;
+
+	///true if reading stopped because of invalid input, a blob that failed to decode or a read error, thread-safe
+	bool failed() const;
+
+	inline uint32_t readAhead() const { return m_ReadAhead; }
+	inline BlobBufferPool * bufferPool() const { return m_BufferPool; }
+private:
+	///compressed blob as read from the descriptor
+	struct Chunk {
+		BlobDataType type;
+		///serialized Blob message in data[0, availableBytes)
+		BlobDataBuffer data;
+		///bytes of the blob in the input (length prefix, header and body)
+		uint32_t length;
+
+		Chunk() : type(BLOB_Invalid), length(0) {}
+	};
+private:
+	void run();
+	///read exactly @count bytes, returns the number of bytes read before the end of the input
+	SizeType readFully(char * buffer, SizeType count);
+	///read the next blob, returns false at the end of the input or on errors (setting m_Failed)
+	bool readChunk(Chunk & chunk, std::string & headerData);
+private:
+	int m_FileDescriptor;
+	uint32_t m_ReadAhead;
+	BlobBufferPool * m_BufferPool;
+
+	mutable std::mutex m_Lock;
+	mutable std::condition_variable m_NotEmpty;
+	std::condition_variable m_NotFull;
+	std::deque<Chunk> m_Queue;
+	SizeType m_Position;
+	SizeType m_BytesRead;
+	bool m_EndOfInput;
+	bool m_Failed;
+	bool m_Stop;
+
+	std::thread m_Reader;
+};
+
+} // namespace osmpbf
+
+#endif // OSMPBF_BLOBSTREAM_H
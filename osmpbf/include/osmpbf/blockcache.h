@@ -0,0 +1,171 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OSMPBF_BLOCKCACHE_H
+#define OSMPBF_BLOCKCACHE_H
+
+#include <osmpbf/blobdata.h>
+#include <osmpbf/primitiveblockinputadaptor.h>
+#include <osmpbf/typelimits.h>
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace osmpbf
+{
+
+class BlobFileIn;
+
+/**
+  * Byte-bounded LRU cache of decompressed blocks of a BlobFileIn, keyed by blob offset.
+  *
+  * For random access workloads that visit the same blobs again and again: a hit returns the
+  * decompressed buffer (and optionally the parsed PrimitiveBlockInputAdaptor) without inflating
+  * or parsing it again. Misses are read with BlobFileIn::readBlobAt().
+  *
+  * The cache is split into independently locked shards by offset. Every shard evicts its least
+  * recently used blocks once it holds more than capacity / shardCount bytes, but always keeps the
+  * block just inserted. Blocks handed out stay valid after their eviction.
+  *
+  * A parsed adaptor is charged with the size of the decompressed block again as an estimate.
+  * Adaptors are not thread-safe, an AdaptorRef therefore locks its adaptor while it is held.
+  *
+  * The file has to be open and outlive the cache. All functions are thread-safe.
+  */
+class BlockCache
+{
+public:
+	typedef std::shared_ptr<const BlobDataBuffer> BufferPtr;
+
+	///exclusive reference to a cached adaptor, the adaptor is locked until the reference is destroyed
+	class AdaptorRef
+	{
+	public:
+		AdaptorRef() {}
+		AdaptorRef(AdaptorRef && other) = default;
+		///unlocks the previous adaptor before releasing it
+		AdaptorRef & operator=(AdaptorRef && other)
+		{
+			m_Lock = std::move(other.m_Lock);
+			m_Slot = std::move(other.m_Slot);
+			return *this;
+		}
+
+		inline bool isNull() const { return !m_Slot; }
+		inline PrimitiveBlockInputAdaptor & operator*() const { return m_Slot->adaptor; }
+		inline PrimitiveBlockInputAdaptor * operator->() const { return &m_Slot->adaptor; }
+	private:
+		friend class BlockCache;
+		struct Slot {
+			std::mutex lock;
+			PrimitiveBlockInputAdaptor adaptor;
+			bool parsed;
+
+			Slot() : parsed(false) {}
+		};
+		typedef std::shared_ptr<Slot> SlotPtr;
+
+		explicit AdaptorRef(const SlotPtr & slot) : m_Slot(slot), m_Lock(slot->lock) {}
+		///null if @slot is locked by another reference
+		AdaptorRef(const SlotPtr & slot, std::try_to_lock_t) : m_Slot(slot), m_Lock(slot->lock, std::try_to_lock)
+		{
+			if (!m_Lock.owns_lock())
+				m_Slot.reset();
+		}
+
+		//declared before m_Lock, the lock is released first
+		SlotPtr m_Slot;
+		std::unique_lock<std::mutex> m_Lock;
+	};
+public:
+	///@capacity number of bytes, @shardCount number of independently locked shards (at least one)
+	BlockCache(BlobFileIn * file, SizeType capacity, uint32_t shardCount = 16);
+	BlockCache(const BlockCache & other) = delete;
+	BlockCache & operator=(const BlockCache & other) = delete;
+	virtual ~BlockCache();
+public:
+	///decompressed blob at @offset, NULL if there is no valid blob
+	BufferPtr buffer(SizeType offset);
+	///parsed block of the blob at @offset, null if there is no valid blob
+	AdaptorRef adaptor(SizeType offset);
+	///like adaptor(), but null instead of waiting if the adaptor is held by another reference
+	AdaptorRef tryAdaptor(SizeType offset);
+
+	///drop all blocks
+	void clear();
+
+	inline SizeType capacity() const { return m_Capacity; }
+	///bytes of the cached blocks
+	SizeType usedBytes() const;
+	///number of cached blocks
+	std::size_t size() const;
+
+	inline uint64_t hits() const { return m_Hits.load(); }
+	inline uint64_t misses() const { return m_Misses.load(); }
+	inline uint64_t evictions() const { return m_Evictions.load(); }
+private:
+	struct Entry {
+		SizeType offset;
+		BufferPtr buffer;
+		AdaptorRef::SlotPtr adaptor;
+		SizeType bytes;
+	};
+	typedef std::list<Entry> EntryList;
+
+	struct Shard {
+		mutable std::mutex lock;
+		///most recently used first
+		EntryList entries;
+		std::unordered_map<SizeType, EntryList::iterator> index;
+		SizeType bytes;
+
+		Shard() : bytes(0) {}
+	};
+private:
+	inline Shard & shard(SizeType offset) { return m_Shards[std::hash<SizeType>()(offset) % m_Shards.size()]; }
+	///entry of @offset moved to the front of @shard, NULL if there is none. @shard has to be locked
+	Entry * find(Shard & shard, SizeType offset);
+	///entry of @offset, inserting @buffer if there is none. @shard has to be locked
+	Entry * insert(Shard & shard, SizeType offset, const BufferPtr & buffer);
+	///evict from the back of @shard until it fits, sparing the front entry. @shard has to be locked
+	void evict(Shard & shard);
+	///read the blob at @offset, NULL on errors
+	BufferPtr read(SizeType offset);
+	///see adaptor() and tryAdaptor()
+	AdaptorRef lockAdaptor(SizeType offset, bool wait);
+private:
+	BlobFileIn * m_File;
+	SizeType m_Capacity;
+	SizeType m_ShardCapacity;
+	std::vector<Shard> m_Shards;
+
+	std::atomic<uint64_t> m_Hits;
+	std::atomic<uint64_t> m_Misses;
+	std::atomic<uint64_t> m_Evictions;
+};
+
+} // namespace osmpbf
+
+#endif // OSMPBF_BLOCKCACHE_H
@@ -0,0 +1,245 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OSMPBF_COMPILEDFILTER_H
+#define OSMPBF_COMPILEDFILTER_H
+
+#include <osmpbf/filter.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+  * A CompiledFilter is a filter dag (see filter.h) lowered to a flat program.
+  *
+  * Inner nodes (and, or, not) become jumps on a single accumulator.
+  * Tag filters become leaves of a bitset: when a PrimitiveBlockInputAdaptor is bound,
+  * the string table is scanned once and every string gets a key mask and a value mask
+  * of the leaves it satisfies. Matching a primitive is then a single pass over its
+  * tags (hits |= keyMask[key] & valueMask[value]) followed by the program.
+  *
+  * The filter classes stay the construction API; filters without a compiled form
+  * are evaluated through a private copy of the original filter.
+  *
+  * The lowered program (CompiledFilterProgram) is immutable and shared by all copies,
+  * a CompiledFilter only holds the binding to the current block.
+  * Like filters, a CompiledFilter is NOT thread-safe, but copying one is cheap:
+  * use one copy per thread instead of copying the filter dag.
+  */
+
+namespace osmpbf
+{
+
+class CompiledFilter;
+
+///Immutable, thread-safe program of a CompiledFilter
+class CompiledFilterProgram
+{
+public:
+	explicit CompiledFilterProgram(const RCFilterPtr & filter);
+	CompiledFilterProgram(const CompiledFilterProgram & other) = delete;
+	CompiledFilterProgram & operator=(const CompiledFilterProgram & other) = delete;
+public:
+	///number of instructions in the program
+	inline std::size_t programSize() const { return m_Program.size(); }
+	///number of tag leaves in the program
+	inline std::size_t leafCount() const { return m_Leaves.size(); }
+	///number of sub filters evaluated through their original implementation
+	inline std::size_t fallbackCount() const { return m_Fallbacks.size(); }
+protected:
+	friend class CompiledFilter;
+
+	enum Opcode : uint8_t {
+		///acc = arg
+		OP_Const,
+		///acc = primitive.type() & arg
+		OP_Type,
+		///acc = leaf arg has a matching tag
+		OP_Leaf,
+		///acc = fallback arg matches
+		OP_Call,
+		///acc = !acc
+		OP_Not,
+		///if (!acc) goto arg
+		OP_JumpIfFalse,
+		///if (acc) goto arg
+		OP_JumpIfTrue,
+		///acc = primitive is a node inside location filter arg
+		OP_Location
+	};
+
+	struct Instruction {
+		Opcode op;
+		uint32_t arg;
+		Instruction(Opcode op, uint32_t arg) : op(op), arg(arg) {}
+	};
+
+	///matching rule of a single tag leaf, key and value have to match on the same tag
+	struct Leaf {
+		enum KeyMatch : uint8_t {KEY_Any, KEY_Set, KEY_Regex};
+		enum ValueMatch : uint8_t {VALUE_Any, VALUE_Set, VALUE_Int, VALUE_Regex, VALUE_Numeric};
+
+		KeyMatch keyMatch;
+		ValueMatch valueMatch;
+		///shared with the original filter and thus its memo
+		RegexMatcherPtr regex;
+		long intValue;
+		NumericTagFilter::Comparison comparison;
+		double minValue;
+		double maxValue;
+
+		Leaf() : keyMatch(KEY_Set), valueMatch(VALUE_Any), intValue(0), comparison(NumericTagFilter::CMP_Equal), minValue(0), maxValue(0) {}
+	};
+
+	typedef std::vector<Instruction> Program;
+	typedef std::vector<uint64_t> MaskVector;
+	typedef std::unordered_map<std::string, std::vector<uint32_t> > StringLeafMap;
+protected:
+	void emit(const AbstractTagFilter * filter);
+	void emitOr(const AbstractMultiTagFilter::FilterList & children, bool isAnd);
+	uint32_t addLeaf(const Leaf & leaf);
+	void addKey(uint32_t leaf, const std::string & key);
+	void addValue(uint32_t leaf, const std::string & value);
+
+	inline const AbstractLocationFilter * location(uint32_t index) const { return static_cast<const AbstractLocationFilter *>(m_Locations[index].get()); }
+
+	///OR the bits of all leaves accepting @str as key into @keyMask
+	void keyMask(const std::string & str, uint64_t * keyMask) const;
+	///OR the bits of all leaves accepting @str as value into @valueMask
+	void valueMask(const std::string & str, uint64_t * valueMask) const;
+protected:
+	Program m_Program;
+	std::vector<Leaf> m_Leaves;
+	///unbound originals of the fallback filters, every CompiledFilter works on its own copies
+	std::vector<RCFilterPtr> m_Fallbacks;
+	///unbound copies of the location filters, only their thread-safe const interface is used
+	std::vector<RCFilterPtr> m_Locations;
+	bool m_Monotone;
+
+	StringLeafMap m_KeyLeaves;
+	StringLeafMap m_ValueLeaves;
+	std::vector<uint32_t> m_RegexKeyLeaves;
+	std::vector<uint32_t> m_RegexValueLeaves;
+	std::vector<uint32_t> m_IntValueLeaves;
+	std::vector<uint32_t> m_NumericValueLeaves;
+	MaskVector m_AnyKeyMask;
+	MaskVector m_AnyValueMask;
+	uint32_t m_MaskWords;
+};
+
+typedef std::shared_ptr<const CompiledFilterProgram> CompiledFilterProgramPtr;
+
+class CompiledFilter
+{
+public:
+	CompiledFilter();
+	explicit CompiledFilter(const RCFilterPtr & filter);
+	explicit CompiledFilter(const CompiledFilterProgramPtr & program);
+	///shares the program of @other, the binding is not copied
+	CompiledFilter(const CompiledFilter & other);
+	CompiledFilter(CompiledFilter && other) = default;
+	virtual ~CompiledFilter();
+
+	CompiledFilter & operator=(const CompiledFilter & other);
+	CompiledFilter & operator=(CompiledFilter && other) = default;
+public:
+	///lower @filter, replaces any previously compiled program
+	void compile(const RCFilterPtr & filter);
+	///use @program, replaces any previously compiled program
+	void setProgram(const CompiledFilterProgramPtr & program);
+	inline const CompiledFilterProgramPtr & program() const { return m_Program; }
+
+	///assign an input adaptor, the string table is bound lazily
+	void assignInputAdaptor(const PrimitiveBlockInputAdaptor * pbi);
+	///bind the assigned input adaptor.
+	///Returns true if there may exist a matching primitive in the currently assigned input adaptor
+	bool rebuildCache();
+
+	///return true if the primitive matches the filter
+	bool matches(const IPrimitive & primitive);
+
+	/**
+	 * evaluate all primitives of @type (NodePrimitive, WayPrimitive or RelationPrimitive) in @pbi at once.
+	 * Tags are read straight from the primitive groups (keys_vals for dense nodes), primitives without
+	 * tags relevant to the filter are decided without running the program.
+	 * Assigns @pbi to this filter.
+	 */
+	BlockSelection evaluateBlock(PrimitiveBlockInputAdaptor & pbi, PrimitiveType type);
+public:
+	inline std::size_t programSize() const { return m_Program->programSize(); }
+	inline std::size_t leafCount() const { return m_Program->leafCount(); }
+	inline std::size_t fallbackCount() const { return m_Program->fallbackCount(); }
+protected:
+	typedef CompiledFilterProgram::MaskVector MaskVector;
+protected:
+	void bind();
+
+	///compute m_Hits for @primitive
+	void collectHits(const IPrimitive & primitive);
+	inline void clearHits()
+	{
+		for (uint32_t w = 0; w < m_MaskWords; ++w)
+			m_Hits[w] = 0;
+	}
+	inline void addHits(uint32_t keyId, uint32_t valueId, std::size_t stringCount)
+	{
+		if (keyId >= stringCount || valueId >= stringCount)
+			return;
+
+		const uint64_t * keyMask = m_KeyMasks.data() + keyId * m_MaskWords;
+		const uint64_t * valueMask = m_ValueMasks.data() + valueId * m_MaskWords;
+		for (uint32_t w = 0; w < m_MaskWords; ++w)
+			m_Hits[w] |= keyMask[w] & valueMask[w];
+	}
+	inline bool hasHits() const
+	{
+		uint64_t any = 0;
+		for (uint32_t w = 0; w < m_MaskWords; ++w)
+			any |= m_Hits[w];
+		return any;
+	}
+	///run the program, hits are collected from @primitive on demand or taken from m_Hits if it is NULL.
+	///Without @primitive location filters are looked up at m_NodeIndex of m_LocationSelections
+	bool execute(PrimitiveType type, const IPrimitive * primitive);
+	bool mayMatch();
+protected:
+	CompiledFilterProgramPtr m_Program;
+	std::vector<RCFilterPtr> m_Fallbacks;
+	///copy of m_Program->m_MaskWords
+	uint32_t m_MaskWords;
+
+	const PrimitiveBlockInputAdaptor * m_PBI;
+	PrimitiveBlockInputAdaptor::IdType m_pbiId;
+	///per string id masks of the bound block, m_MaskWords entries each
+	MaskVector m_KeyMasks;
+	MaskVector m_ValueMasks;
+	MaskVector m_Hits;
+	MaskVector m_Scratch;
+	///per location filter results of the nodes of the block in evaluateBlock
+	std::vector<BlockSelection> m_LocationSelections;
+	std::size_t m_NodeIndex;
+};
+
+} // namespace osmpbf
+
+#endif // OSMPBF_COMPILEDFILTER_H
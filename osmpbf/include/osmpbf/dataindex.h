@@ -41,6 +41,7 @@ public:
 	DenseNodesData & operator=(const DenseNodesData & other);
 
 	inline crosby::binary::PrimitiveGroup * group() { return m_Group; }
+	inline const crosby::binary::PrimitiveGroup * group() const { return m_Group; }
 	inline bool isDataUnpacked() const { return m_DataUnpacked; }
 
 	inline int queryDenseNodeKeyValIndex(int index)
@@ -0,0 +1,148 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OSMPBF_EXECUTOR_H
+#define OSMPBF_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace osmpbf
+{
+
+class TaskGroup;
+
+/**
+  * Persistent pool of worker threads with work-stealing.
+  *
+  * Every worker owns a deque: tasks submitted from inside a worker are pushed to its own deque
+  * and popped LIFO, idle workers steal the oldest tasks from other deques. Tasks submitted from
+  * other threads go to a shared queue.
+  *
+  * One executor can be shared by independent scans, see the parse helpers taking an Executor.
+  * Tasks must not throw. Tasks may create TaskGroups themselves; waiting on them executes
+  * pending tasks of the waited group instead of blocking the worker.
+  *
+  * The destructor finishes all queued tasks before joining the workers.
+  *
+  * With pinWorkers every worker is bound to one cpu (Linux only). Consecutive workers are spread over the
+  * sockets, so the blob buffers a worker reuses (see the parse helpers) are allocated on its own memory node.
+  */
+class Executor
+{
+public:
+	typedef std::function<void()> Task;
+public:
+	///@threadCount if this is set to zero then this will default to max(std::thread::hardware_concurrency(), 1)
+	///@pinWorkers bind every worker to a single cpu of the process' affinity mask
+	explicit Executor(uint32_t threadCount = 0, bool pinWorkers = false);
+	Executor(const Executor & other) = delete;
+	Executor & operator=(const Executor & other) = delete;
+	virtual ~Executor();
+public:
+	inline uint32_t threadCount() const { return (uint32_t) m_Threads.size(); }
+	///cpu worker @index is bound to or -1 if it is not pinned
+	inline int workerCpu(uint32_t index) const { return m_WorkerCpus.empty() ? -1 : m_WorkerCpus[index]; }
+
+	///queue @task, thread-safe
+	void submit(Task task);
+
+	///run a single queued task of any group on the calling thread, thread-safe.
+	///Returns false if no task was queued
+	bool runPendingTask();
+
+	///index of the calling worker of this executor or -1 if called from another thread
+	int currentWorker() const;
+
+	///process-wide executor with max(std::thread::hardware_concurrency(), 1) workers, created on first use
+	static Executor & defaultExecutor();
+private:
+	friend class TaskGroup;
+
+	struct QueuedTask {
+		Task task;
+		///group the task was submitted by, NULL for plain submissions
+		const TaskGroup * group;
+	};
+
+	struct TaskQueue {
+		std::mutex lock;
+		std::deque<QueuedTask> tasks;
+	};
+private:
+	void submit(Task task, const TaskGroup * group);
+	///run a single queued task of @group on the calling thread, see TaskGroup::wait()
+	bool runGroupTask(const TaskGroup * group);
+
+	void work(uint32_t index);
+	///pop a task of @group, any task if @group is NULL
+	bool popTask(int worker, Task & task, const TaskGroup * group);
+private:
+	///one deque per worker, the last one is the queue of external submissions
+	std::vector< std::unique_ptr<TaskQueue> > m_Queues;
+	std::vector<std::thread> m_Threads;
+	///empty if the workers are not pinned
+	std::vector<int> m_WorkerCpus;
+
+	std::mutex m_SleepLock;
+	std::condition_variable m_WakeUp;
+	///number of queued, not yet started tasks
+	std::atomic<uint64_t> m_Queued;
+	bool m_Stop;
+};
+
+/**
+  * Set of tasks running on an Executor which can be waited for.
+  * wait() executes pending tasks of this group on the calling thread instead of idling,
+  * so it can be called from inside of tasks. Tasks of other groups are never run by it:
+  * a waiting task does not get stuck in unrelated (possibly long running) work.
+  */
+class TaskGroup
+{
+public:
+	explicit TaskGroup(Executor & executor);
+	TaskGroup(const TaskGroup & other) = delete;
+	TaskGroup & operator=(const TaskGroup & other) = delete;
+	///waits for all tasks
+	virtual ~TaskGroup();
+public:
+	inline Executor & executor() { return m_Executor; }
+
+	///run @task on the executor, thread-safe
+	void run(Executor::Task task);
+	///wait until all tasks of this group are done
+	void wait();
+private:
+	Executor & m_Executor;
+	std::atomic<uint32_t> m_Pending;
+	std::mutex m_Lock;
+	std::condition_variable m_Done;
+};
+
+} // namespace osmpbf
+
+#endif // OSMPBF_EXECUTOR_H
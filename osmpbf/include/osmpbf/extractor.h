@@ -0,0 +1,133 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OSMPBF_EXTRACTOR_H
+#define OSMPBF_EXTRACTOR_H
+
+#include <osmpbf/blobdata.h>
+#include <osmpbf/compiledfilter.h>
+#include <osmpbf/idbitset.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace osmpbf
+{
+
+class BlobFileIn;
+class Executor;
+class PrimitiveBlockInputAdaptor;
+
+/**
+  * Extracts all primitives matching a filter into a referentially complete file.
+  *
+  * The input is read in several parallel passes over the blobs (each thread maps the file on its own):
+  *  1. primitives matching the filter are selected, relation -> sub relation edges are recorded
+  *  2. the selection is closed over sub relations (in memory)
+  *  3. member ways and nodes of the selected relations are selected (relation blobs only)
+  *  4. nodes referenced by the selected ways are selected (way blobs only)
+  *  5. the output is written in input order: blobs without selected primitives are dropped,
+  *     completely selected blobs are copied verbatim, all others are re-encoded
+  *
+  * Selections are kept in IdBitSets, about 1 bit per id of the id range in use.
+  * Members not present in the input are silently missing in the output.
+  */
+class Extractor
+{
+public:
+	explicit Extractor(const std::string & inputFileName);
+	virtual ~Extractor();
+public:
+	inline void setFilter(const RCFilterPtr & filter) { m_Filter = filter; }
+	inline const RCFilterPtr & filter() const { return m_Filter; }
+
+	///@threadCount if this is set to zero then this will default to the thread count of the executor
+	///or max(std::thread::hardware_concurrency(), 1) without one
+	inline void setThreadCount(uint32_t threadCount) { m_ThreadCount = threadCount; }
+	///run the passes as tasks on @executor instead of spawning threads for every pass, NULL to spawn threads
+	inline void setExecutor(Executor * executor) { m_Executor = executor; }
+	inline void setVerboseOutput(bool value) { m_VerboseOutput = value; }
+
+	///run all passes and write the result to @outputFileName
+	bool run(const std::string & outputFileName);
+
+	///selected primitives of the last run
+	inline const IdBitSet & nodes() const { return m_Nodes; }
+	inline const IdBitSet & ways() const { return m_Ways; }
+	inline const IdBitSet & relations() const { return m_Relations; }
+
+	///blob statistics of the last run
+	inline uint32_t copiedBlobs() const { return m_CopiedBlobs; }
+	inline uint32_t encodedBlobs() const { return m_EncodedBlobs; }
+	inline uint32_t droppedBlobs() const { return m_DroppedBlobs; }
+protected:
+	struct BlobInfo {
+		RawBlobRef raw;
+		bool hasWays;
+		bool hasRelations;
+
+		BlobInfo() : hasWays(true), hasRelations(true) {}
+	};
+
+	///called per data blob with the index of the blob, the parsed block and the thread index
+	typedef std::function<void(std::size_t, PrimitiveBlockInputAdaptor &, uint32_t)> BlobProcessor;
+	///called with the index of a blob @processor is not run on, and whether the blob failed to decode
+	typedef std::function<void(std::size_t, bool)> BlobSkipHandler;
+protected:
+	bool scan(BlobFileIn & inFile);
+	/**
+	 * run @processor for all data blobs accepted by @predicate on m_ThreadCount threads or tasks.
+	 * Every blob taken by a thread is either processed or passed to @skipped (rejected, empty or
+	 * failed to decode). No further blobs are taken after a failure.
+	 */
+	bool forEachBlob(const std::function<bool(const BlobInfo &)> & predicate, const BlobProcessor & processor,
+		const BlobSkipHandler & skipped = BlobSkipHandler());
+
+	bool selectMatching();
+	void closeRelations();
+	bool selectRelationMembers();
+	bool selectWayRefs();
+	bool write(const std::string & outputFileName);
+protected:
+	std::string m_InputFileName;
+	RCFilterPtr m_Filter;
+	Executor * m_Executor;
+	uint32_t m_ThreadCount;
+	bool m_VerboseOutput;
+
+	std::vector<BlobInfo> m_Blobs;
+	RawBlobRef m_HeaderBlob;
+	///relation -> sub relation edges of pass 1
+	std::vector< std::pair<int64_t, int64_t> > m_SubRelations;
+
+	IdBitSet m_Nodes;
+	IdBitSet m_Ways;
+	IdBitSet m_Relations;
+
+	uint32_t m_CopiedBlobs;
+	uint32_t m_EncodedBlobs;
+	uint32_t m_DroppedBlobs;
+};
+
+} // namespace osmpbf
+
+#endif // OSMPBF_EXTRACTOR_H
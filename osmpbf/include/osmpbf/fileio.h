@@ -22,6 +22,8 @@ int close(int fd);
 
 SignedSizeType lseek(int fd, osmpbf::OffsetType offset, int whence);
 
+SignedSizeType read(int fd, void * buffer, SizeType count);
+
 SignedSizeType write(int fd, const void * buffer, SizeType count);
 
 ///@param protection expects a combination of MmapProtections
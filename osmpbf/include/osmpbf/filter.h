@@ -23,17 +23,24 @@
 
 #include <osmpbf/common_input.h>
 #include "primitiveblockinputadaptor.h"
+#include "regexmatcher.h"
 
 #include <generics/macros.h>
 #include <generics/refcountobject.h>
 
-#include <forward_list>
+#include <iosfwd>
 #include <string>
 #include <set>
+#include <vector>
 #include <unordered_set>
 #include <unordered_map>
 #include <regex>
 
+#ifdef OSMPBF_FILTER_PROFILING
+#include <atomic>
+#include <memory>
+#endif
+
 /**
   * Filters do what their name suggests.
   * They take as input a primitive and return if the primitive matches the filter specification
@@ -51,7 +58,10 @@
   * You can use the CopyFilterPtr class to handle filter dags with copy-semantic (useful when dealing with multi-threading)
   * Use the RCFilterPtr if reference counting semantics is good enough
   * 
-  * 
+  * If the library is built with OSMPBF_FILTER_PROFILING every filter node counts its matches() calls,
+  * true results, cache rebuilds and the time spent in matches(). Copies of a dag share the counters
+  * of their original, so the statistics of all thread-local copies add up. Use dumpProfile() to
+  * print the dag annotated with these statistics. Without the flag the counters do not exist.
   */
 
 namespace osmpbf
@@ -64,11 +74,19 @@ class ConstantReturnFilter;
 class PrimitiveTypeFilter;
 class BoolTagFilter;
 class IntTagFilter;
+class NumericTagFilter;
 class KeyOnlyTagFilter;
 class KeyValueTagFilter;
 class KeyMultiValueTagFilter;
 class MultiKeyMultiValueTagFilter;
 class RegexKeyTagFilter;
+class RegexValueTagFilter;
+class AbstractLocationFilter;
+class BBoxNodeFilter;
+class PolygonNodeFilter;
+
+///Result of a whole block evaluation: one entry per primitive of the requested type in stream order
+typedef std::vector<bool> BlockSelection;
 
 template<class OSMInputPrimitive>
 int findTag(const OSMInputPrimitive & primitive, uint32_t keyId, uint32_t valueId);
@@ -82,6 +100,20 @@ bool hasTag(const OSMInputPrimitive & primitive, uint32_t keyId, uint32_t valueI
 template<class OSMInputPrimitive>
 bool hasKey(const OSMInputPrimitive & primitive, uint32_t keyId);
 
+///Evaluation statistics of a single filter node, see OSMPBF_FILTER_PROFILING
+struct FilterProfile {
+	///number of matches() calls
+	uint64_t calls;
+	///number of matches() calls returning true
+	uint64_t hits;
+	///number of cache rebuilds
+	uint64_t rebuilds;
+	///time spent in matches(), including child nodes
+	uint64_t nanoseconds;
+
+	FilterProfile() : calls(0), hits(0), rebuilds(0), nanoseconds(0) {}
+};
+
 ///This is the base class for all filters
 class AbstractTagFilter : public generics::RefCountObject
 {
@@ -89,7 +121,17 @@ public:
 	AbstractTagFilter();
 	virtual ~AbstractTagFilter();
 	///Create a deep copy of the filter dag. This does not copy assigned PrimitiveBlockInputAdaptors.
+	///The copy shares the profiling counters of this dag
 	AbstractTagFilter * copy() const;
+public:
+	///true if the library was built with OSMPBF_FILTER_PROFILING
+	static bool profilingEnabled();
+	///statistics of this node summed over all copies, thread-safe. All zero without OSMPBF_FILTER_PROFILING
+	FilterProfile profile() const;
+	///reset the statistics of this node and all copies
+	void resetProfile();
+	///print the dag below this node annotated with the statistics of every node
+	void dumpProfile(std::ostream & out) const;
 public:
 	///assign an input adaptor to allow for faster filter due to caches
 	virtual void assignInputAdaptor(const PrimitiveBlockInputAdaptor * pbi);
@@ -99,6 +141,8 @@ public:
 public:
 	///return true if the primitive matches the filter
 	bool matches(const IPrimitive & primitive);
+	///evaluate all primitives of @type (NodePrimitive, WayPrimitive or RelationPrimitive) in @pbi
+	BlockSelection evaluateBlock(PrimitiveBlockInputAdaptor & pbi, PrimitiveType type);
 protected:
 	typedef std::unordered_map<const AbstractTagFilter*, AbstractTagFilter*> CopyMap;
 	///sub classes need to implement the private matches function
@@ -109,12 +153,65 @@ protected:
 	///Usually this can be achieved using copies[this] = MyFilter();
 	virtual AbstractTagFilter * copy(AbstractTagFilter::CopyMap & copies) const = 0;
 	AbstractTagFilter * copy(AbstractTagFilter * other, AbstractTagFilter::CopyMap & copies) const;
+protected:
+	///count a cache rebuild, to be called by all rebuildCache() implementations
+	inline void profileRebuild()
+	{
+#ifdef OSMPBF_FILTER_PROFILING
+		m_Profile->rebuilds.fetch_add(1, std::memory_order_relaxed);
+#endif
+	}
+#ifdef OSMPBF_FILTER_PROFILING
+private:
+	struct ProfileCounters {
+		std::atomic<uint64_t> calls;
+		std::atomic<uint64_t> hits;
+		std::atomic<uint64_t> rebuilds;
+		std::atomic<uint64_t> nanoseconds;
+		ProfileCounters() : calls(0), hits(0), rebuilds(0), nanoseconds(0) {}
+	};
+private:
+	std::shared_ptr<ProfileCounters> m_Profile;
+#endif
 };
 
+/**
+  * Base class of AndTagFilter and OrTagFilter.
+  * Children are evaluated in order until one of them decides the result (rejects for and, passes for or).
+  * Each child keeps counters of how often it was evaluated and decided the result
+  * and a cost estimate sampled from every SAMPLE_INTERVAL-th evaluation.
+  * Every reorderInterval() blocks the children are sorted by cost / p(decisive),
+  * so the cheapest, most selective children run first.
+  */
 class AbstractMultiTagFilter : public AbstractTagFilter
 {
 public:
-	AbstractMultiTagFilter() : AbstractTagFilter() {}
+	typedef std::vector<AbstractTagFilter *> FilterList;
+
+	struct ChildStats {
+		///number of evaluations
+		uint64_t evaluations;
+		///number of evaluations that decided the result of the parent
+		uint64_t decisive;
+		///number of timed evaluations
+		uint64_t samples;
+		///total time of the timed evaluations in nanoseconds
+		uint64_t sampledNanoseconds;
+
+		ChildStats() : evaluations(0), decisive(0), samples(0), sampledNanoseconds(0) {}
+
+		///estimated cost of a single evaluation in nanoseconds, 0 if unknown
+		inline double cost() const { return samples ? double(sampledNanoseconds) / samples : 0.0; }
+		///estimated probability that an evaluation decides the result
+		inline double decisiveRate() const { return (decisive + 1.0) / (evaluations + 2.0); }
+	};
+	typedef std::vector<ChildStats> ChildStatsList;
+
+	///every SAMPLE_INTERVAL-th evaluation of a child is timed
+	static constexpr uint64_t SAMPLE_INTERVAL = 64;
+	static constexpr uint32_t DEFAULT_REORDER_INTERVAL = 16;
+public:
+	AbstractMultiTagFilter();
 	virtual ~AbstractMultiTagFilter();
 public:
 	virtual void assignInputAdaptor(const PrimitiveBlockInputAdaptor * pbi) override;
@@ -122,11 +219,32 @@ public:
 	AbstractTagFilter * addChild(AbstractTagFilter * child);
 	template<typename T_ABSTRACT_TAG_FILTER_ITERATOR>
 	void addChildren(T_ABSTRACT_TAG_FILTER_ITERATOR begin, const T_ABSTRACT_TAG_FILTER_ITERATOR & end);
+	///children in their current evaluation order
+	const FilterList & children() const;
+
+	///per child counters, same order as children()
+	const ChildStatsList & childStats() const;
+	void resetChildStats();
+
+	///reorder children every @blocks blocks, 0 disables reordering
+	void setReorderInterval(uint32_t blocks);
+	uint32_t reorderInterval() const;
+	///sort children by their estimated cost / p(decisive)
+	void reorderChildren();
 protected:
-	typedef std::forward_list<AbstractTagFilter *> FilterList;
 	virtual AbstractTagFilter* copy(CopyMap& copies) const override = 0;
+	///copy children and settings into @other
+	void copyChildren(AbstractMultiTagFilter * other, CopyMap & copies) const;
+	///count blocks and reorder children if due, call once per p_matches
+	void observe(const IPrimitive & primitive);
+	///evaluate child @index and update its counters
+	bool evaluateChild(std::size_t index, const IPrimitive & primitive, bool decisiveResult);
 protected:
 	FilterList m_Children;
+	ChildStatsList m_ChildStats;
+	uint32_t m_ReorderInterval;
+	uint32_t m_BlockCount;
+	PrimitiveBlockInputAdaptor::IdType m_LastBlock;
 };
 
 ///This class handles cache consistency for filters with caches
@@ -341,6 +459,7 @@ public:
 	KeyMultiValueTagFilter & operator<<(const std::string & value);
 	KeyMultiValueTagFilter & operator<<(const char * value);
 	void clearValues();
+	const ValueSet & values() const;
 protected:
 	virtual AbstractTagFilter * copy(AbstractTagFilter::CopyMap & copies) const override;
 protected:
@@ -372,6 +491,7 @@ public:
 	MultiKeyTagFilter & operator<<(const std::string & value);
 	MultiKeyTagFilter & operator<<(const char * value);
 	void clearValues();
+	const ValueSet & keys() const;
 protected:
 	virtual AbstractTagFilter * copy(AbstractTagFilter::CopyMap & copies) const override;
 protected:
@@ -386,14 +506,15 @@ protected:
 ///A multiple keys, multiple-values filter
 class MultiKeyMultiValueTagFilter : public AbstractTagFilter
 {
+public:
+	typedef std::unordered_map<std::string, std::unordered_set<std::string> > ValueMap;
 public:
 	MultiKeyMultiValueTagFilter();
 public:
 	template<typename T_STRING_ITERATOR>
 	void addValues(const std::string & key, const T_STRING_ITERATOR & begin, const T_STRING_ITERATOR & end);
 	void clearValues();
-protected:
-	typedef std::unordered_map<std::string, std::unordered_set<std::string> > ValueMap;
+	const ValueMap & valueMap() const;
 protected:
 	virtual bool p_matches(const IPrimitive & primitive) override;
 	virtual AbstractTagFilter * copy(AbstractTagFilter::CopyMap & copies) const override;
@@ -401,7 +522,7 @@ protected:
 	ValueMap m_ValueMap;
 };
 
-///A regex based key filter.
+///A regex based key filter. Match results are memoized in a RegexMatcher shared with all copies.
 class RegexKeyTagFilter : public AbstractTagFilterWithCache
 {
 public:
@@ -416,17 +537,150 @@ public:
 	void setRegex(const T_OCTET_ITERATOR & begin, const T_OCTET_ITERATOR & end, std::regex_constants::match_flag_type flags = std::regex_constants::match_default);
 	void setRegex(const std::regex & regex, std::regex_constants::match_flag_type flags = std::regex_constants::match_default);
 	void setRegex(const std::string & regexString, std::regex_constants::match_flag_type flags = std::regex_constants::match_default);
+	const std::regex & regex() const;
+	std::regex_constants::match_flag_type matchFlags() const;
+	const RegexMatcherPtr & matcher() const;
+protected:
+	RegexKeyTagFilter(const RegexMatcherPtr & matcher);
 protected:
 	virtual bool p_rebuildCache() override;
 	virtual bool p_cached_match(const IPrimitive & primitive) override;
 	virtual bool p_uncached_match(const IPrimitive & primitive) override;
 	virtual AbstractTagFilter * copy(AbstractTagFilter::CopyMap & copies) const override;
 protected:
-	std::regex m_regex;
-	std::regex_constants::match_flag_type m_matchFlags;
+	RegexMatcherPtr m_Matcher;
+	std::unordered_set<int> m_IdSet;
+};
+
+/**
+  * A regex based value filter. If @key is not empty only values of that key are tested.
+  * Match results are memoized in a RegexMatcher shared with all copies.
+  */
+class RegexValueTagFilter : public AbstractTagFilterWithCache
+{
+public:
+	RegexValueTagFilter(const std::string & key, const std::string & regexString, std::regex_constants::match_flag_type flags = std::regex_constants::match_default);
+	RegexValueTagFilter(const std::string & key, const std::regex & regex, std::regex_constants::match_flag_type flags = std::regex_constants::match_default);
+	virtual ~RegexValueTagFilter();
+public:
+	void setKey(const std::string & key);
+	const std::string & key() const;
+	void setRegex(const std::regex & regex, std::regex_constants::match_flag_type flags = std::regex_constants::match_default);
+	void setRegex(const std::string & regexString, std::regex_constants::match_flag_type flags = std::regex_constants::match_default);
+	const std::regex & regex() const;
+	std::regex_constants::match_flag_type matchFlags() const;
+	const RegexMatcherPtr & matcher() const;
+protected:
+	RegexValueTagFilter(const std::string & key, const RegexMatcherPtr & matcher);
+protected:
+	virtual bool p_rebuildCache() override;
+	virtual bool p_cached_match(const IPrimitive & primitive) override;
+	virtual bool p_uncached_match(const IPrimitive & primitive) override;
+	virtual AbstractTagFilter * copy(AbstractTagFilter::CopyMap & copies) const override;
+protected:
+	std::string m_Key;
+	RegexMatcherPtr m_Matcher;
+	int m_KeyId;
 	std::unordered_set<int> m_IdSet;
-private:
-	RegexKeyTagFilter(std::regex_constants::match_flag_type flags);
+};
+
+/**
+  * Base of filters deciding nodes by their location only, ways and relations never match.
+  * The bounding box is converted into the raw coordinate space of the assigned block once,
+  * nodes outside of it are rejected without converting their coordinates.
+  * The const interface is thread-safe.
+  */
+class AbstractLocationFilter : public AbstractTagFilterWithCache
+{
+public:
+	AbstractLocationFilter();
+	virtual ~AbstractLocationFilter();
+public:
+	///test WGS84 coordinates in nanodegrees (see INode::lati()) which are inside the bounding box
+	virtual bool containsi(int64_t lat, int64_t lon) const = 0;
+	bool contains(const INode & node) const;
+
+	/**
+	 * append the result of every node in @pbi to @selection in stream order.
+	 * Coordinates are read straight from the primitive groups and tested in batches in raw block space.
+	 */
+	void evaluateNodes(const PrimitiveBlockInputAdaptor & pbi, BlockSelection & selection) const;
+
+	///bounding box of all matching locations in nanodegrees, empty if minLat > maxLat
+	inline int64_t minLat() const { return m_MinLat; }
+	inline int64_t minLon() const { return m_MinLon; }
+	inline int64_t maxLat() const { return m_MaxLat; }
+	inline int64_t maxLon() const { return m_MaxLon; }
+protected:
+	///bounding box in the raw coordinate space of a block
+	struct RawBounds {
+		int64_t minLat;
+		int64_t minLon;
+		int64_t maxLat;
+		int64_t maxLon;
+		inline bool empty() const { return minLat > maxLat || minLon > maxLon; }
+		inline bool contains(int64_t lat, int64_t lon) const { return lat >= minLat && lat <= maxLat && lon >= minLon && lon <= maxLon; }
+	};
+protected:
+	///true if every location inside the bounding box matches
+	virtual bool boundsExact() const = 0;
+	void setBoundsi(int64_t minLat, int64_t minLon, int64_t maxLat, int64_t maxLon);
+	RawBounds rawBounds(const PrimitiveBlockInputAdaptor & pbi) const;
+	///test @count absolute raw coordinates of @pbi
+	void evaluateRaw(const PrimitiveBlockInputAdaptor & pbi, const RawBounds & bounds,
+		const int64_t * lat, const int64_t * lon, std::size_t count, BlockSelection & selection) const;
+protected:
+	virtual bool p_rebuildCache() override;
+	virtual bool p_cached_match(const IPrimitive & primitive) override;
+	virtual bool p_uncached_match(const IPrimitive & primitive) override;
+protected:
+	int64_t m_MinLat;
+	int64_t m_MinLon;
+	int64_t m_MaxLat;
+	int64_t m_MaxLon;
+	RawBounds m_RawBounds;
+};
+
+///Matches nodes inside a bounding box (inclusive), coordinates are given in degrees
+class BBoxNodeFilter : public AbstractLocationFilter
+{
+public:
+	BBoxNodeFilter(double minLat, double minLon, double maxLat, double maxLon);
+	virtual ~BBoxNodeFilter();
+public:
+	void setBounds(double minLat, double minLon, double maxLat, double maxLon);
+	virtual bool containsi(int64_t lat, int64_t lon) const override;
+protected:
+	virtual bool boundsExact() const override;
+	virtual AbstractTagFilter * copy(AbstractTagFilter::CopyMap & copies) const override;
+};
+
+/**
+  * Matches nodes inside a polygon given as rings of (lat, lon) pairs in degrees.
+  * Rings are combined with the even-odd rule, so inner rings cut holes.
+  * Nodes exactly on an edge may be inside or outside.
+  */
+class PolygonNodeFilter : public AbstractLocationFilter
+{
+public:
+	typedef std::vector< std::pair<double, double> > Ring;
+public:
+	PolygonNodeFilter();
+	explicit PolygonNodeFilter(const Ring & ring);
+	virtual ~PolygonNodeFilter();
+public:
+	void addRing(const Ring & ring);
+	void clearRings();
+	inline std::size_t ringCount() const { return m_Rings.size(); }
+	virtual bool containsi(int64_t lat, int64_t lon) const override;
+protected:
+	typedef std::vector< std::pair<int64_t, int64_t> > RingI;
+protected:
+	virtual bool boundsExact() const override;
+	virtual AbstractTagFilter * copy(AbstractTagFilter::CopyMap & copies) const override;
+	void updateBounds();
+protected:
+	std::vector<RingI> m_Rings;
 };
 
 /** Check for a @key that matches boolean value @value. Evaluates to false if key is not available */
@@ -467,6 +721,63 @@ protected:
 	uint32_t m_ValueId;
 };
 
+/**
+  * Compare the numeric value of @key, e.g. maxspeed < 50 or ele between 100 and 200.
+  * Values have to be plain decimal numbers ("50", "-3", "7.5", "1e3"), everything else
+  * (units, ranges, lists) does not match.
+  *
+  * Every distinct value string of a block is parsed at most once, the parsed values
+  * are cached until the next block. Use cachedNumber() on matches to avoid parsing again.
+  */
+class NumericTagFilter : public KeyOnlyTagFilter
+{
+public:
+	enum Comparison {
+		CMP_Less, CMP_LessEqual, CMP_Equal, CMP_NotEqual, CMP_GreaterEqual, CMP_Greater,
+		///minValue <= value <= maxValue
+		CMP_Between
+	};
+public:
+	NumericTagFilter(const std::string & key, Comparison comparison, double value);
+	///matches values in [@minValue, @maxValue]
+	NumericTagFilter(const std::string & key, double minValue, double maxValue);
+public:
+	void setComparison(Comparison comparison, double value);
+	void setRange(double minValue, double maxValue);
+
+	inline Comparison comparison() const { return m_Comparison; }
+	///value for all comparisons but CMP_Between
+	inline double value() const { return m_MinValue; }
+	inline double minValue() const { return m_MinValue; }
+	inline double maxValue() const { return m_MaxValue; }
+
+	///return true if @value satisfies the comparison
+	bool accepts(double value) const;
+
+	///numeric value of string @stringId of the assigned block, parses it on first use.
+	///Returns false if the string is not a number
+	bool cachedNumber(uint32_t stringId, double & value);
+
+	///parse a plain decimal number, surrounding whitespace is ignored
+	static bool parseNumber(const std::string & str, double & value);
+	static bool compare(Comparison comparison, double value, double minValue, double maxValue);
+protected:
+	enum ParseState : uint8_t {PARSE_Pending, PARSE_Number, PARSE_NaN};
+protected:
+	virtual bool p_rebuildCache() override;
+	virtual bool p_cached_match(const IPrimitive & primitive) override;
+	virtual bool p_uncached_match(const IPrimitive & primitive) override;
+	virtual AbstractTagFilter * copy(AbstractTagFilter::CopyMap & copies) const override;
+protected:
+	Comparison m_Comparison;
+	double m_MinValue;
+	double m_MaxValue;
+
+	///per string id of the assigned block
+	std::vector<ParseState> m_ParseStates;
+	std::vector<double> m_Values;
+};
+
 AndTagFilter * newAnd(AbstractTagFilter * a, AbstractTagFilter * b);
 OrTagFilter * newOr(AbstractTagFilter * a, AbstractTagFilter * b);
 
@@ -556,14 +867,12 @@ void MultiKeyMultiValueTagFilter::addValues(const std::string& key, const T_STRI
 
 template<typename T_OCTET_ITERATOR>
 RegexKeyTagFilter::RegexKeyTagFilter(const T_OCTET_ITERATOR & begin, const T_OCTET_ITERATOR & end, std::regex_constants::match_flag_type flags) :
-m_regex(begin, end),
-m_matchFlags(flags)
+m_Matcher(new RegexMatcher(std::string(begin, end), flags))
 {}
 
 template<typename T_OCTET_ITERATOR>
 void RegexKeyTagFilter::setRegex(const T_OCTET_ITERATOR & begin, const T_OCTET_ITERATOR & end, std::regex_constants::match_flag_type flags) {
-	m_regex.assign(begin, end);
-	m_matchFlags = flags;
+	m_Matcher.reset(new RegexMatcher(std::string(begin, end), flags));
 	markDirty();
 }
 
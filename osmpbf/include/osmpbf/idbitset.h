@@ -0,0 +1,77 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OSMPBF_IDBITSET_H
+#define OSMPBF_IDBITSET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace osmpbf
+{
+
+/**
+  * Compact set of primitive ids.
+  *
+  * Ids are stored as bits in pages of 2^PAGE_BITS ids, pages are only allocated
+  * once an id inside of them is inserted. Negative ids (as used by editors for new
+  * primitives) live in their own page table.
+  *
+  * Reading is thread-safe, inserting is not: fill one set per thread and merge them.
+  */
+class IdBitSet
+{
+public:
+	static constexpr int PAGE_BITS = 16;
+	static constexpr std::size_t PAGE_WORDS = (std::size_t(1) << PAGE_BITS) / 64;
+public:
+	IdBitSet();
+public:
+	///@return true if @id was not in the set before
+	bool insert(int64_t id);
+	bool count(int64_t id) const;
+
+	///add all ids of @other
+	void merge(const IdBitSet & other);
+
+	///number of ids in the set
+	inline std::size_t size() const { return m_Size; }
+	inline bool empty() const { return !m_Size; }
+
+	void clear();
+private:
+	typedef std::vector<uint64_t> Page;
+	typedef std::vector<Page> PageTable;
+private:
+	inline static uint64_t index(int64_t id) { return id < 0 ? uint64_t(-(id + 1)) : uint64_t(id); }
+	inline PageTable & pages(int64_t id) { return id < 0 ? m_NegativePages : m_Pages; }
+	inline const PageTable & pages(int64_t id) const { return id < 0 ? m_NegativePages : m_Pages; }
+
+	std::size_t merge(PageTable & target, const PageTable & source);
+private:
+	PageTable m_Pages;
+	PageTable m_NegativePages;
+	std::size_t m_Size;
+};
+
+} // namespace osmpbf
+
+#endif // OSMPBF_IDBITSET_H
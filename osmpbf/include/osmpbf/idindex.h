@@ -0,0 +1,143 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OSMPBF_IDINDEX_H
+#define OSMPBF_IDINDEX_H
+
+#include <osmpbf/common.h>
+#include <osmpbf/typelimits.h>
+#include <osmpbf/primitiveblockinputadaptor.h>
+#include <osmpbf/blockcache.h>
+#include <osmpbf/inode.h>
+#include <osmpbf/iway.h>
+#include <osmpbf/irelation.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace osmpbf
+{
+
+class OSMFileIn;
+
+/**
+  * Maps id ranges to blob offsets, separately for nodes, ways and relations.
+  *
+  * Every blob contributes the smallest and largest id of each primitive type it contains.
+  * For files sorted by type and id (as written by all common tools) the ranges of a type
+  * are disjoint and a lookup is a binary search yielding at most one blob. Otherwise all
+  * blobs whose range contains the id are candidates.
+  *
+  * The index is built in one parallel pass over the file and can be saved next to it.
+  * The saved format is in host byte order and records the size of the file it was built for.
+  *
+  * A built or loaded index is immutable, lookups are thread-safe.
+  */
+class IdIndex
+{
+public:
+	struct BlobRange {
+		int64_t minId;
+		int64_t maxId;
+		///offset of the blob in the file, see BlobFileIn::readBlobAt()
+		SizeType offset;
+	};
+public:
+	IdIndex();
+	virtual ~IdIndex();
+public:
+	///build the index over all blobs of @inFile, which is reset before and after the pass.
+	///@threadCount if this is set to zero then this will default to max(std::thread::hardware_concurrency(), 1)
+	bool build(OSMFileIn & inFile, uint32_t threadCount = 0);
+
+	bool save(const std::string & fileName) const;
+	bool load(const std::string & fileName);
+
+	void clear();
+	inline bool empty() const { return m_Ranges[0].empty() && m_Ranges[1].empty() && m_Ranges[2].empty(); }
+
+	///size of the file the index was built for
+	inline SizeType fileSize() const { return m_FileSize; }
+
+	///@type NodePrimitive, WayPrimitive or RelationPrimitive
+	inline const std::vector<BlobRange> & ranges(PrimitiveType type) const { return m_Ranges[typeIndex(type)]; }
+	///true if the ranges of @type do not overlap (the file is sorted)
+	inline bool disjoint(PrimitiveType type) const { return m_Disjoint[typeIndex(type)]; }
+
+	///offsets of the blobs which may contain @id of @type, in file order
+	void candidates(PrimitiveType type, int64_t id, std::vector<SizeType> & offsets) const;
+private:
+	static inline std::size_t typeIndex(PrimitiveType type) { return type == NodePrimitive ? 0 : (type == WayPrimitive ? 1 : 2); }
+	///sort the ranges by id and compute m_Disjoint
+	void finish();
+private:
+	std::vector<BlobRange> m_Ranges[3];
+	bool m_Disjoint[3];
+	SizeType m_FileSize;
+};
+
+/**
+  * Primitive looked up by id, see OSMFileIn::findNode(). Keeps the block it was decoded from alive.
+  * Null if the id was not found. Like the block, it is not thread-safe.
+  *
+  * A primitive of a block shared by a BlockCache holds the lock of the cached adaptor (see BlockCache::AdaptorRef)
+  * until it is destroyed, so release it early.
+  */
+template<typename T_STREAM>
+class FoundPrimitive
+{
+public:
+	FoundPrimitive() {}
+	FoundPrimitive(const std::shared_ptr<PrimitiveBlockInputAdaptor> & block, const T_STREAM & primitive) :
+		m_Block(block), m_Primitive(new T_STREAM(primitive)) {}
+	FoundPrimitive(BlockCache::AdaptorRef && block, const T_STREAM & primitive) :
+		m_CachedBlock(std::move(block)), m_Primitive(new T_STREAM(primitive)) {}
+	FoundPrimitive(FoundPrimitive && other) = default;
+	FoundPrimitive & operator=(FoundPrimitive && other)
+	{
+		//release the primitive before the block it refers to
+		m_Primitive = std::move(other.m_Primitive);
+		m_CachedBlock = std::move(other.m_CachedBlock);
+		m_Block = std::move(other.m_Block);
+		return *this;
+	}
+
+	inline bool isNull() const { return !m_Primitive || m_Primitive->isNull(); }
+
+	inline T_STREAM & operator*() const { return *m_Primitive; }
+	inline T_STREAM * operator->() const { return m_Primitive.get(); }
+
+	inline PrimitiveBlockInputAdaptor & block() const { return m_Block ? *m_Block : *m_CachedBlock; }
+private:
+	//declared before m_Primitive, the primitive is destroyed first. Only one of them is set
+	std::shared_ptr<PrimitiveBlockInputAdaptor> m_Block;
+	BlockCache::AdaptorRef m_CachedBlock;
+	std::unique_ptr<T_STREAM> m_Primitive;
+};
+
+typedef FoundPrimitive<INodeStream> FoundNode;
+typedef FoundPrimitive<IWayStream> FoundWay;
+typedef FoundPrimitive<IRelationStream> FoundRelation;
+
+} // namespace osmpbf
+
+#endif // OSMPBF_IDINDEX_H
@@ -37,6 +37,8 @@ class INode : public IPrimitive
 public:
 	explicit INode(AbstractNodeInputAdaptor * data);
 	INode(const INode & other);
+	///@other has to be a node, i.e. other.type() == NodePrimitive
+	explicit INode(const IPrimitive & other);
 
 	INode & operator=(const INode & other);
 
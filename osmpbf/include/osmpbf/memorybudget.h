@@ -0,0 +1,85 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OSMPBF_MEMORYBUDGET_H
+#define OSMPBF_MEMORYBUDGET_H
+
+#include <osmpbf/typelimits.h>
+
+#include <condition_variable>
+#include <mutex>
+
+namespace osmpbf
+{
+
+/**
+  * Byte budget for decompressed blocks which are read but not yet processed.
+  *
+  * The size of a block is only known after it has been decompressed, so the budget works as
+  * admission control: readers call waitForSpace() before reading the next block and charge it
+  * afterwards with acquire(), consumers release() the bytes when they are done with the block.
+  * Blocks are never refused, the budget can thus be exceeded by at most one block per reader.
+  *
+  * Readers have to make sure not to wait while holding charged blocks themselves, the parse helpers
+  * (see parsehelpers.h) stop fetching further blocks instead.
+  *
+  * A BlobDataBuffer charged to a budget releases its bytes automatically, see BlobDataBuffer::charge().
+  * All functions are thread-safe.
+  */
+class MemoryBudget
+{
+public:
+	///@capacity number of bytes, zero is treated as one byte (one block at a time)
+	explicit MemoryBudget(SizeType capacity);
+	MemoryBudget(const MemoryBudget & other) = delete;
+	MemoryBudget & operator=(const MemoryBudget & other) = delete;
+	virtual ~MemoryBudget();
+public:
+	inline SizeType capacity() const { return m_Capacity; }
+
+	///bytes currently charged
+	SizeType used() const;
+	///maximum of used() since construction or the last resetPeak()
+	SizeType peak() const;
+	void resetPeak();
+	///number of times waitForSpace() had to block
+	SizeType waitCount() const;
+
+	///true if no more blocks should be read
+	bool exhausted() const;
+
+	///block until the budget is not exhausted anymore
+	void waitForSpace();
+	///charge @bytes, never blocks
+	void acquire(SizeType bytes);
+	///give back @bytes previously charged by acquire()
+	void release(SizeType bytes);
+private:
+	SizeType m_Capacity;
+	SizeType m_Used;
+	SizeType m_Peak;
+	SizeType m_WaitCount;
+	mutable std::mutex m_Lock;
+	std::condition_variable m_Released;
+};
+
+} // namespace osmpbf
+
+#endif // OSMPBF_MEMORYBUDGET_H
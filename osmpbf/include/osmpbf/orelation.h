@@ -0,0 +1,80 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OSMPBF_ORELATION_H
+#define OSMPBF_ORELATION_H
+
+#include <osmpbf/common.h>
+#include <osmpbf/abstractprimitiveoutputadaptor.h>
+#include <osmpbf/oprimitive.h>
+
+#include <cstdint>
+#include <string>
+
+namespace crosby {
+	namespace binary {
+		class Relation;
+	}
+}
+
+namespace osmpbf {
+	class PrimitiveBlockOutputAdaptor;
+
+	class RelationOutputAdaptor : public AbstractPrimitiveOutputAdaptor< crosby::binary::Relation > {
+	public:
+		RelationOutputAdaptor();
+		RelationOutputAdaptor(PrimitiveBlockOutputAdaptor * controller, crosby::binary::Relation * data);
+
+		virtual int membersSize() const;
+
+		virtual int64_t memberId(int index) const;
+		virtual PrimitiveType memberType(int index) const;
+		virtual const std::string & memberRole(int index) const;
+
+		virtual void addMember(int64_t id, PrimitiveType type, const std::string & role);
+
+		virtual void clearMembers();
+	};
+
+	class ORelation : public OPrimitive< RelationOutputAdaptor > {
+		friend class PrimitiveBlockOutputAdaptor;
+	public:
+		ORelation(const ORelation & other);
+
+		ORelation & operator=(const ORelation & other);
+
+		inline int membersSize() const { return m_Private->membersSize(); }
+
+		inline int64_t memberId(int index) const { return m_Private->memberId(index); }
+		inline PrimitiveType memberType(int index) const { return m_Private->memberType(index); }
+		inline const std::string & memberRole(int index) const { return m_Private->memberRole(index); }
+
+		///@type is one of NodePrimitive, WayPrimitive or RelationPrimitive
+		inline void addMember(int64_t id, PrimitiveType type, const std::string & role) { m_Private->addMember(id, type, role); }
+
+		virtual void clearMembers();
+
+	protected:
+		ORelation();
+		ORelation(RelationOutputAdaptor * data);
+	};
+}
+
+#endif // OSMPBF_ORELATION_H
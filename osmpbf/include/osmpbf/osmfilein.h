@@ -24,6 +24,7 @@
 #include <osmpbf/blobdata.h>
 #include <osmpbf/typelimits.h>
 #include <osmpbf/pbf_prototypes.h>
+#include <osmpbf/idindex.h>
 
 #include <string>
 #include <vector>
@@ -46,6 +47,17 @@ public:
 	OSMFileIn & operator=(OSMFileIn && other);
 
 	bool open();
+	/**
+	 * open shard @shard of @shardCount: the data of the file is split into @shardCount byte ranges
+	 * of equal size, a shard reads the blobs starting inside its range. The range is moved to the
+	 * next blob boundary on both ends, so the shards of a file are disjoint and cover all blobs
+	 * without any coordination between the readers.
+	 * dataPosition() and dataSize() are relative to the shard.
+	 *
+	 * @param blobOffsets sorted file offsets of all blobs (see RawBlobRef::offset) if available,
+	 *        otherwise the boundaries are found by BlobFileIn::findBlob()
+	 */
+	bool openShard(uint32_t shard, uint32_t shardCount, const std::vector<SizeType> * blobOffsets = NULL);
 	void close();
 	void reset();
 	void dataSeek(OffsetType position);
@@ -67,18 +79,58 @@ public:
 	 */
 	bool getNextBlock(BlobDataBuffer & buffer);
 
+	/**
+	 * copy next block into data buffer and remember where its compressed
+	 * representation is located in the input file
+	 *
+	 * @param buffer target buffer
+	 * @param rawBlob reference to the still compressed blob, may be passed to BlobFileOut::writeRawBlob()
+	 */
+	bool getNextBlock(BlobDataBuffer & buffer, RawBlobRef & rawBlob);
+
 	/**
 	 * copy num blocks into data buffers
 	 * Thread-safety: blocks may not be in order
 	 *
 	 * @param buffers target container of buffers
 	 * @param num number of blocks to copy, set to -1 to copy all remaining blocks
+	 * @param budget if set, the buffers are charged to it (see MemoryBudget). Waits for space before
+	 *        the first block, fewer than @num blocks are copied if the budget gets exhausted. The
+	 *        buffers passed in are released before reading, the return value is false only if
+	 *        the end of the input was reached
 	 */
-	bool getNextBlocks(BlobDataMultiBuffer & buffers, int num);
+	bool getNextBlocks(BlobDataMultiBuffer & buffers, int num, MemoryBudget * budget = NULL);
 
 	///@param adaptor parse next block by @adaptor, not thread-safe
 	bool parseNextBlock(PrimitiveBlockInputAdaptor & adaptor);
 
+	///underlying blob file, e.g. for BlobFileIn::readBlobAt() or a BlockCache
+	inline BlobFileIn * blobFile() const { return m_FileIn; }
+
+	/**
+	 * use @index for findNode(), findWay() and findRelation(). The index is not owned and
+	 * has to outlive its use. Fails if it was built for a file of different size.
+	 */
+	bool setIdIndex(const IdIndex * index);
+	inline const IdIndex * idIndex() const { return m_IdIndex; }
+
+	/**
+	 * blocks are taken from @cache (not owned) in find*() if set, it has to be built on blobFile().
+	 * The parsed adaptor of the cache is used unless it is held by another FoundPrimitive, then a
+	 * private adaptor is parsed from the cached data instead of waiting for it
+	 */
+	inline void setBlockCache(BlockCache * cache) { m_BlockCache = cache; }
+	inline BlockCache * blockCache() const { return m_BlockCache; }
+
+	/**
+	 * look up a primitive by id through the IdIndex set by setIdIndex(), only the blobs which may
+	 * contain it are decoded. The result is null if there is no such primitive.
+	 * Thread-safe with respect to each other and independent of the sequential reading position.
+	 */
+	FoundNode findNode(int64_t id) const;
+	FoundWay findWay(int64_t id) const;
+	FoundRelation findRelation(int64_t id) const;
+
 	inline const BlobDataBuffer & blockBuffer() const { return m_DataBuffer; }
 	inline void clearBlockBuffer() { m_DataBuffer.clear(); }
 
@@ -117,7 +169,17 @@ protected:
 
 	SizeType m_DataOffset;
 
+	const IdIndex * m_IdIndex;
+	BlockCache * m_BlockCache;
+
 	bool parseHeader();
+	///decode the block of the blob at @offset for find*(), NULL on errors
+	std::shared_ptr<PrimitiveBlockInputAdaptor> readIndexedBlock(SizeType offset) const;
+	///@T_STREAM INodeStream, IWayStream or IRelationStream
+	template<typename T_STREAM>
+	FoundPrimitive<T_STREAM> find(int64_t id) const;
+	///first blob starting at or after @position
+	SizeType shardBoundary(SizeType position, const std::vector<SizeType> * blobOffsets) const;
 };
 
 } // namespace osmpbf
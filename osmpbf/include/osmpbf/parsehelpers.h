@@ -23,11 +23,17 @@
 
 #include <osmpbf/osmfilein.h>
 #include <osmpbf/primitiveblockinputadaptor.h>
+#include <osmpbf/executor.h>
+#include <osmpbf/memorybudget.h>
+#include <osmpbf/parseobserver.h>
 
 #include <mutex>
 #include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <thread>
 #include <type_traits>
+#include <vector>
 
 #if defined(_OPENMP)
 #include <omp.h>
@@ -66,52 +72,342 @@ namespace detail {
 
 ///@inFile currently either OSMFileIn or PbiStream
 ///@processor (osmpbf::PrimitiveBlockInputAdaptor & pbi)
+///@observer receives progress reports and may cancel the parse (see ParseObserver)
 template<typename TPBI_Processor, typename T_IN_DATA>
-void parseFile(T_IN_DATA & inFile, TPBI_Processor processor);
+void parseFile(T_IN_DATA & inFile, TPBI_Processor processor, ParseObserver * observer = NULL);
 
 ///@inFile currently either OSMFileIn or PbiStream
 ///@processor (osmpbf::PrimitiveBlockInputAdaptor & pbi)
-///@readBlobCount number of blobs to work on in parallel. If this is set to zero then this will default to max(omp_get_num_procs(), 1)
+///Every OpenMP thread fetches, inflates and processes one blob after another, so reading and processing overlap
+///and there is no barrier between blobs. @processor is shared by all threads. If its return value is not void, then the
+///processing stops for ALL threads if its evaluated to false
+///The number of threads is chosen by OpenMP (e.g. OMP_NUM_THREADS or omp_set_num_threads())
+///@readBlobCount number of blobs in flight, every thread fetches ceil(@readBlobCount / threads) blobs before processing them.
+///If this is set to zero then this will default to max(omp_get_num_procs(), 1)
+///@budget limits the decompressed blobs read ahead (see MemoryBudget)
+///@observer see parseFile
 template<typename TPBI_Processor, typename T_IN_DATA>
-void parseFileOmp(T_IN_DATA & inFile, TPBI_Processor processor, uint32_t readBlobCount = 0);
+void parseFileOmp(T_IN_DATA & inFile, TPBI_Processor processor, uint32_t readBlobCount = 0, MemoryBudget * budget = NULL, ParseObserver * observer = NULL);
 
 ///@warning processor is passed by value! Pass a pointer to avoid copying
 ///@inFile currently either OSMFileIn or PbiStream
 ///@processor (osmpbf::PrimitiveBlockInputAdaptor & pbi) if the return value is not void, then the processing stops for ALL processors if its evaluated to false
 ///Every thread hold its own PrimitiveBlockInputAdaptor. You can set threadPrivateProcessor to true to always get the same pbi on a per-thread/@processor basis
 ///@threadCount if this is set to zero then this will default to max(omp_get_num_procs(), 1) or max(std::thread::hardware_concurrency(), 1)
-///@readBlobCount number of blobs a single thread fetches to work upon before fetching new blobs
+///@readBlobCount number of blobs a single thread fetches to work upon before fetching new blobs.
+///A thread keeps the buffer of its first blob for the next batch and releases the others after processing them
 ///@threadPrivateProcessor each thread will hold a copy of processor instead of sharing a single one
 ///@maxBlobsToRead maximum number of blobs to read
+///@budget limits the decompressed blobs fetched but not yet processed by all threads (see MemoryBudget).
+///Threads wait for space before fetching their first blob and fetch fewer than @readBlobCount blobs if it is exhausted
+///@observer receives progress reports and may cancel the parse (see ParseObserver), cancelling stops all threads
 ///@return number of blobs read
 template<typename TPBI_Processor, typename T_IN_DATA>
 uint32_t parseFileCPPThreads(T_IN_DATA & inFile, TPBI_Processor processor,
 							uint32_t threadCount = 0,
 							uint32_t readBlobCount = 1,
 							bool threadPrivateProcessor = false,
-							uint32_t maxBlobsToRead = 0xFFFFFFFF
+							uint32_t maxBlobsToRead = 0xFFFFFFFF,
+							MemoryBudget * budget = NULL,
+							ParseObserver * observer = NULL
+						);
+
+///Same as parseFileCPPThreads above, but the work runs as tasks on the persistent workers of @executor
+///instead of freshly spawned threads. Independent scans can share one executor, processors may submit
+///sub tasks to it (e.g. using a TaskGroup) while the scan is running. Waiting on such a group only
+///runs tasks of that group, never the blob fetching tasks of a scan.
+///@taskCount number of blob fetching tasks. If this is set to zero then this will default to executor.threadCount()
+template<typename TPBI_Processor, typename T_IN_DATA>
+uint32_t parseFileCPPThreads(Executor & executor, T_IN_DATA & inFile, TPBI_Processor processor,
+							uint32_t taskCount = 0,
+							uint32_t readBlobCount = 1,
+							bool threadPrivateProcessor = false,
+							uint32_t maxBlobsToRead = 0xFFFFFFFF,
+							MemoryBudget * budget = NULL,
+							ParseObserver * observer = NULL
 						);
-						
+
+///Map-reduce over the blobs of @inFile: every thread works on its own accumulator, the accumulators are merged at the end.
+///No state is shared between the threads while processing.
+///@inFile currently either OSMFileIn or PbiStream
+///@makeLocal () -> T_LOCAL, creates the (empty) accumulator of a thread, called threadCount times on the calling thread
+///@process (T_LOCAL & local, osmpbf::PrimitiveBlockInputAdaptor & pbi) if the return value is not void, then the processing stops for ALL threads if its evaluated to false
+///@merge (T_LOCAL & target, T_LOCAL & source) merge source into target
+///@threadCount if this is set to zero then this will default to max(std::thread::hardware_concurrency(), 1)
+///@readBlobCount number of blobs a single thread fetches to work upon before fetching new blobs
+///@treeMerge merge pairwise in log2(threadCount) parallel rounds instead of sequentially into the first accumulator.
+///Use this if merging is expensive (e.g. large histograms)
+///@budget see parseFileCPPThreads
+///@observer see parseFileCPPThreads, the accumulators of a cancelled parse are merged as well
+///@return the merged accumulator
+template<typename T_LOCAL_FACTORY, typename T_PROCESS, typename T_MERGE, typename T_IN_DATA>
+typename std::result_of<T_LOCAL_FACTORY()>::type
+parseFileReduce(T_IN_DATA & inFile, T_LOCAL_FACTORY makeLocal, T_PROCESS process, T_MERGE merge,
+				uint32_t threadCount = 0,
+				uint32_t readBlobCount = 1,
+				bool treeMerge = false,
+				MemoryBudget * budget = NULL,
+				ParseObserver * observer = NULL
+			);
+
+///Same as parseFileReduce above, but the work (and the tree merge) runs as tasks on @executor
+///@taskCount number of blob fetching tasks and thus accumulators. If this is set to zero then this will default to executor.threadCount()
+template<typename T_LOCAL_FACTORY, typename T_PROCESS, typename T_MERGE, typename T_IN_DATA>
+typename std::result_of<T_LOCAL_FACTORY()>::type
+parseFileReduce(Executor & executor, T_IN_DATA & inFile, T_LOCAL_FACTORY makeLocal, T_PROCESS process, T_MERGE merge,
+				uint32_t taskCount = 0,
+				uint32_t readBlobCount = 1,
+				bool treeMerge = false,
+				MemoryBudget * budget = NULL,
+				ParseObserver * observer = NULL
+			);
+
+///Merge the results of the shards of a file (see OSMFileIn::openShard()), e.g. after collecting them from several processes.
+///@merge (T & target, T & source) merge source into target, called in shard order
+///@return the merged result, a default constructed T if @shardResults is empty. The elements of @shardResults are merged in place
+template<typename T, typename T_MERGE>
+T mergeShards(std::vector<T> & shardResults, T_MERGE merge);
+
+///setup and teardown hooks of parseFilePhased
+class PhaseHooks {
+public:
+	virtual ~PhaseHooks() {}
+	///called before the first callback of phase @type (NodePrimitive, WayPrimitive or RelationPrimitive)
+	virtual void beginPhase(PrimitiveType /*type*/) {}
+	///called after the last callback of phase @type
+	virtual void endPhase(PrimitiveType /*type*/) {}
+};
+
+///Process all nodes, then all ways, then all relations of @inFile, every phase in parallel.
+///There is a barrier between the phases: no way callback starts before all node callbacks are done, and so on.
+///This requires the input to be sorted by type (as written by all common tools), primitives of an earlier type found
+///after the barrier are still passed to their callback, but not before the next barrier.
+///@inFile currently either OSMFileIn or PbiStream
+///@nodeProcessor, @wayProcessor, @relationProcessor (osmpbf::PrimitiveBlockInputAdaptor & pbi) called for every block
+///containing primitives of their type, shared by all threads. Blocks containing several types are passed to every
+///matching callback in its phase. If the return value is not void, then the processing stops for ALL threads if its evaluated to false
+///@threadCount if this is set to zero then this will default to max(std::thread::hardware_concurrency(), 1)
+///@hooks if set, beginPhase() and endPhase() are called for every phase in order (even for empty phases) while no callback runs
+///@budget, @observer see parseFileCPPThreads
+template<typename T_NODE_PROCESSOR, typename T_WAY_PROCESSOR, typename T_RELATION_PROCESSOR, typename T_IN_DATA>
+void parseFilePhased(T_IN_DATA & inFile, T_NODE_PROCESSOR nodeProcessor, T_WAY_PROCESSOR wayProcessor, T_RELATION_PROCESSOR relationProcessor,
+					uint32_t threadCount = 0,
+					PhaseHooks * hooks = NULL,
+					MemoryBudget * budget = NULL,
+					ParseObserver * observer = NULL
+				);
 
 }// end namespace osmpbf
 
 //definitions
 
 namespace osmpbf {
+namespace detail {
+	///count @pbi as processed and deliver a progress report if one is due
+	template<typename T_IN_DATA>
+	inline void observeBlob(ParseObserver * observer, T_IN_DATA & inFile, const osmpbf::PrimitiveBlockInputAdaptor & pbi)
+	{
+		if (observer && observer->blobProcessed(pbi.nodesSize() + pbi.waysSize() + pbi.relationsSize()))
+			observer->report(inFile.dataPosition());
+	}
+
+	inline bool cancelled(const ParseObserver * observer)
+	{
+		return observer && observer->cancelled();
+	}
+}
+
 template<typename TPBI_Processor, typename T_IN_DATA>
-void parseFile(T_IN_DATA & inFile, TPBI_Processor processor)
+void parseFile(T_IN_DATA & inFile, TPBI_Processor processor, ParseObserver * observer)
 {
+	if (observer)
+		observer->begin(inFile.dataSize());
+
 	osmpbf::PrimitiveBlockInputAdaptor pbi;
-	while (inFile.parseNextBlock(pbi))
+	while (!detail::cancelled(observer) && inFile.parseNextBlock(pbi))
 	{
 		if (pbi.isNull())
 			continue;
 		processor(pbi);
+		detail::observeBlob(observer, inFile, pbi);
+	}
+
+	if (observer)
+		observer->end(inFile.dataPosition());
+}
+
+namespace detail {
+	///shared blob fetching state of the threads of parseFileOmp, parseFileCPPThreads and parseFileReduce
+	template<typename T_IN_DATA>
+	class BlobWorker {
+	public:
+		BlobWorker(T_IN_DATA & inFile, uint32_t readBlobCount, uint32_t maxBlobsToRead, MemoryBudget * budget, ParseObserver * observer) :
+			m_InFile(inFile),
+			m_BlobsRead(0), m_DoProcessing(true),
+			m_ReadBlobCount(std::max<uint32_t>(readBlobCount, 1)),
+			m_MaxBlobsToRead(maxBlobsToRead),
+			m_Budget(budget),
+			m_Observer(observer)
+		{
+			if (m_Observer)
+				m_Observer->begin(m_InFile.dataSize());
+		}
+
+		///report the end of the parse to the observer, call after all threads are done
+		void finish()
+		{
+			if (m_Observer)
+				m_Observer->end(m_InFile.dataPosition());
+		}
+
+		inline uint32_t blobsRead() const { return m_BlobsRead; }
+
+		///fetch and process blobs until the input is exhausted or a processor returned false
+		template<typename T_PROCESSOR>
+		void run(T_PROCESSOR & processor)
+		{
+			typedef typename std::result_of<T_PROCESSOR(osmpbf::PrimitiveBlockInputAdaptor&)>::type ReturnType;
+
+			//the first buffer and pbi are reused for all blobs of this thread, so they stay on its memory node (first touch)
+			osmpbf::PrimitiveBlockInputAdaptor pbi;
+			std::vector<osmpbf::BlobDataBuffer> dbufs(m_ReadBlobCount);
+			uint32_t fetched = 0;
+
+			bool inputLeft = true;
+			while (inputLeft && m_DoProcessing && m_BlobsRead < m_MaxBlobsToRead)
+			{
+				fetched = 0;
+				while(fetched < m_ReadBlobCount) {
+					if (detail::cancelled(m_Observer)) {
+						inputLeft = false;
+						break;
+					}
+					//never wait while holding charged blobs
+					if (m_Budget) {
+						if (!fetched) {
+							m_Budget->waitForSpace();
+						}
+						else if (m_Budget->exhausted()) {
+							break;
+						}
+					}
+					//pretend that we have read another blob
+					auto prevBlobsRead = m_BlobsRead.fetch_add(1);
+
+					if (prevBlobsRead >= m_MaxBlobsToRead) {
+						m_BlobsRead -= 1;
+						inputLeft = false;
+						break;
+					}
+					//read our blob
+					if (m_InFile.getNextBlock(dbufs[fetched])) {
+						dbufs[fetched].charge(m_Budget);
+						++fetched;
+					}
+					else {
+						m_BlobsRead -= 1;
+						inputLeft = false;
+						break;
+					}
+				}
+
+				for(uint32_t i(0); i < fetched; ++i) {
+					osmpbf::BlobDataBuffer & dbuf = dbufs[i];
+					pbi.parseData(dbuf.data, dbuf.availableBytes);
+					//invalid or empty blocks are not passed to the processor, but still observed
+					if (!pbi.isNull()) {
+						//make sure this does not get optimized away
+						bool tmp = detail::PbiProcessor<T_PROCESSOR, ReturnType>::process(processor, pbi);
+						m_DoProcessing = tmp && m_DoProcessing;
+					}
+					dbuf.uncharge();
+					detail::observeBlob(m_Observer, m_InFile, pbi);
+				}
+
+				//uncharged buffers are not accounted for by the budget, only keep one of them per thread
+				for(uint32_t i(1); i < fetched; ++i) {
+					dbufs[i].clear();
+				}
+			}
+		}
+	private:
+		T_IN_DATA & m_InFile;
+		std::atomic<uint32_t> m_BlobsRead;
+		std::atomic<bool> m_DoProcessing;
+		uint32_t m_ReadBlobCount;
+		uint32_t m_MaxBlobsToRead;
+		MemoryBudget * m_Budget;
+		ParseObserver * m_Observer;
+	};
+
+	///work function of the threads of parseFileCPPThreads
+	template<typename TPBI_Processor, typename T_IN_DATA>
+	class ParseFileWorker : public BlobWorker<T_IN_DATA> {
+	public:
+		typedef typename std::conditional<std::is_pointer<TPBI_Processor>::value, typename std::remove_pointer<TPBI_Processor>::type, TPBI_Processor>::type MyPbiProcessor;
+		typedef detail::ProcessorPtr<TPBI_Processor> ProcessorPtrCreator;
+	public:
+		ParseFileWorker(T_IN_DATA & inFile, TPBI_Processor & processor, uint32_t readBlobCount, bool threadPrivateProcessor, uint32_t maxBlobsToRead, MemoryBudget * budget, ParseObserver * observer) :
+			BlobWorker<T_IN_DATA>(inFile, readBlobCount, maxBlobsToRead, budget, observer),
+			m_Processor(processor),
+			m_ThreadPrivateProcessor(threadPrivateProcessor)
+		{}
+
+		void operator()()
+		{
+			MyPbiProcessor * myP = ProcessorPtrCreator::ptr(m_Processor);
+			if (m_ThreadPrivateProcessor) {
+				myP = new MyPbiProcessor(*myP);
+			}
+			this->run(*myP);
+			if (m_ThreadPrivateProcessor) {
+				delete myP;
+			}
+		}
+	private:
+		TPBI_Processor & m_Processor;
+		bool m_ThreadPrivateProcessor;
+	};
+
+	///processor of a single thread of parseFileReduce, binds its accumulator to the process function
+	template<typename T_LOCAL, typename T_PROCESS>
+	struct ReduceSlot {
+		T_LOCAL * local;
+		T_PROCESS * process;
+
+		inline auto operator()(osmpbf::PrimitiveBlockInputAdaptor & pbi) -> decltype((*process)(*local, pbi)) {
+			return (*process)(*local, pbi);
+		}
+	};
+
+	///merge @locals into locals.front(), pairwise in parallel if @runParallel is set.
+	///@runParallel (std::vector<std::function<void()>> & tasks) runs the tasks and waits for them
+	template<typename T_LOCAL, typename T_MERGE, typename T_RUN_PARALLEL>
+	void mergeLocals(std::vector<T_LOCAL> & locals, T_MERGE & merge, bool treeMerge, T_RUN_PARALLEL runParallel)
+	{
+		if (!treeMerge) {
+			for(std::size_t i(1); i < locals.size(); ++i) {
+				merge(locals.front(), locals[i]);
+			}
+			return;
+		}
+
+		//every level halves the number of accumulators, merges of a level are independent
+		std::vector< std::function<void()> > tasks;
+		for(std::size_t step(1); step < locals.size(); step *= 2) {
+			tasks.clear();
+			for(std::size_t i(0); i + step < locals.size(); i += 2*step) {
+				T_LOCAL * target = &locals[i];
+				T_LOCAL * source = &locals[i+step];
+				tasks.emplace_back([&merge, target, source]() { merge(*target, *source); });
+			}
+			runParallel(tasks);
+		}
 	}
 }
 
 template<typename TPBI_Processor, typename T_IN_DATA>
-void parseFileOmp(T_IN_DATA & inFile, TPBI_Processor processor, uint32_t readBlobCount)
+void parseFileOmp(T_IN_DATA & inFile, TPBI_Processor processor, uint32_t readBlobCount, MemoryBudget * budget, ParseObserver * observer)
 {
 	if (!readBlobCount)
 	{
@@ -122,38 +418,26 @@ void parseFileOmp(T_IN_DATA & inFile, TPBI_Processor processor, uint32_t readBlo
 		#endif
 	}
 
-	std::vector<osmpbf::BlobDataBuffer> pbiBuffers;
-	bool processedFile = false;
+	//the team size is left to OpenMP, @readBlobCount is split among its threads
+	uint32_t threadCount = 1;
+	#if defined(_OPENMP)
+	threadCount = std::max<int>(omp_get_max_threads(), 1);
+	#endif
+	uint32_t blobsPerThread = (readBlobCount + threadCount - 1) / threadCount;
 
-	while (!processedFile)
-	{
-		pbiBuffers.clear();
-		inFile.getNextBlocks(pbiBuffers, readBlobCount);
-		std::size_t pbiCount = pbiBuffers.size();
-		processedFile = (pbiCount < readBlobCount);
+	detail::BlobWorker<T_IN_DATA> worker(inFile, blobsPerThread, 0xFFFFFFFF, budget, observer);
 
-		#pragma omp parallel for schedule(dynamic)
-		for(std::size_t i = 0; i < pbiCount; ++i)
-		{
-			osmpbf::PrimitiveBlockInputAdaptor pbi(pbiBuffers[i].data, pbiBuffers[i].availableBytes);
-			pbiBuffers[i].clear();
-			if (pbi.isNull())
-			{
-				continue;
-			}
-			processor(pbi);
-		}
+	#pragma omp parallel
+	{
+		worker.run(processor);
 	}
+	worker.finish();
 }
 
 template<typename TPBI_Processor, typename T_IN_DATA>
 uint32_t
-parseFileCPPThreads(T_IN_DATA & inFile, TPBI_Processor processor, uint32_t threadCount, uint32_t readBlobCount, bool threadPrivateProcessor, uint32_t maxBlobsToRead)
+parseFileCPPThreads(T_IN_DATA & inFile, TPBI_Processor processor, uint32_t threadCount, uint32_t readBlobCount, bool threadPrivateProcessor, uint32_t maxBlobsToRead, MemoryBudget * budget, ParseObserver * observer)
 {
-	typedef typename std::conditional<std::is_pointer<TPBI_Processor>::value, typename std::remove_pointer<TPBI_Processor>::type, TPBI_Processor>::type MyPbiProcessor;
-// 	typedef typename std::remove_pointer<TPBI_Processor>::type MyPbiProcessor;
-	typedef typename std::result_of<MyPbiProcessor(osmpbf::PrimitiveBlockInputAdaptor&)>::type PBIProcessorReturnType;
-	typedef detail::ProcessorPtr<TPBI_Processor> ProcessorPtrCreator;
 	if (!maxBlobsToRead)
 		return 0;
 
@@ -162,75 +446,351 @@ parseFileCPPThreads(T_IN_DATA & inFile, TPBI_Processor processor, uint32_t threa
 		threadCount = std::max<int>(std::thread::hardware_concurrency(), 1);
 	}
 
-	readBlobCount = std::max<uint32_t>(readBlobCount, 1);
-	std::atomic<uint32_t> blobsRead(0);
-	std::atomic<bool> doProcessing(true);
+	detail::ParseFileWorker<TPBI_Processor, T_IN_DATA> worker(inFile, processor, readBlobCount, threadPrivateProcessor, maxBlobsToRead, budget, observer);
+
+	std::vector<std::thread> ts;
+	ts.reserve(threadCount);
+	for(uint32_t i(0); i < threadCount; ++i)
+	{
+		ts.push_back(std::thread(std::ref(worker)));
+	}
+
+	for(std::thread & t : ts)
+	{
+		t.join();
+	}
+	worker.finish();
 	
+	return worker.blobsRead();
+}
 
-	auto workFunc = [&inFile, &processor, &blobsRead, &doProcessing, readBlobCount, threadPrivateProcessor, maxBlobsToRead]()
+template<typename TPBI_Processor, typename T_IN_DATA>
+uint32_t
+parseFileCPPThreads(Executor & executor, T_IN_DATA & inFile, TPBI_Processor processor, uint32_t taskCount, uint32_t readBlobCount, bool threadPrivateProcessor, uint32_t maxBlobsToRead, MemoryBudget * budget, ParseObserver * observer)
+{
+	if (!maxBlobsToRead)
+		return 0;
+
+	if (!taskCount)
+	{
+		taskCount = executor.threadCount();
+	}
+
+	detail::ParseFileWorker<TPBI_Processor, T_IN_DATA> worker(inFile, processor, readBlobCount, threadPrivateProcessor, maxBlobsToRead, budget, observer);
+
+	TaskGroup group(executor);
+	for(uint32_t i(0); i < taskCount; ++i)
 	{
-		MyPbiProcessor * myP = ProcessorPtrCreator::ptr(processor);
-		if (threadPrivateProcessor) {
-			myP = new MyPbiProcessor(*myP);
+		group.run(std::ref(worker));
+	}
+	group.wait();
+	worker.finish();
+
+	return worker.blobsRead();
+}
+
+template<typename T_LOCAL_FACTORY, typename T_PROCESS, typename T_MERGE, typename T_IN_DATA>
+typename std::result_of<T_LOCAL_FACTORY()>::type
+parseFileReduce(T_IN_DATA & inFile, T_LOCAL_FACTORY makeLocal, T_PROCESS process, T_MERGE merge, uint32_t threadCount, uint32_t readBlobCount, bool treeMerge, MemoryBudget * budget, ParseObserver * observer)
+{
+	typedef typename std::result_of<T_LOCAL_FACTORY()>::type Local;
+	typedef detail::ReduceSlot<Local, T_PROCESS> Slot;
+
+	if (!threadCount)
+	{
+		threadCount = std::max<int>(std::thread::hardware_concurrency(), 1);
+	}
+
+	std::vector<Local> locals;
+	locals.reserve(threadCount);
+	for(uint32_t i(0); i < threadCount; ++i)
+	{
+		locals.emplace_back(makeLocal());
+	}
+
+	detail::BlobWorker<T_IN_DATA> worker(inFile, readBlobCount, 0xFFFFFFFF, budget, observer);
+
+	std::vector<std::thread> ts;
+	ts.reserve(threadCount);
+	for(uint32_t i(0); i < threadCount; ++i)
+	{
+		Slot slot = {&locals[i], &process};
+		ts.push_back(std::thread([&worker, slot]() mutable { worker.run(slot); }));
+	}
+
+	for(std::thread & t : ts)
+	{
+		t.join();
+	}
+	worker.finish();
+
+	detail::mergeLocals(locals, merge, treeMerge, [](std::vector< std::function<void()> > & tasks) {
+		std::vector<std::thread> mts;
+		mts.reserve(tasks.size());
+		for(std::function<void()> & task : tasks)
+		{
+			mts.push_back(std::thread(task));
+		}
+		for(std::thread & t : mts)
+		{
+			t.join();
 		}
-		osmpbf::PrimitiveBlockInputAdaptor pbi;
-		std::vector<osmpbf::BlobDataBuffer> dbufs;
-		dbufs.reserve(readBlobCount);
+	});
 
-		while (doProcessing && blobsRead < maxBlobsToRead)
+	return std::move(locals.front());
+}
+
+template<typename T_LOCAL_FACTORY, typename T_PROCESS, typename T_MERGE, typename T_IN_DATA>
+typename std::result_of<T_LOCAL_FACTORY()>::type
+parseFileReduce(Executor & executor, T_IN_DATA & inFile, T_LOCAL_FACTORY makeLocal, T_PROCESS process, T_MERGE merge, uint32_t taskCount, uint32_t readBlobCount, bool treeMerge, MemoryBudget * budget, ParseObserver * observer)
+{
+	typedef typename std::result_of<T_LOCAL_FACTORY()>::type Local;
+	typedef detail::ReduceSlot<Local, T_PROCESS> Slot;
+
+	if (!taskCount)
+	{
+		taskCount = executor.threadCount();
+	}
+
+	std::vector<Local> locals;
+	locals.reserve(taskCount);
+	for(uint32_t i(0); i < taskCount; ++i)
+	{
+		locals.emplace_back(makeLocal());
+	}
+
+	detail::BlobWorker<T_IN_DATA> worker(inFile, readBlobCount, 0xFFFFFFFF, budget, observer);
+
+	{
+		TaskGroup group(executor);
+		for(uint32_t i(0); i < taskCount; ++i)
 		{
-			dbufs.clear();
-			while(dbufs.size() < readBlobCount) {
-				//pretend that we have read another blob
-				auto prevBlobsRead = blobsRead.fetch_add(1);
-				
-				if (prevBlobsRead >= maxBlobsToRead) {
-					blobsRead -= 1;
-					break;
+			Slot slot = {&locals[i], &process};
+			group.run([&worker, slot]() mutable { worker.run(slot); });
+		}
+		group.wait();
+	}
+	worker.finish();
+
+	detail::mergeLocals(locals, merge, treeMerge, [&executor](std::vector< std::function<void()> > & tasks) {
+		TaskGroup group(executor);
+		for(std::function<void()> & task : tasks)
+		{
+			group.run(task);
+		}
+		group.wait();
+	});
+
+	return std::move(locals.front());
+}
+
+template<typename T, typename T_MERGE>
+T mergeShards(std::vector<T> & shardResults, T_MERGE merge)
+{
+	if (shardResults.empty())
+	{
+		return T();
+	}
+	detail::mergeLocals(shardResults, merge, false, [](std::vector< std::function<void()> > &) {});
+	return std::move(shardResults.front());
+}
+
+namespace detail {
+	///shared state and work function of the threads of parseFilePhased
+	template<typename T_NODE_PROCESSOR, typename T_WAY_PROCESSOR, typename T_RELATION_PROCESSOR, typename T_IN_DATA>
+	class PhasedWorker {
+	public:
+		enum {PHASE_Node = 0, PHASE_Way = 1, PHASE_Relation = 2, PHASE_Count = 3};
+	public:
+		PhasedWorker(T_IN_DATA & inFile, T_NODE_PROCESSOR & nodeProcessor, T_WAY_PROCESSOR & wayProcessor, T_RELATION_PROCESSOR & relationProcessor,
+					PhaseHooks * hooks, MemoryBudget * budget, ParseObserver * observer) :
+			m_InFile(inFile),
+			m_NodeProcessor(nodeProcessor), m_WayProcessor(wayProcessor), m_RelationProcessor(relationProcessor),
+			m_Hooks(hooks), m_Budget(budget), m_Observer(observer),
+			m_DoProcessing(true),
+			m_Phase(PHASE_Node),
+			m_Fetching(0)
+		{
+			for(int phase(0); phase < PHASE_Count; ++phase)
+				m_Pending[phase] = 0;
+
+			if (m_Observer)
+				m_Observer->begin(m_InFile.dataSize());
+			if (m_Hooks)
+				m_Hooks->beginPhase(primitiveType(PHASE_Node));
+		}
+
+		///run the remaining phase changes, call after all threads are done
+		void finish()
+		{
+			std::unique_lock<std::mutex> lck(m_Lock);
+			advance(PHASE_Relation);
+			if (m_Hooks)
+				m_Hooks->endPhase(primitiveType(PHASE_Relation));
+			lck.unlock();
+
+			if (m_Observer)
+				m_Observer->end(m_InFile.dataPosition());
+		}
+
+		void operator()()
+		{
+			osmpbf::PrimitiveBlockInputAdaptor pbi;
+			osmpbf::BlobDataBuffer dbuf;
+
+			while (m_DoProcessing && !detail::cancelled(m_Observer))
+			{
+				if (m_Budget)
+					m_Budget->waitForSpace();
+
+				//the type of a block is only known once it is parsed, phases must not advance until then
+				{
+					std::lock_guard<std::mutex> lck(m_Lock);
+					++m_Fetching;
 				}
-				//read our blob
-				osmpbf::BlobDataBuffer bdb;
-				if (inFile.getNextBlock(bdb)) {
-					dbufs.emplace_back( std::move(bdb) );
+
+				bool ok = m_InFile.getNextBlock(dbuf);
+				if (ok) {
+					dbuf.charge(m_Budget);
+					pbi.parseData(dbuf.data, dbuf.availableBytes);
+				}
+
+				bool phases[PHASE_Count] = {
+					ok && !pbi.isNull() && pbi.nodesSize() > 0,
+					ok && !pbi.isNull() && pbi.waysSize() > 0,
+					ok && !pbi.isNull() && pbi.relationsSize() > 0
+				};
+				int phase = nextPhase(phases, 0);
+
+				{
+					std::lock_guard<std::mutex> lck(m_Lock);
+					--m_Fetching;
+					if (phase < PHASE_Count)
+						++m_Pending[phase];
 				}
-				else {
-					blobsRead -= 1;
+				m_Changed.notify_all();
+
+				if (!ok)
 					break;
+
+				while (phase < PHASE_Count) {
+					{
+						std::unique_lock<std::mutex> lck(m_Lock);
+						m_Changed.wait(lck, [this, phase]() { return phase <= m_Phase || mayAdvance(phase); });
+						advance(phase);
+					}
+
+					bool tmp = process(phase, pbi);
+					m_DoProcessing = tmp && m_DoProcessing;
+
+					int next = m_DoProcessing ? nextPhase(phases, phase+1) : (int) PHASE_Count;
+					{
+						std::lock_guard<std::mutex> lck(m_Lock);
+						--m_Pending[phase];
+						if (next < PHASE_Count)
+							++m_Pending[next];
+					}
+					m_Changed.notify_all();
+					phase = next;
 				}
+
+				dbuf.uncharge();
+				if (ok && !pbi.isNull())
+					detail::observeBlob(m_Observer, m_InFile, pbi);
 			}
-			
-			for(osmpbf::BlobDataBuffer & dbuf : dbufs) {
-				pbi.parseData(dbuf.data, dbuf.availableBytes);
-				//make sure this does not get optimized away
-				bool tmp = detail::PbiProcessor<MyPbiProcessor, PBIProcessorReturnType>::process(*myP, pbi);
-				doProcessing = tmp && doProcessing;
-			}
-			//nothing to fetch anymore
-			if (dbufs.size() < readBlobCount) {
-				break;
+		}
+	private:
+		static inline PrimitiveType primitiveType(int phase)
+		{
+			return (PrimitiveType) (1 << phase);
+		}
+
+		static inline int nextPhase(const bool * phases, int phase)
+		{
+			while (phase < PHASE_Count && !phases[phase])
+				++phase;
+			return phase;
+		}
+
+		///no block may still need an earlier phase than @phase. Has to be guarded by m_Lock
+		inline bool mayAdvance(int phase) const
+		{
+			if (m_Fetching)
+				return false;
+			for(int earlier(0); earlier < phase; ++earlier)
+				if (m_Pending[earlier])
+					return false;
+			return true;
+		}
+
+		///advance to @phase and run the hooks of all phases in between. Has to be guarded by m_Lock
+		void advance(int phase)
+		{
+			while (m_Phase < phase) {
+				if (m_Hooks)
+					m_Hooks->endPhase(primitiveType(m_Phase));
+				++m_Phase;
+				if (m_Hooks)
+					m_Hooks->beginPhase(primitiveType(m_Phase));
 			}
 		}
-		if (threadPrivateProcessor) {
-			delete myP;
+
+		bool process(int phase, osmpbf::PrimitiveBlockInputAdaptor & pbi)
+		{
+			switch (phase) {
+			case PHASE_Node:
+				return PbiProcessor<T_NODE_PROCESSOR, typename std::result_of<T_NODE_PROCESSOR(osmpbf::PrimitiveBlockInputAdaptor&)>::type>::process(m_NodeProcessor, pbi);
+			case PHASE_Way:
+				return PbiProcessor<T_WAY_PROCESSOR, typename std::result_of<T_WAY_PROCESSOR(osmpbf::PrimitiveBlockInputAdaptor&)>::type>::process(m_WayProcessor, pbi);
+			default:
+				return PbiProcessor<T_RELATION_PROCESSOR, typename std::result_of<T_RELATION_PROCESSOR(osmpbf::PrimitiveBlockInputAdaptor&)>::type>::process(m_RelationProcessor, pbi);
+			}
 		}
+	private:
+		T_IN_DATA & m_InFile;
+		T_NODE_PROCESSOR & m_NodeProcessor;
+		T_WAY_PROCESSOR & m_WayProcessor;
+		T_RELATION_PROCESSOR & m_RelationProcessor;
+		PhaseHooks * m_Hooks;
+		MemoryBudget * m_Budget;
+		ParseObserver * m_Observer;
+		std::atomic<bool> m_DoProcessing;
+
+		std::mutex m_Lock;
+		std::condition_variable m_Changed;
+		int m_Phase;
+		///number of blobs being fetched and parsed
+		uint32_t m_Fetching;
+		///number of parsed blocks which still need a phase, by the next phase they need
+		uint32_t m_Pending[PHASE_Count];
 	};
+}
+
+template<typename T_NODE_PROCESSOR, typename T_WAY_PROCESSOR, typename T_RELATION_PROCESSOR, typename T_IN_DATA>
+void parseFilePhased(T_IN_DATA & inFile, T_NODE_PROCESSOR nodeProcessor, T_WAY_PROCESSOR wayProcessor, T_RELATION_PROCESSOR relationProcessor,
+					uint32_t threadCount, PhaseHooks * hooks, MemoryBudget * budget, ParseObserver * observer)
+{
+	if (!threadCount)
+	{
+		threadCount = std::max<int>(std::thread::hardware_concurrency(), 1);
+	}
+
+	detail::PhasedWorker<T_NODE_PROCESSOR, T_WAY_PROCESSOR, T_RELATION_PROCESSOR, T_IN_DATA> worker(inFile, nodeProcessor, wayProcessor, relationProcessor, hooks, budget, observer);
 
 	std::vector<std::thread> ts;
 	ts.reserve(threadCount);
 	for(uint32_t i(0); i < threadCount; ++i)
 	{
-		ts.push_back(std::thread(workFunc));
+		ts.push_back(std::thread(std::ref(worker)));
 	}
 
 	for(std::thread & t : ts)
 	{
 		t.join();
 	}
-	
-	return blobsRead;
+	worker.finish();
 }
 
-
 } //end namespace osmpbf
 
 #endif // OSMPBF_PARSEHELPERS_H
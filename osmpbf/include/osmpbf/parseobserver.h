@@ -0,0 +1,111 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OSMPBF_PARSEOBSERVER_H
+#define OSMPBF_PARSEOBSERVER_H
+
+#include <osmpbf/typelimits.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace osmpbf
+{
+
+///snapshot of a running parse, see ParseObserver
+struct ParseProgress {
+	///position of the reader in the data section of the input
+	SizeType bytesRead;
+	///size of the data section of the input
+	SizeType totalBytes;
+	uint64_t blobsParsed;
+	///nodes, ways and relations of the parsed blobs
+	uint64_t primitivesParsed;
+	double elapsedSeconds;
+	double bytesPerSecond;
+	double primitivesPerSecond;
+	///estimated remaining time, negative if unknown
+	double etaSeconds;
+
+	ParseProgress() :
+		bytesRead(0), totalBytes(0), blobsParsed(0), primitivesParsed(0),
+		elapsedSeconds(0.0), bytesPerSecond(0.0), primitivesPerSecond(0.0), etaSeconds(-1.0)
+	{}
+};
+
+/**
+  * Progress and cancellation hook of the parse helpers (see parsehelpers.h).
+  *
+  * Reimplement progress() to receive a ParseProgress at most every interval milliseconds and
+  * finished() to receive the final one. Both are called from one of the parsing threads,
+  * but never concurrently, so they should return quickly.
+  *
+  * cancel() may be called from any thread (including processors and progress()): the helpers stop
+  * fetching blobs, blobs already fetched are still processed.
+  * An observer can only watch one parse at a time.
+  */
+class ParseObserver
+{
+public:
+	explicit ParseObserver(uint32_t interval = 1000);
+	ParseObserver(const ParseObserver & other) = delete;
+	ParseObserver & operator=(const ParseObserver & other) = delete;
+	virtual ~ParseObserver();
+public:
+	inline uint32_t interval() const { return m_Interval; }
+	inline void setInterval(uint32_t interval) { m_Interval = interval; }
+
+	///request cancellation of the running parse, thread-safe
+	inline void cancel() { m_Cancelled = true; }
+	inline bool cancelled() const { return m_Cancelled; }
+
+	///progress of the running (or last) parse, thread-safe
+	ParseProgress snapshot(SizeType bytesRead) const;
+public:
+	///called by the parse helpers when the parse starts. Resets the counters and the cancellation state
+	void begin(SizeType totalBytes);
+	///called by the parse helpers after a blob with @primitives primitives was processed, thread-safe.
+	///Returns true if a report is due, the caller has to call report() then
+	bool blobProcessed(uint64_t primitives);
+	///deliver a progress report for the reader position @bytesRead
+	void report(SizeType bytesRead);
+	///called by the parse helpers when the parse ended
+	void end(SizeType bytesRead);
+protected:
+	virtual void progress(const ParseProgress & progress);
+	virtual void finished(const ParseProgress & progress);
+private:
+	typedef std::chrono::steady_clock Clock;
+private:
+	uint32_t m_Interval;
+	std::atomic<bool> m_Cancelled;
+	std::atomic<bool> m_Reporting;
+	std::atomic<uint64_t> m_Blobs;
+	std::atomic<uint64_t> m_Primitives;
+	///nanoseconds since m_Start
+	std::atomic<int64_t> m_NextReport;
+	SizeType m_TotalBytes;
+	Clock::time_point m_Start;
+};
+
+} // namespace osmpbf
+
+#endif // OSMPBF_PARSEOBSERVER_H
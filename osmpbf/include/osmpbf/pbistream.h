@@ -2,6 +2,8 @@
 #define OSMPBF_PBISTREAM_H
 #include <osmpbf/typelimits.h>
 #include <osmpbf/osmfilein.h>
+#include <osmpbf/blobstream.h>
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <mutex>
@@ -24,6 +26,8 @@ public:
 	virtual bool getNext(BlobDataMultiBuffer & buffers, int num) = 0;
 	virtual bool parseNext(PrimitiveBlockInputAdaptor & adaptor) = 0;
 
+	///true if reading stopped early because of invalid input, false by default
+	virtual bool failed() const;
 };
 
 }//end namespace interface
@@ -68,7 +72,7 @@ protected:
 	OSMFileIn & currentFile();
 	const OSMFileIn & currentFile() const;
 private:
-	std::mutex m_lock;
+	mutable std::mutex m_lock;
 	std::vector<OSMFileIn> m_files;
 	std::vector<SizeType> m_clDataSize; //cumulative data size
 	SizeType m_dataSize;
@@ -76,20 +80,103 @@ private:
 	std::size_t m_currentFile;
 };
 
+/**
+ * Reads all files at the same time: every getNext() takes the next blob of the next file
+ * with blobs left (round robin), so concurrent consumers read from different files instead
+ * of queueing on the current one. There is no stream wide lock, reading is only serialized
+ * per file.
+ * Blobs of one file keep their order, blobs of different files are interleaved.
+ * position() is the sum of the data positions of all files.
+ */
+class ConcurrentMultiFilePbiStream: public interface::PbiStream {
+public:
+	///distance(begin, end) > 0!
+	template<typename T_OSMFILE_IN_ITERATOR>
+	ConcurrentMultiFilePbiStream(T_OSMFILE_IN_ITERATOR begin, T_OSMFILE_IN_ITERATOR end);
+	virtual ~ConcurrentMultiFilePbiStream() override;
+
+	///not thread-safe
+	virtual void reset() override;
+	///not thread-safe, files before @position are exhausted, files after it are reset
+	virtual void seek(SizeType position) override;
+	virtual SizeType position() const override;
+	virtual SizeType size() const override;
+
+	virtual bool hasNext() const override;
+	virtual bool getNext(BlobDataBuffer & buffer) override;
+	virtual bool getNext(BlobDataMultiBuffer & buffers, int num) override;
+	virtual bool parseNext(PrimitiveBlockInputAdaptor & adaptor) override;
+private:
+	///recompute the exhausted flags from the file positions
+	void updateExhausted();
+	void markExhausted(std::size_t file);
+private:
+	std::vector<OSMFileIn> m_files;
+	std::vector<SizeType> m_clDataSize; //cumulative data size
+	SizeType m_dataSize;
+	///one flag per file
+	std::unique_ptr<std::atomic<bool>[]> m_exhausted;
+	///number of files not exhausted
+	std::atomic<std::size_t> m_remaining;
+	///round robin cursor
+	std::atomic<std::size_t> m_nextFile;
+};
+
+/**
+ * Reads a single, possibly non-seekable input through a BlobStreamIn.
+ * The stream can neither be reset nor seeked and its size is unknown (0).
+ * OSMHeader blobs following the first one (concatenated files) are skipped.
+ */
+class StreamPbiStream: public interface::PbiStream {
+public:
+	///takes ownership of @stream, throws std::runtime_error if the input does not start with a usable OSMHeader
+	StreamPbiStream(BlobStreamIn * stream);
+	virtual ~StreamPbiStream() override;
+
+	///only valid before the first block was read
+	virtual void reset() override;
+	///only valid for the current position
+	virtual void seek(SizeType position) override;
+	virtual SizeType position() const override;
+	virtual SizeType size() const override;
+
+	///may wait for the next blob to arrive
+	virtual bool hasNext() const override;
+	virtual bool getNext(BlobDataBuffer & buffer) override;
+	virtual bool getNext(BlobDataMultiBuffer & buffers, int num) override;
+	virtual bool parseNext(PrimitiveBlockInputAdaptor & adaptor) override;
+
+	///see BlobStreamIn::failed()
+	virtual bool failed() const override;
+private:
+	std::unique_ptr<BlobStreamIn> m_stream;
+	SizeType m_dataOffset;
+};
+
 }//end namespace imp
 
 
 class PbiStream {
+public:
+	///how blobs of multiple files are read
+	enum ReadMode {
+		///one file after another
+		RM_Sequential,
+		///all files at the same time, see imp::ConcurrentMultiFilePbiStream
+		RM_Concurrent
+	};
 public:
 	PbiStream();
 	PbiStream(PbiStream && other);
 	PbiStream(OSMFileIn && fileIn);
-	PbiStream(std::vector<OSMFileIn> && files);
-	PbiStream(const std::vector<std::string> & fileNames);
+	///read from a non-seekable input, takes ownership of @stream. Throws std::runtime_error if the input has no valid header
+	PbiStream(BlobStreamIn * stream);
+	PbiStream(std::vector<OSMFileIn> && files, ReadMode mode = RM_Sequential);
+	PbiStream(const std::vector<std::string> & fileNames, ReadMode mode = RM_Sequential);
 	///@param begin iterator to OsmFileIn
 	///@warning this moves the data between begin and end into PbiStream!
 	template<typename T_OSMFILE_IN_ITERATOR>
-	PbiStream(T_OSMFILE_IN_ITERATOR begin, T_OSMFILE_IN_ITERATOR end);
+	PbiStream(T_OSMFILE_IN_ITERATOR begin, T_OSMFILE_IN_ITERATOR end, ReadMode mode = RM_Sequential);
 	virtual ~PbiStream();
 	PbiStream & operator=(const PbiStream & other) = delete;
 	PbiStream & operator=(PbiStream && other) = default;
@@ -122,6 +209,13 @@ public:
 
 	///@param adaptor parse next block by @adaptor, not thread-safe
 	bool parseNext(PrimitiveBlockInputAdaptor & adaptor);
+
+	/**
+	 * true if a streamed input (see PbiStream(BlobStreamIn*)) stopped because of a blob that failed
+	 * to decode or a read error. getNext() and parseNext() return false then as at the end of the input,
+	 * so check failed() after a scan of a streamed input. Always false for files.
+	 */
+	bool failed() const;
 	
 	
 	// the following are the same as above,
@@ -161,15 +255,40 @@ m_currentFile(0)
 	m_clDataSize.emplace_back(m_dataSize);
 }
 
+template<typename T_OSMFILE_IN_ITERATOR>
+ConcurrentMultiFilePbiStream::ConcurrentMultiFilePbiStream(T_OSMFILE_IN_ITERATOR begin, T_OSMFILE_IN_ITERATOR end) :
+m_dataSize(0),
+m_remaining(0),
+m_nextFile(0)
+{
+	using std::distance;
+	auto dst = distance(begin, end);
+	m_files.reserve(dst);
+	m_clDataSize.reserve(dst+1);
+	for(; begin != end; ++begin) {
+		m_clDataSize.emplace_back(m_dataSize);
+		m_dataSize += begin->dataSize();
+		m_files.emplace_back( std::move(*begin) );
+		m_files.back().reset();
+	}
+	m_clDataSize.emplace_back(m_dataSize);
+	m_exhausted.reset(new std::atomic<bool>[m_files.size()]);
+	updateExhausted();
+}
 
 }//end namespace imp
 
 template<typename T_OSMFILE_IN_ITERATOR>
-PbiStream::PbiStream(T_OSMFILE_IN_ITERATOR begin, T_OSMFILE_IN_ITERATOR end)
+PbiStream::PbiStream(T_OSMFILE_IN_ITERATOR begin, T_OSMFILE_IN_ITERATOR end, ReadMode mode)
 {
 	using std::distance;
 	if (distance(begin, end) > 0) {
-		m_priv.reset(new imp::MultiFilePbiStream(begin, end));
+		if (mode == RM_Concurrent) {
+			m_priv.reset(new imp::ConcurrentMultiFilePbiStream(begin, end));
+		}
+		else {
+			m_priv.reset(new imp::MultiFilePbiStream(begin, end));
+		}
 	}
 }
 
@@ -129,8 +129,13 @@ private:
 
 	friend class RelationInputAdaptor;
 	friend class RelationStreamInputAdaptor;
+
+	friend class CompiledFilter;
+	friend class AbstractLocationFilter;
 	
 	crosby::binary::PrimitiveBlock * m_PrimitiveBlock;
+	///cleared block kept after a failed parse, reused by the next parseData()
+	crosby::binary::PrimitiveBlock * m_SpareBlock;
 	SizeType m_pc;
 
 	PrimitiveGroupVector m_PlainNodesGroups;
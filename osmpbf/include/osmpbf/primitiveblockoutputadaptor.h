@@ -37,9 +37,11 @@ namespace crosby {
 namespace osmpbf {
 	class INode;
 	class IWay;
+	class IRelation;
 
 	class OWay;
 	class ONode;
+	class ORelation;
 
 	class PrimitiveBlockOutputAdaptor {
 	public:
@@ -57,6 +59,11 @@ namespace osmpbf {
 
 		int waysSize() const;
 
+		ORelation createRelation();
+		ORelation createRelation(const IRelation & templateIRelation);
+
+		int relationsSize() const;
+
 		void setGranularity(int32_t value);
 		void setLatOffset(int64_t value);
 		void setLonOffset(int64_t value);
@@ -67,6 +74,7 @@ namespace osmpbf {
 
 		PrimitiveBlockOutputAdaptor & operator<<(INode & node);
 		PrimitiveBlockOutputAdaptor & operator<<(IWay & way);
+		PrimitiveBlockOutputAdaptor & operator<<(IRelation & relation);
 
 	private:
 		crosby::binary::PrimitiveBlock * m_PrimitiveBlock;
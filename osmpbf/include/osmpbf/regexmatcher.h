@@ -0,0 +1,93 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OSMPBF_REGEXMATCHER_H
+#define OSMPBF_REGEXMATCHER_H
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <unordered_map>
+
+namespace osmpbf
+{
+
+/**
+  * Thread-safe std::regex_match with memoization.
+  *
+  * String tables of different blocks share most of their strings, so results are remembered
+  * in a memo table split into SHARD_COUNT independently locked shards. A shard is cleared
+  * when it exceeds MAX_SHARD_ENTRIES.
+  *
+  * If the matcher is constructed from a pattern string (ECMAScript grammar, no icase, default match flags),
+  * a literal prefix and the longest literal substring every match has to contain are extracted from it.
+  * Strings failing this check are rejected without running the regex or touching the memo.
+  *
+  * Filters share their matcher with their copies, so all threads profit from the same memo.
+  */
+class RegexMatcher
+{
+public:
+	static constexpr std::size_t SHARD_COUNT = 16;
+	static constexpr std::size_t MAX_SHARD_ENTRIES = 1 << 14;
+public:
+	RegexMatcher();
+	explicit RegexMatcher(const std::string & pattern, std::regex_constants::match_flag_type flags = std::regex_constants::match_default);
+	explicit RegexMatcher(const std::regex & regex, std::regex_constants::match_flag_type flags = std::regex_constants::match_default);
+	RegexMatcher(const RegexMatcher & other) = delete;
+	RegexMatcher & operator=(const RegexMatcher & other) = delete;
+public:
+	///thread-safe
+	bool matches(const std::string & str) const;
+
+	inline const std::regex & regex() const { return m_Regex; }
+	inline std::regex_constants::match_flag_type matchFlags() const { return m_MatchFlags; }
+
+	///literal every matching string starts with, may be empty
+	inline const std::string & requiredPrefix() const { return m_RequiredPrefix; }
+	///literal every matching string contains, may be empty
+	inline const std::string & requiredSubstring() const { return m_RequiredSubstring; }
+
+	///number of memoized results, thread-safe
+	std::size_t memoSize() const;
+	void clearMemo();
+private:
+	struct Shard {
+		std::mutex lock;
+		std::unordered_map<std::string, bool> memo;
+	};
+private:
+	void extractLiterals(const std::string & pattern);
+	bool prefilter(const std::string & str) const;
+private:
+	std::regex m_Regex;
+	std::regex_constants::match_flag_type m_MatchFlags;
+	std::string m_RequiredPrefix;
+	std::string m_RequiredSubstring;
+	mutable std::array<Shard, SHARD_COUNT> m_Shards;
+};
+
+typedef std::shared_ptr<RegexMatcher> RegexMatcherPtr;
+
+} // namespace osmpbf
+
+#endif // OSMPBF_REGEXMATCHER_H
@@ -31,6 +31,7 @@ namespace osmpbf
 
 INode::INode() : IPrimitive() {}
 INode::INode(const INode & other) : IPrimitive(other) {}
+INode::INode(const IPrimitive & other) : IPrimitive(other) {}
 
 INode & INode::operator=(const INode & other) { IPrimitive::operator=(other); return *this; }
 
@@ -0,0 +1,98 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#include <osmpbf/memorybudget.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace osmpbf
+{
+
+MemoryBudget::MemoryBudget(SizeType capacity) :
+m_Capacity(std::max<SizeType>(capacity, 1)),
+m_Used(0),
+m_Peak(0),
+m_WaitCount(0)
+{}
+
+MemoryBudget::~MemoryBudget()
+{
+	assert(!m_Used);
+}
+
+SizeType MemoryBudget::used() const
+{
+	std::lock_guard<std::mutex> lck(m_Lock);
+	return m_Used;
+}
+
+SizeType MemoryBudget::peak() const
+{
+	std::lock_guard<std::mutex> lck(m_Lock);
+	return m_Peak;
+}
+
+void MemoryBudget::resetPeak()
+{
+	std::lock_guard<std::mutex> lck(m_Lock);
+	m_Peak = m_Used;
+}
+
+SizeType MemoryBudget::waitCount() const
+{
+	std::lock_guard<std::mutex> lck(m_Lock);
+	return m_WaitCount;
+}
+
+bool MemoryBudget::exhausted() const
+{
+	std::lock_guard<std::mutex> lck(m_Lock);
+	return m_Used >= m_Capacity;
+}
+
+void MemoryBudget::waitForSpace()
+{
+	std::unique_lock<std::mutex> lck(m_Lock);
+	if (m_Used < m_Capacity)
+		return;
+
+	++m_WaitCount;
+	m_Released.wait(lck, [this]() { return m_Used < m_Capacity; });
+}
+
+void MemoryBudget::acquire(SizeType bytes)
+{
+	std::lock_guard<std::mutex> lck(m_Lock);
+	m_Used += bytes;
+	m_Peak = std::max(m_Peak, m_Used);
+}
+
+void MemoryBudget::release(SizeType bytes)
+{
+	{
+		std::lock_guard<std::mutex> lck(m_Lock);
+		assert(bytes <= m_Used);
+		m_Used -= std::min(bytes, m_Used);
+	}
+	m_Released.notify_all();
+}
+
+} // namespace osmpbf
@@ -0,0 +1,103 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#include <osmpbf/orelation.h>
+#include <osmpbf/primitiveblockoutputadaptor.h>
+
+#include <generics/store.h>
+
+#include "osmformat.pb.h"
+
+namespace osmpbf {
+
+// ORelation
+
+	ORelation::ORelation(const ORelation & other) : OPrimitive< RelationOutputAdaptor >(other) {}
+	ORelation::ORelation() : OPrimitive< RelationOutputAdaptor >() {}
+	ORelation::ORelation(RelationOutputAdaptor * data): OPrimitive< RelationOutputAdaptor >(data) {}
+
+	ORelation & ORelation::operator=(const ORelation & other) { OPrimitive<RelationOutputAdaptor>::operator=(other); return *this; }
+
+	void ORelation::clearMembers()
+	{
+		m_Private->clearMembers();
+	}
+
+	// RelationOutputAdaptor
+
+	RelationOutputAdaptor::RelationOutputAdaptor() : AbstractPrimitiveOutputAdaptor< crosby::binary::Relation >() {}
+	RelationOutputAdaptor::RelationOutputAdaptor(PrimitiveBlockOutputAdaptor * controller, crosby::binary::Relation * data) :
+		AbstractPrimitiveOutputAdaptor< crosby::binary::Relation >(&controller->stringTable(), data) {}
+
+	int RelationOutputAdaptor::membersSize() const {
+		return m_Data->memids_size();
+	}
+
+	int64_t RelationOutputAdaptor::memberId(int index) const {
+		return m_Data->memids(index);
+	}
+
+	PrimitiveType RelationOutputAdaptor::memberType(int index) const {
+		switch (m_Data->types(index)) {
+		case crosby::binary::Relation::NODE:
+			return NodePrimitive;
+		case crosby::binary::Relation::WAY:
+			return WayPrimitive;
+		case crosby::binary::Relation::RELATION:
+			return RelationPrimitive;
+		default:
+			return NoPrimitive;
+		}
+	}
+
+	const std::string & RelationOutputAdaptor::memberRole(int index) const {
+		return m_StringTable->query(m_Data->roles_sid(index));
+	}
+
+	void RelationOutputAdaptor::addMember(int64_t id, PrimitiveType type, const std::string & role) {
+		crosby::binary::Relation::MemberType memberType;
+		switch (type) {
+		case NodePrimitive:
+			memberType = crosby::binary::Relation::NODE;
+			break;
+		case WayPrimitive:
+			memberType = crosby::binary::Relation::WAY;
+			break;
+		case RelationPrimitive:
+			memberType = crosby::binary::Relation::RELATION;
+			break;
+		default:
+			return;
+		}
+
+		m_Data->add_memids(id);
+		m_Data->add_types(memberType);
+		m_Data->add_roles_sid(m_StringTable->insert(role));
+	}
+
+	void RelationOutputAdaptor::clearMembers() {
+		for (int i = 0; i < m_Data->roles_sid_size(); ++i)
+			m_StringTable->remove(m_Data->roles_sid(i));
+
+		m_Data->clear_memids();
+		m_Data->clear_types();
+		m_Data->clear_roles_sid();
+	}
+}
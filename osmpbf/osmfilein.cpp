@@ -24,18 +24,56 @@
 
 #include <osmpbf/blobfile.h>
 #include <osmpbf/primitiveblockinputadaptor.h>
+#include <osmpbf/blockcache.h>
 
 #include <iostream>
 #include <deque>
+#include <algorithm>
 
 namespace osmpbf {
 
+namespace {
+	///first primitive with @id in @stream
+	template<typename T_STREAM>
+	bool seekId(T_STREAM & stream, int64_t id) {
+		for (; !stream.isNull(); stream.next()) {
+			if (stream.id() == id)
+				return true;
+		}
+		return false;
+	}
+
+	///primitive type and stream of a block for OSMFileIn::find()
+	template<typename T_STREAM>
+	struct StreamTraits;
+
+	template<>
+	struct StreamTraits<INodeStream> {
+		static constexpr PrimitiveType type = NodePrimitive;
+		static inline INodeStream stream(PrimitiveBlockInputAdaptor & pbi) { return pbi.getNodeStream(); }
+	};
+
+	template<>
+	struct StreamTraits<IWayStream> {
+		static constexpr PrimitiveType type = WayPrimitive;
+		static inline IWayStream stream(PrimitiveBlockInputAdaptor & pbi) { return pbi.getWayStream(); }
+	};
+
+	template<>
+	struct StreamTraits<IRelationStream> {
+		static constexpr PrimitiveType type = RelationPrimitive;
+		static inline IRelationStream stream(PrimitiveBlockInputAdaptor & pbi) { return pbi.getRelationStream(); }
+	};
+}
+
 // OSMFileIn
 
 	OSMFileIn::OSMFileIn(const std::string & fileName, bool verboseOutput) :
 		m_FileIn(new BlobFileIn(fileName)),
 		m_FileHeader(NULL),
-		m_DataOffset(0)
+		m_DataOffset(0),
+		m_IdIndex(NULL),
+		m_BlockCache(NULL)
 	{
 		m_FileIn->setVerboseOutput(verboseOutput);
 	}
@@ -43,7 +81,9 @@ namespace osmpbf {
 	OSMFileIn::OSMFileIn(BlobFileIn * fileIn) :
 		m_FileIn(fileIn),
 		m_FileHeader(NULL),
-		m_DataOffset(0)
+		m_DataOffset(0),
+		m_IdIndex(NULL),
+		m_BlockCache(NULL)
 	{}
 
 	OSMFileIn::OSMFileIn(OSMFileIn&& other) :
@@ -51,14 +91,17 @@ namespace osmpbf {
 		m_DataBuffer(std::move(other.m_DataBuffer)),
 		m_FileHeader(other.m_FileHeader),
 		m_MissingFeatures(std::move(other.m_MissingFeatures)),
-		m_DataOffset(other.m_DataOffset)
-	
+		m_DataOffset(other.m_DataOffset),
+		m_IdIndex(other.m_IdIndex),
+		m_BlockCache(other.m_BlockCache)
 	{
 		other.m_FileIn = 0;
 		other.m_DataBuffer.clear();
 		other.m_FileHeader = 0;
 		other.m_MissingFeatures.clear();
 		other.m_DataOffset = 0;
+		other.m_IdIndex = NULL;
+		other.m_BlockCache = NULL;
 	}
 
 	
@@ -77,12 +120,16 @@ namespace osmpbf {
 		m_FileHeader = other.m_FileHeader;
 		m_MissingFeatures = std::move(other.m_MissingFeatures);
 		m_DataOffset = other.m_DataOffset;
+		m_IdIndex = other.m_IdIndex;
+		m_BlockCache = other.m_BlockCache;
 		
 		other.m_FileIn = 0;
 		other.m_DataBuffer.clear();
 		other.m_FileHeader = 0;
 		other.m_MissingFeatures.clear();
 		other.m_DataOffset = 0;
+		other.m_IdIndex = NULL;
+		other.m_BlockCache = NULL;
 		return *this;
 	}
 
@@ -94,6 +141,37 @@ namespace osmpbf {
 		return false;
 	}
 
+	bool OSMFileIn::openShard(uint32_t shard, uint32_t shardCount, const std::vector<SizeType> * blobOffsets) {
+		if (shard >= shardCount) {
+			std::cerr << "ERROR: invalid shard " << shard << " of " << shardCount << std::endl;
+			return false;
+		}
+
+		if (!open())
+			return false;
+
+		SizeType dataSize = m_FileIn->size() - m_DataOffset;
+		SizeType begin = shard ? shardBoundary(m_DataOffset + dataSize * shard / shardCount, blobOffsets) : m_DataOffset;
+		SizeType end = (shard + 1 < shardCount) ? shardBoundary(m_DataOffset + dataSize * (shard + 1) / shardCount, blobOffsets) : m_FileIn->size();
+
+		m_DataOffset = begin;
+		m_FileIn->setEnd(end);
+		m_FileIn->seek(begin);
+		return true;
+	}
+
+	SizeType OSMFileIn::shardBoundary(SizeType position, const std::vector<SizeType> * blobOffsets) const {
+		if (position <= m_DataOffset)
+			return m_DataOffset;
+
+		if (blobOffsets) {
+			std::vector<SizeType>::const_iterator it = std::lower_bound(blobOffsets->cbegin(), blobOffsets->cend(), position);
+			return (it != blobOffsets->cend()) ? *it : m_FileIn->size();
+		}
+
+		return m_FileIn->findBlob(position);
+	}
+
 	void OSMFileIn::close() {
 		m_FileIn->close();
 		m_DataBuffer.clear();
@@ -112,7 +190,7 @@ namespace osmpbf {
 	}
 
 	SizeType OSMFileIn::dataSize() const {
-		return m_FileIn->size() - m_DataOffset;
+		return m_FileIn->end() - m_DataOffset;
 	}
 
 	SizeType OSMFileIn::totalSize() const {
@@ -121,7 +199,7 @@ namespace osmpbf {
 	
 	bool OSMFileIn::hasNext() const
 	{
-		return m_FileIn->position() < m_FileIn->size();
+		return m_FileIn->position() < m_FileIn->end();
 	}
 
 
@@ -130,12 +208,36 @@ namespace osmpbf {
 		return buffer.type != BLOB_Invalid;
 	}
 
-	bool OSMFileIn::getNextBlocks(osmpbf::BlobDataMultiBuffer& buffers, int num) {
+	bool OSMFileIn::getNextBlock(BlobDataBuffer & buffer, RawBlobRef & rawBlob) {
+		m_FileIn->readBlob(buffer, rawBlob);
+		return buffer.type != BLOB_Invalid;
+	}
+
+	bool OSMFileIn::getNextBlocks(osmpbf::BlobDataMultiBuffer& buffers, int num, MemoryBudget * budget) {
+		if (budget) {
+			buffers.clear();
+			budget->waitForSpace();
+
+			// stop early instead of waiting while holding charged buffers
+			for(int i = 0; i < num || num < 0; ++i) {
+				if (i && budget->exhausted())
+					return true;
+
+				buffers.emplace_back();
+				if (!getNextBlock(buffers.back())) {
+					buffers.pop_back();
+					return false;
+				}
+				buffers.back().charge(budget);
+			}
+			return true;
+		}
+
 		// read (all) buffers
 		int i = 0;
 		if ( num < 0) {
 			for(buffers.resize(1); getNextBlock(buffers[i]); ++i) {
-				buffers.resize(i+1);
+				buffers.resize(i+2);
 			}
 		}
 		else {
@@ -153,6 +255,81 @@ namespace osmpbf {
 		return m_DataBuffer.type != BLOB_Invalid;
 	}
 
+	bool OSMFileIn::setIdIndex(const IdIndex * index) {
+		if (index && m_FileIn && index->fileSize() != totalSize()) {
+			std::cerr << "ERROR: id index was built for a file of " << index->fileSize() << " bytes, input has " << totalSize() << std::endl;
+			return false;
+		}
+
+		m_IdIndex = index;
+		return true;
+	}
+
+	std::shared_ptr<PrimitiveBlockInputAdaptor> OSMFileIn::readIndexedBlock(SizeType offset) const {
+		std::shared_ptr<PrimitiveBlockInputAdaptor> result;
+
+		if (m_BlockCache) {
+			BlockCache::BufferPtr buffer = m_BlockCache->buffer(offset);
+			if (buffer && buffer->type == BLOB_OSMData)
+				result = std::make_shared<PrimitiveBlockInputAdaptor>(buffer->data, buffer->availableBytes);
+		}
+		else {
+			BlobDataBuffer buffer;
+			if (m_FileIn->readBlobAt(offset, buffer) && buffer.type == BLOB_OSMData)
+				result = std::make_shared<PrimitiveBlockInputAdaptor>(buffer.data, buffer.availableBytes);
+		}
+
+		if (result && result->isNull())
+			result.reset();
+		return result;
+	}
+
+	template<typename T_STREAM>
+	FoundPrimitive<T_STREAM> OSMFileIn::find(int64_t id) const {
+		typedef StreamTraits<T_STREAM> Traits;
+
+		if (!m_IdIndex) {
+			std::cerr << "ERROR: no id index set" << std::endl;
+			return FoundPrimitive<T_STREAM>();
+		}
+
+		std::vector<SizeType> offsets;
+		m_IdIndex->candidates(Traits::type, id, offsets);
+		for (SizeType offset : offsets) {
+			if (m_BlockCache) {
+				//never wait for a cached adaptor, it may be held by a FoundPrimitive of this thread
+				BlockCache::AdaptorRef cached = m_BlockCache->tryAdaptor(offset);
+				if (!cached.isNull()) {
+					T_STREAM primitive = Traits::stream(*cached);
+					if (seekId(primitive, id))
+						return FoundPrimitive<T_STREAM>(std::move(cached), primitive);
+					continue;
+				}
+			}
+
+			std::shared_ptr<PrimitiveBlockInputAdaptor> pbi = readIndexedBlock(offset);
+			if (!pbi)
+				continue;
+
+			T_STREAM primitive = Traits::stream(*pbi);
+			if (seekId(primitive, id))
+				return FoundPrimitive<T_STREAM>(pbi, primitive);
+		}
+		return FoundPrimitive<T_STREAM>();
+	}
+
+	FoundNode OSMFileIn::findNode(int64_t id) const {
+		return find<INodeStream>(id);
+	}
+
+	FoundWay OSMFileIn::findWay(int64_t id) const {
+		return find<IWayStream>(id);
+	}
+
+	FoundRelation OSMFileIn::findRelation(int64_t id) const {
+		return find<IRelationStream>(id);
+	}
+
 	bool OSMFileIn::skipBlock() {
 		return m_FileIn->skipBlob();
 	}
@@ -0,0 +1,102 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#include <osmpbf/parseobserver.h>
+
+namespace osmpbf
+{
+
+ParseObserver::ParseObserver(uint32_t interval) :
+m_Interval(interval),
+m_Cancelled(false),
+m_Reporting(false),
+m_Blobs(0),
+m_Primitives(0),
+m_NextReport(0),
+m_TotalBytes(0),
+m_Start(Clock::now())
+{}
+
+ParseObserver::~ParseObserver() {}
+
+ParseProgress ParseObserver::snapshot(SizeType bytesRead) const
+{
+	ParseProgress result;
+	result.bytesRead = bytesRead;
+	result.totalBytes = m_TotalBytes;
+	result.blobsParsed = m_Blobs;
+	result.primitivesParsed = m_Primitives;
+	result.elapsedSeconds = std::chrono::duration<double>(Clock::now() - m_Start).count();
+
+	if (result.elapsedSeconds > 0.0)
+	{
+		result.bytesPerSecond = result.bytesRead / result.elapsedSeconds;
+		result.primitivesPerSecond = result.primitivesParsed / result.elapsedSeconds;
+	}
+
+	if (result.bytesPerSecond > 0.0 && result.totalBytes >= result.bytesRead)
+		result.etaSeconds = (result.totalBytes - result.bytesRead) / result.bytesPerSecond;
+
+	return result;
+}
+
+void ParseObserver::begin(SizeType totalBytes)
+{
+	m_Cancelled = false;
+	m_Reporting = false;
+	m_Blobs = 0;
+	m_Primitives = 0;
+	m_NextReport = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::milliseconds(m_Interval)).count();
+	m_TotalBytes = totalBytes;
+	m_Start = Clock::now();
+}
+
+bool ParseObserver::blobProcessed(uint64_t primitives)
+{
+	m_Blobs.fetch_add(1, std::memory_order_relaxed);
+	m_Primitives.fetch_add(primitives, std::memory_order_relaxed);
+
+	int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_Start).count();
+	if (now < m_NextReport.load(std::memory_order_relaxed))
+		return false;
+
+	//only one thread reports, the others go on
+	return !m_Reporting.exchange(true, std::memory_order_acquire);
+}
+
+void ParseObserver::report(SizeType bytesRead)
+{
+	progress(snapshot(bytesRead));
+
+	int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_Start).count();
+	m_NextReport = now + std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::milliseconds(m_Interval)).count();
+	m_Reporting.store(false, std::memory_order_release);
+}
+
+void ParseObserver::end(SizeType bytesRead)
+{
+	finished(snapshot(bytesRead));
+}
+
+void ParseObserver::progress(const ParseProgress & /*progress*/) {}
+
+void ParseObserver::finished(const ParseProgress & /*progress*/) {}
+
+} // namespace osmpbf
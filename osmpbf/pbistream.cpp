@@ -1,7 +1,12 @@
 #include <osmpbf/pbistream.h>
 #include <osmpbf/osmfilein.h>
+#include <osmpbf/primitiveblockinputadaptor.h>
+
+#include "osmformat.pb.h"
 #include <assert.h>
 #include <limits>
+#include <stdexcept>
+#include <iostream>
 #include <algorithm>
 
 
@@ -12,6 +17,11 @@ PbiStream::PbiStream() {}
 
 PbiStream::~PbiStream() {}
 
+bool
+PbiStream::failed() const {
+	return false;
+}
+
 } //end namespace interface
 
 namespace imp {
@@ -116,6 +126,7 @@ MultiFilePbiStream::seek(osmpbf::SizeType position) {
 
 SizeType
 MultiFilePbiStream::position() const {
+	std::lock_guard<std::mutex> lck(m_lock);
 	return m_position;
 }
 
@@ -195,6 +206,203 @@ MultiFilePbiStream::parseNext(PrimitiveBlockInputAdaptor& adaptor) {
 	return ok;
 }
 
+ConcurrentMultiFilePbiStream::~ConcurrentMultiFilePbiStream() {}
+
+void
+ConcurrentMultiFilePbiStream::updateExhausted() {
+	std::size_t remaining = 0;
+	for(std::size_t i(0), s(m_files.size()); i < s; ++i) {
+		bool exhausted = !m_files[i].hasNext();
+		m_exhausted[i] = exhausted;
+		remaining += !exhausted;
+	}
+	m_remaining = remaining;
+}
+
+void
+ConcurrentMultiFilePbiStream::markExhausted(std::size_t file) {
+	if (!m_exhausted[file].exchange(true)) {
+		m_remaining.fetch_sub(1);
+	}
+}
+
+void
+ConcurrentMultiFilePbiStream::reset() {
+	for(OSMFileIn & file : m_files) {
+		file.reset();
+	}
+	m_nextFile = 0;
+	updateExhausted();
+}
+
+void
+ConcurrentMultiFilePbiStream::seek(osmpbf::SizeType position) {
+	for(std::size_t i(0), s(m_files.size()); i < s; ++i) {
+		if (position >= m_clDataSize[i+1]) {
+			m_files[i].dataSeek(m_files[i].dataSize());
+		}
+		else if (position > m_clDataSize[i]) {
+			m_files[i].dataSeek(position - m_clDataSize[i]);
+		}
+		else {
+			m_files[i].reset();
+		}
+	}
+	m_nextFile = 0;
+	updateExhausted();
+}
+
+SizeType
+ConcurrentMultiFilePbiStream::position() const {
+	SizeType result = 0;
+	for(const OSMFileIn & file : m_files) {
+		result += file.dataPosition();
+	}
+	return result;
+}
+
+SizeType
+ConcurrentMultiFilePbiStream::size() const {
+	return m_dataSize;
+}
+
+bool
+ConcurrentMultiFilePbiStream::hasNext() const {
+	return m_remaining.load() > 0;
+}
+
+bool
+ConcurrentMultiFilePbiStream::getNext(BlobDataBuffer & buffer) {
+	while (m_remaining.load()) {
+		std::size_t file = m_nextFile.fetch_add(1) % m_files.size();
+		if (m_exhausted[file].load()) {
+			continue;
+		}
+		OSMFileIn & fileIn = m_files[file];
+		if (fileIn.getNextBlock(buffer)) {
+			if (!fileIn.hasNext()) {
+				markExhausted(file);
+			}
+			return true;
+		}
+		// another reader took the last blob of this file, unless the file is broken
+		bool broken = fileIn.hasNext();
+		markExhausted(file);
+		if (broken) {
+			return false;
+		}
+	}
+	return false;
+}
+
+bool
+ConcurrentMultiFilePbiStream::getNext(osmpbf::BlobDataMultiBuffer & buffers, int num) {
+	if (num < 0) {
+		num = std::numeric_limits<int>::max();
+	}
+	BlobDataBuffer tmpBuffer;
+	while(buffers.size() < (std::size_t)num && getNext(tmpBuffer)) {
+		buffers.emplace_back(std::move(tmpBuffer));
+	}
+	return (buffers.size() == (std::size_t)num) || (num == std::numeric_limits<int>::max());
+}
+
+bool
+ConcurrentMultiFilePbiStream::parseNext(PrimitiveBlockInputAdaptor& adaptor) {
+	BlobDataBuffer buffer;
+	if (!getNext(buffer)) {
+		return false;
+	}
+	adaptor.parseData(buffer.data, buffer.availableBytes);
+	return true;
+}
+
+StreamPbiStream::StreamPbiStream(BlobStreamIn * stream) :
+m_stream(stream),
+m_dataOffset(0)
+{
+	BlobDataBuffer buffer;
+	m_stream->readBlob(buffer);
+	if (buffer.type != BLOB_OSMHeader) {
+		throw std::runtime_error("osmpbf::PbiStream: OSM header block not found");
+	}
+	crosby::binary::HeaderBlock header;
+	if (!header.ParseFromArray(buffer.data, buffer.availableBytes)) {
+		throw std::runtime_error("osmpbf::PbiStream: invalid OSM header");
+	}
+	for(int i(0), s(header.required_features_size()); i < s; ++i) {
+		const std::string & feature = header.required_features(i);
+		if (feature != "OsmSchema-V0.6" && feature != "DenseNodes") {
+			throw std::runtime_error("osmpbf::PbiStream: missing required feature of input data: " + feature);
+		}
+	}
+	m_dataOffset = m_stream->position();
+}
+
+StreamPbiStream::~StreamPbiStream() {}
+
+void
+StreamPbiStream::reset() {
+	seek(0);
+}
+
+void
+StreamPbiStream::seek(osmpbf::SizeType position) {
+	if (position != this->position()) {
+		std::cerr << "ERROR: osmpbf::PbiStream: streamed input is not seekable" << std::endl;
+	}
+}
+
+SizeType
+StreamPbiStream::position() const {
+	return m_stream->position() - m_dataOffset;
+}
+
+SizeType
+StreamPbiStream::size() const {
+	return 0;
+}
+
+bool
+StreamPbiStream::hasNext() const {
+	return m_stream->hasNext();
+}
+
+bool
+StreamPbiStream::getNext(BlobDataBuffer & buffer) {
+	do {
+		m_stream->readBlob(buffer);
+	} while (buffer.type == BLOB_OSMHeader);
+	return buffer.type != BLOB_Invalid;
+}
+
+bool
+StreamPbiStream::getNext(osmpbf::BlobDataMultiBuffer & buffers, int num) {
+	if (num < 0) {
+		num = std::numeric_limits<int>::max();
+	}
+	BlobDataBuffer tmpBuffer;
+	while(buffers.size() < (std::size_t)num && getNext(tmpBuffer)) {
+		buffers.emplace_back(std::move(tmpBuffer));
+	}
+	return (buffers.size() == (std::size_t)num) || (num == std::numeric_limits<int>::max());
+}
+
+bool
+StreamPbiStream::parseNext(PrimitiveBlockInputAdaptor& adaptor) {
+	BlobDataBuffer buffer;
+	if (!getNext(buffer)) {
+		return false;
+	}
+	adaptor.parseData(buffer.data, buffer.availableBytes);
+	return true;
+}
+
+bool
+StreamPbiStream::failed() const {
+	return m_stream->failed();
+}
+
 
 }//end namespace imp
 
@@ -209,8 +417,15 @@ PbiStream::PbiStream(OSMFileIn && fileIn) :
 m_priv(std::make_unique<imp::SingleFilePbiStream>(std::move(fileIn)))
 {}
 
-PbiStream::PbiStream(std::vector<OSMFileIn> && files) {
-	if (files.size() > 1) {
+PbiStream::PbiStream(BlobStreamIn * stream) :
+m_priv(std::make_unique<imp::StreamPbiStream>(stream))
+{}
+
+PbiStream::PbiStream(std::vector<OSMFileIn> && files, ReadMode mode) {
+	if (files.size() > 1 && mode == RM_Concurrent) {
+		m_priv = std::make_unique<imp::ConcurrentMultiFilePbiStream>(files.begin(), files.end());
+	}
+	else if (files.size() > 1) {
 		m_priv = std::make_unique<imp::MultiFilePbiStream>(files.begin(), files.end());
 		
 	}
@@ -220,7 +435,7 @@ PbiStream::PbiStream(std::vector<OSMFileIn> && files) {
 	files.clear();
 }
 
-PbiStream::PbiStream(const std::vector<std::string> & fileNames) {
+PbiStream::PbiStream(const std::vector<std::string> & fileNames, ReadMode mode) {
 	std::vector<OSMFileIn> files;
 	files.reserve(fileNames.size());
 	for(const std::string & fileName : fileNames) {
@@ -235,6 +450,9 @@ PbiStream::PbiStream(const std::vector<std::string> & fileNames) {
 	if (files.size() == 1) {
 		m_priv.reset(new imp::SingleFilePbiStream(std::move(files.front())));
 	}
+	else if (files.size() > 1 && mode == RM_Concurrent) {
+		m_priv.reset(new imp::ConcurrentMultiFilePbiStream(files.begin(), files.end()));
+	}
 	else if (files.size() > 1) {
 		m_priv.reset(new imp::MultiFilePbiStream(files.begin(), files.end()));
 	}
@@ -282,6 +500,11 @@ PbiStream::parseNext(PrimitiveBlockInputAdaptor & adaptor) {
 	return m_priv->parseNext(adaptor);
 }
 
+bool
+PbiStream::failed() const {
+	return m_priv->failed();
+}
+
 //convinience functions for easier porting
 
 void
@@ -37,6 +37,7 @@ namespace osmpbf
 
 PrimitiveBlockInputAdaptor::PrimitiveBlockInputAdaptor() :
 	m_PrimitiveBlock(nullptr),
+	m_SpareBlock(nullptr),
 	m_pc(0),
 	m_PlainNodesCount(0),
 	m_DenseNodesCount(0),
@@ -57,11 +58,11 @@ PrimitiveBlockInputAdaptor()
 PrimitiveBlockInputAdaptor::~PrimitiveBlockInputAdaptor()
 {
 	delete m_PrimitiveBlock;
+	delete m_SpareBlock;
 }
 
 void PrimitiveBlockInputAdaptor::parseData(char * rawData, SizeType length, bool unpackDense)
 {
-	delete m_PrimitiveBlock;
 	++m_pc;
 
 	m_PlainNodesGroups.clear();
@@ -69,7 +70,17 @@ void PrimitiveBlockInputAdaptor::parseData(char * rawData, SizeType length, bool
 	m_WaysGroups.clear();
 	m_RelationsGroups.clear();
 
-	m_PrimitiveBlock = new crosby::binary::PrimitiveBlock();
+	m_PlainNodesCount = 0;
+	m_DenseNodesCount = 0;
+	m_WaysCount = 0;
+	m_RelationsCount = 0;
+
+	//reuse the previous block: parsing clears it, but keeps the memory of its strings and repeated fields
+	if (!m_PrimitiveBlock)
+	{
+		m_PrimitiveBlock = m_SpareBlock ? m_SpareBlock : new crosby::binary::PrimitiveBlock();
+		m_SpareBlock = nullptr;
+	}
 
 	if (m_PrimitiveBlock->ParseFromArray((void*)rawData, length))
 	{
@@ -105,7 +116,8 @@ void PrimitiveBlockInputAdaptor::parseData(char * rawData, SizeType length, bool
 		if (!m_PrimitiveBlock->has_stringtable())
 			std::cerr << "no stringtable field found" << std::endl;
 
-		delete m_PrimitiveBlock;
+		m_PrimitiveBlock->Clear();
+		m_SpareBlock = m_PrimitiveBlock;
 		m_PrimitiveBlock = NULL;
 	}
 }
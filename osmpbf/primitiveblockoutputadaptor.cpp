@@ -23,6 +23,8 @@
 #include <osmpbf/oway.h>
 #include <osmpbf/onode.h>
 #include <osmpbf/inode.h>
+#include <osmpbf/irelation.h>
+#include <osmpbf/orelation.h>
 #include <generics/store.h>
 #include <limits>
 
@@ -137,6 +139,30 @@ namespace osmpbf {
 		return m_WaysGroup ? m_WaysGroup->ways_size() : 0;
 	}
 
+	ORelation PrimitiveBlockOutputAdaptor::createRelation() {
+		if (!m_RelationsGroup)
+			m_RelationsGroup = m_PrimitiveBlock->add_primitivegroup();
+
+		return ORelation(new RelationOutputAdaptor(this, m_RelationsGroup->add_relations()));
+	}
+
+	ORelation PrimitiveBlockOutputAdaptor::createRelation(const IRelation & templateIRelation) {
+		ORelation result = createRelation();
+
+		// set fields for new relation
+		result.setId(templateIRelation.id());
+		for (IMemberStream member = templateIRelation.getMemberStream(); !member.isNull(); member.next())
+			result.addMember(member.id(), member.type(), member.role());
+		for (int i = 0; i < templateIRelation.tagsSize(); i++)
+			result.addTag(templateIRelation.key(i), templateIRelation.value(i));
+
+		return result;
+	}
+
+	int PrimitiveBlockOutputAdaptor::relationsSize() const {
+		return m_RelationsGroup ? m_RelationsGroup->relations_size() : 0;
+	}
+
 	void PrimitiveBlockOutputAdaptor::setGranularity(int32_t value) {
 		m_PrimitiveBlock->set_granularity(value);
 	}
@@ -325,6 +351,21 @@ namespace osmpbf {
 			}
 		}
 
+		// prepare relations
+		if (m_RelationsGroup) {
+			google::protobuf::RepeatedPtrField<crosby::binary::Relation>::iterator relationIt = m_RelationsGroup->mutable_relations()->begin();
+			while (relationIt != m_RelationsGroup->mutable_relations()->end()) {
+				// encode member ids and correct role string ids
+				deltaEncode<int64_t>(relationIt->mutable_memids()->mutable_data(), relationIt->mutable_memids()->mutable_data() + relationIt->memids_size());
+				for (int i = 0; i < relationIt->roles_sid_size(); i++)
+					relationIt->set_roles_sid(i, stringIdTable[relationIt->roles_sid(i)]);
+
+				cleanUpTags<crosby::binary::Relation>(*relationIt, stringIdTable);
+
+				++relationIt;
+			}
+		}
+
 		delete[] stringIdTable;
 
 		assert(m_PrimitiveBlock->IsInitialized());
@@ -352,4 +393,8 @@ namespace osmpbf {
 	PrimitiveBlockOutputAdaptor & PrimitiveBlockOutputAdaptor::operator<<(IWay & way) {
 		 createWay(way); return *this;
 	}
+
+	PrimitiveBlockOutputAdaptor & PrimitiveBlockOutputAdaptor::operator<<(IRelation & relation) {
+		 createRelation(relation); return *this;
+	}
 }
@@ -0,0 +1,214 @@
+/*
+    This file is part of the osmpbf library.
+
+    Copyright(c) 2014 Oliver Groß.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 3 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, see
+    <http://www.gnu.org/licenses/>.
+ */
+
+#include <osmpbf/regexmatcher.h>
+
+#include <cstring>
+#include <functional>
+
+namespace osmpbf
+{
+
+constexpr std::size_t RegexMatcher::SHARD_COUNT;
+constexpr std::size_t RegexMatcher::MAX_SHARD_ENTRIES;
+
+RegexMatcher::RegexMatcher() :
+m_MatchFlags(std::regex_constants::match_default)
+{}
+
+RegexMatcher::RegexMatcher(const std::string & pattern, std::regex_constants::match_flag_type flags) :
+m_Regex(pattern),
+m_MatchFlags(flags)
+{
+	extractLiterals(pattern);
+}
+
+RegexMatcher::RegexMatcher(const std::regex & regex, std::regex_constants::match_flag_type flags) :
+m_Regex(regex),
+m_MatchFlags(flags)
+{}
+
+bool RegexMatcher::matches(const std::string & str) const
+{
+	if (!prefilter(str))
+		return false;
+
+	Shard & shard = m_Shards[std::hash<std::string>()(str) % SHARD_COUNT];
+
+	{
+		std::lock_guard<std::mutex> lck(shard.lock);
+		std::unordered_map<std::string, bool>::const_iterator it = shard.memo.find(str);
+		if (it != shard.memo.cend())
+			return it->second;
+	}
+
+	//match outside of the lock, concurrent threads may compute the same result twice
+	bool result = std::regex_match(str, m_Regex, m_MatchFlags);
+
+	std::lock_guard<std::mutex> lck(shard.lock);
+	if (shard.memo.size() >= MAX_SHARD_ENTRIES)
+		shard.memo.clear();
+	shard.memo.emplace(str, result);
+
+	return result;
+}
+
+std::size_t RegexMatcher::memoSize() const
+{
+	std::size_t result = 0;
+	for (Shard & shard : m_Shards)
+	{
+		std::lock_guard<std::mutex> lck(shard.lock);
+		result += shard.memo.size();
+	}
+	return result;
+}
+
+void RegexMatcher::clearMemo()
+{
+	for (Shard & shard : m_Shards)
+	{
+		std::lock_guard<std::mutex> lck(shard.lock);
+		shard.memo.clear();
+	}
+}
+
+bool RegexMatcher::prefilter(const std::string & str) const
+{
+	if (str.size() < m_RequiredPrefix.size() || str.compare(0, m_RequiredPrefix.size(), m_RequiredPrefix) != 0)
+		return false;
+
+	if (!m_RequiredSubstring.empty() && str.find(m_RequiredSubstring) == std::string::npos)
+		return false;
+
+	return true;
+}
+
+void RegexMatcher::extractLiterals(const std::string & pattern)
+{
+	const std::regex::flag_type grammars = std::regex_constants::basic | std::regex_constants::extended |
+		std::regex_constants::awk | std::regex_constants::grep | std::regex_constants::egrep;
+
+	if ((m_Regex.flags() & (std::regex_constants::icase | grammars)) || m_MatchFlags != std::regex_constants::match_default)
+		return;
+
+	//any alternation may bypass a literal
+	if (pattern.find('|') != std::string::npos)
+		return;
+
+	std::string prefix, run, longest;
+	bool prefixOpen = true;
+	bool lastWasLiteral = false;
+	int depth = 0;
+
+	std::size_t i = (!pattern.empty() && pattern[0] == '^') ? 1 : 0;
+	while (i < pattern.size())
+	{
+		char c = pattern[i];
+		bool literal = false;
+
+		if (c == '\\')
+		{
+			//escaped punctuation is a literal, anything else (\d, \w, \b, ...) is a class or an assertion
+			if (i + 1 < pattern.size() && std::ispunct((unsigned char) pattern[i + 1]))
+			{
+				c = pattern[i + 1];
+				literal = true;
+			}
+			i += 2;
+		}
+		else if (c == '*' || c == '?' || c == '{')
+		{
+			//the previous literal is optional
+			if (lastWasLiteral)
+			{
+				run.pop_back();
+				if (prefixOpen)
+					prefix.pop_back();
+			}
+
+			if (c == '{')
+			{
+				std::size_t end = pattern.find('}', i);
+				i = (end == std::string::npos) ? pattern.size() : end + 1;
+			}
+			else
+			{
+				++i;
+			}
+		}
+		else if (c == '[')
+		{
+			//skip the character class, a leading ']' or '^]' is part of it
+			std::size_t j = i + 1;
+			if (j < pattern.size() && pattern[j] == '^')
+				++j;
+			if (j < pattern.size() && pattern[j] == ']')
+				++j;
+			while (j < pattern.size() && pattern[j] != ']')
+				j += (pattern[j] == '\\') ? 2 : 1;
+			i = j + 1;
+		}
+		else if (c == '(')
+		{
+			++depth;
+			++i;
+		}
+		else if (c == ')')
+		{
+			--depth;
+			++i;
+		}
+		else if (std::strchr(".+^$", c))
+		{
+			++i;
+		}
+		else
+		{
+			literal = true;
+			++i;
+		}
+
+		//literals inside groups may be optional or repeated
+		if (literal && !depth)
+		{
+			run.push_back(c);
+			if (prefixOpen)
+				prefix.push_back(c);
+			lastWasLiteral = true;
+			continue;
+		}
+
+		if (run.size() > longest.size())
+			longest = run;
+		run.clear();
+		prefixOpen = false;
+		lastWasLiteral = false;
+	}
+
+	if (run.size() > longest.size())
+		longest = run;
+
+	m_RequiredPrefix = prefix;
+	if (longest.size() > prefix.size())
+		m_RequiredSubstring = longest;
+}
+
+} // namespace osmpbf